@@ -2,18 +2,383 @@
 /// \brief Implementation of primary interface for Pricer.
 //
 // Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include <string>
 #include "Pricer.h"
 #include "PricerParser.h"
 #include "PricerStream.h"
+#include "PricerSys.h"
+#include "PricerShm.h"
+#include "PricerSnapshot.h"
+#include "PricerMetrics.h"
+#include "PricerTrace.h"
+
+/// Parser type used by all the entry points.
+typedef PricerParser<PricerInputStream,PricerOutputStream> PricerStreamParser;
+
+/// State behind a PricerHandle.
+struct PricerInstance
+{
+   PricerInstance()
+   : fShm(),
+     fParser(),
+     fInput(-1,0),
+     fOutput(-1,0),
+     fErr(-1,0),
+     fPartial(),
+     fOutFunc(0),
+     fErrFunc(0),
+     fContext(0),
+     fQuoteSink(0),
+     fArraySink(0),
+     fSnapshots(0),
+     fSnapshotInterval(0),
+     fSinceSnapshot(0)
+   {
+   }
+
+   ~PricerInstance()
+   {
+      delete fQuoteSink;
+      delete fSnapshots;
+   }
+
+   /// Replaces the quote sink (0 for text output). Takes ownership.
+   void SetQuoteSink(PricerQuoteSink* sink, PricerArraySink* arraySink)
+   {
+      fParser.SetQuoteSink(sink);
+      delete fQuoteSink;
+      fQuoteSink = sink;
+      fArraySink = arraySink;
+   }
+
+   /// Publishes the book as it stands to the snapshot readers.
+   void PublishSnapshot()
+   {
+      PricerSnapshot* snapshot = fSnapshots->Prepare();
+      fParser.GetSnapshot(*snapshot);
+      fSnapshots->Publish(snapshot);
+      fSinceSnapshot = 0;
+   }
+
+   PricerShmPublisher   fShm;       ///< Latest quotes, if shmName's set.
+   PricerStreamParser   fParser;
+   PricerInputStream    fInput;     ///< Points at the caller's chunks.
+   PricerOutputStream   fOutput;    ///< Bids and asks, to fOutFunc.
+   PricerOutputStream   fErr;       ///< Diagnostics, to fErrFunc.
+   std::string          fPartial;   ///< Unterminated line between feeds.
+
+   PricerWriteFunc      fOutFunc;
+   PricerWriteFunc      fErrFunc;
+   void*                fContext;
+
+   PricerQuoteSink*     fQuoteSink;  ///< Event sink, or 0 for text.
+   PricerArraySink*     fArraySink;  ///< fQuoteSink if it's an array.
+
+   PricerSnapshots*     fSnapshots;  ///< For PricerReadCost(), or 0.
+   int                  fSnapshotInterval;
+   int                  fSinceSnapshot;    ///< Messages since the last.
+};
+
+/// Stream callback adapters - the user callbacks may use PRICER_CALL.
+static int PricerInstanceWriteOut(void* context, const char* data, int length)
+{
+   PricerInstance* instance = (PricerInstance*)context;
+   return instance->fOutFunc(instance->fContext,data,length);
+}
+
+static int PricerInstanceWriteErr(void* context, const char* data, int length)
+{
+   PricerInstance* instance = (PricerInstance*)context;
+   return instance->fErrFunc(instance->fContext,data,length);
+}
+
+/// Runs every message in [data, data+length), which must
+/// end on a line boundary.
+static int PricerInstanceRun(PricerInstance* instance,
+                             const char*     data,
+                             int             length)
+{
+   int result = kPR_Success;
+   instance->fInput.SetBuffer(data,length);
+
+   for (;;)
+   {
+      ePricerResult res = instance->fParser.ProcessNext(instance->fInput);
+      if (kPR_Exit == res)
+         break;
+
+      if ((instance->fSnapshots) &&
+          (++instance->fSinceSnapshot >= instance->fSnapshotInterval))
+      {
+         instance->PublishSnapshot();
+      }
+
+      if (kPR_OrderNotFound == res)
+      {
+         // Pricer() stops here. In-process we report it and carry on.
+         PricerStreamParser::PricerOutputError(res,instance->fErr);
+         result = res;
+      }
+      else if (PRICERERR(res))
+      {
+         result = res;
+      }
+   }
+   return result;
+}
+
+void PRICER_CALL PricerInitOptions(PricerOptions* options)
+{
+   memset(options,0,sizeof(PricerOptions));
+   options->batchLatencyUsec = 0;
+   options->batchSize        = PRICER_BATCH_SIZE;
+   options->ioUring          = 0;
+   options->mmapOutput       = 0;
+   options->latencyMode      = 0;
+   options->cpu              = -1;
+   options->checkpointFile     = 0;
+   options->checkpointInterval = 0;
+   options->restoreFile        = 0;
+   options->windowStart        = 0;
+   options->windowEnd          = 0xffffffff;
+   options->indexFile          = 0;
+   options->follow             = 0;
+   options->depthIndex         = 0;
+   options->lazyBook           = 0;
+   options->coalesce           = 0;
+   memset(&options->bidFilter,0,sizeof(options->bidFilter));
+   memset(&options->askFilter,0,sizeof(options->askFilter));
+   options->hugePages          = 0;
+   options->preallocOrders     = 0;
+   options->readerCpu          = -1;
+   options->serverMaxLag       = PRICER_SERVER_MAX_LAG;
+   options->shmName            = 0;
+   options->snapshotInterval   = 0;
+   options->metricsFile        = 0;
+   options->metricsInterval    = 10;
+   options->traceFile          = PRICER_TRACE_FILE;
+   options->traceEvents        = PRICER_TRACE_EVENTS;
+}
+
+/// Applies the I/O options to the streams.
+static void PricerSetupStreams(const PricerOptions* options,
+                               PricerInputStream&   inputStream,
+                               PricerOutputStream&  askStream,
+                               PricerOutputStream&  bidStream)
+{
+   // Follow a growing input file. Anything held in the output goes
+   // out whenever we wait for it.
+   if ((options->follow) && (inputStream.EnableFollow()))
+   {
+      inputStream.AddIdleFlush(&askStream);
+      inputStream.AddIdleFlush(&bidStream);
+   }
+
+   // Latency mode: spin on the input and get every quote out
+   // immediately. Batching/mapping/async don't apply.
+   if (options->latencyMode)
+   {
+      inputStream.SetBusyPoll();
+      askStream.SetLineFlush();
+      bidStream.SetLineFlush();
+      return;
+   }
+
+   // Batch pipe/socket output if requested, flushing whenever
+   // the input runs dry.
+   if (options->batchLatencyUsec > 0)
+   {
+      askStream.SetBatching(options->batchSize,options->batchLatencyUsec);
+      bidStream.SetBatching(options->batchSize,options->batchLatencyUsec);
+      inputStream.AddIdleFlush(&askStream);
+      inputStream.AddIdleFlush(&bidStream);
+   }
+
+   // Map regular output files if asked - this takes precedence
+   // over io_uring for those streams.
+   if (options->mmapOutput)
+   {
+      askStream.EnableMappedFile();
+      if (&bidStream != &askStream)
+         bidStream.EnableMappedFile();
+   }
+
+   // Async I/O if asked for and available - silently stays
+   // synchronous otherwise.
+   if (options->ioUring)
+   {
+      inputStream.EnableUring();
+      askStream.EnableUring();
+      if (&bidStream != &askStream)
+         bidStream.EnableUring();
+   }
+}
+
+/// Writes where the pricing and reader threads were placed - their
+/// CPUs, and the NUMA nodes their memory is on.
+static void PricerReportPlacement(const PricerOptions* options,
+                                  bool                 pinned,
+                                  PricerInputStream&   inputStream,
+                                  PricerOutputStream&  errStream)
+{
+   char buf[160];
+   int  len = sprintf(buf,"Placement: pricer ");
+   int  node = pinned ? PricerSysCpuNode(options->cpu) : -1;
+   if (!pinned)
+      len += sprintf(buf + len,"unpinned");
+   else if (node < 0)
+      len += sprintf(buf + len,"cpu %d",options->cpu);
+   else
+      len += sprintf(buf + len,"cpu %d, memory on node %d",options->cpu,node);
+
+   int readerCpu;
+   int readerNode;
+   inputStream.GetReaderPlacement(readerCpu,readerNode);
+   len += sprintf(buf + len,"; reader ");
+   if (!inputStream.IsDecompressing())
+      sprintf(buf + len,"none (input not compressed)");
+   else if (readerCpu < 0)
+      sprintf(buf + len,"unpinned");
+   else if (readerNode < 0)
+      sprintf(buf + len,"cpu %d",readerCpu);
+   else
+      sprintf(buf + len,"cpu %d, buffers on node %d",readerCpu,readerNode);
+
+   errStream << buf << "\n";
+}
+
+/// Applies the process/thread options (memory locking, pre-faulting).
+/// The pricing thread is already pinned - pinned is false if that 
+/// failed.  Failures are reported to errStream but aren't fatal.
+static void PricerSetupSystem(const PricerOptions* options,
+                              bool                 pinned,
+                              PricerInputStream&   inputStream,
+                              PricerOutputStream&  askStream,
+                              PricerOutputStream&  bidStream,
+                              PricerOutputStream&  errStream)
+{
+   bool ok = (options->cpu < 0) || (pinned);
+
+   if (options->latencyMode)
+   {
+      // Lock down and fault in everything we'll touch on the
+      // hot path, so the first messages don't pay for it.
+      ok = PricerSysLockMemory() && ok;
+      PricerSysPrefaultStack(PRICER_PREFAULT_STACK);
+   }
+
+   if ((options->latencyMode) || (options->preallocOrders > 0))
+   {
+      inputStream.Prefault();
+      askStream.Prefault();
+      bidStream.Prefault();
+   }
+
+   if (!ok)
+      errStream << PricerGetResultString(kPR_SysSetupFailed);
+}
+
+/// Writes a checkpoint, and with an index, lists it there.
+/// Indexed checkpoints are kept - each is named for its input offset.
+static bool PricerWriteCheckpoint(const PricerOptions* options,
+                                  PricerStreamParser&  parser,
+                                  PXInt64              offset)
+{
+   if (0 == options->indexFile)
+      return parser.SaveCheckpoint(options->checkpointFile,offset);
+
+   char suffix[32];
+   sprintf(suffix,".%lld",(long long)offset);
+   std::string path = options->checkpointFile;
+   path += suffix;
+
+   return parser.SaveCheckpoint(path.c_str(),offset) &&
+          PricerCheckpointIndex::Append(options->indexFile,
+                                        parser.GetTimeStamp(),
+                                        offset,
+                                        path.c_str());
+}
+
+/// Processes the input to the end like PricerStreamParser::Run(),
+/// writing checkpoints as the options ask.  The output is flushed 
+/// first, so it's complete up to the checkpoint.
+static int PricerRunCheckpointed(const PricerOptions* options,
+                                 PricerStreamParser&  parser,
+                                 PricerInputStream&   inputStream,
+                                 PricerOutputStream&  askStream,
+                                 PricerOutputStream&  bidStream,
+                                 PricerOutputStream&  errStream)
+{
+   PricerSysWatchSignal(kPSS_Checkpoint);
+
+   int sinceCheckpoint = 0;
+   for (;;)
+   {
+      ePricerResult result = parser.ProcessNext(inputStream);
+      bool atEnd = (kPR_Exit == result);
+
+      if (kPR_OrderNotFound == result)
+      {
+         parser.FlushQuotes();
+         return kPR_InvalidData;
+      }
+
+      // Stopped at a message past the window that wasn't applied.
+      if ((atEnd) && (parser.IsPastWindow()))
+         break;
+
+      if ((atEnd) ||
+          ((options->checkpointInterval > 0) && 
+           (++sinceCheckpoint >= options->checkpointInterval)) ||
+          (PricerSysTakeSignal(kPSS_Checkpoint)))
+      {
+         parser.FlushQuotes();
+         askStream.Flush();
+         bidStream.Flush();
+         if (!PricerWriteCheckpoint(options,parser,inputStream.GetOffset()))
+         {
+            errStream << PricerGetResultString(kPR_CheckpointFailed);
+         }
+         sinceCheckpoint = 0;
+      }
+
+      if (atEnd)
+         break;
+   }
+   return parser.GetResult();
+}
 
 int PRICER_CALL Pricer(   int targetShares,
                           int inFileNum,
                           int outAskNum,
                           int outBidNum,
                           int outErrNum)
+{
+   return PricerEx(targetShares,inFileNum,outAskNum,outBidNum,outErrNum,0);
+}
+
+int PRICER_CALL PricerEx( int                   targetShares,
+                          int                   inFileNum,
+                          int                   outAskNum,
+                          int                   outBidNum,
+                          int                   outErrNum,
+                          const PricerOptions*  options)
 {
    int result;
-   PricerParser<PricerInputStream,PricerOutputStream> parser;
+   PricerOptions defaults;
+   if (0 == options)
+   {
+      PricerInitOptions(&defaults);
+      options = &defaults;
+   }
+
+   // Before anything is allocated, so this thread's memory is first
+   // touched - and so placed - on its CPU's NUMA node.
+   bool pinned = (options->cpu >= 0) && PricerSysPinThread(options->cpu);
+
+   PricerShmPublisher    shm;
+   PricerMetricsExporter metrics;
+   PricerStreamParser    parser;
    PricerOutputStream errStream(outErrNum,PRICER_BUFFER_SIZE);
 
    // run debug test w/o args if defined.
@@ -26,6 +391,16 @@ int PRICER_CALL Pricer(   int targetShares,
 
    // Wrap handles in (possibly) buffered streams.
    PricerInputStream inputStream(inFileNum,PRICER_BUFFER_SIZE);
+
+   // Compressed logs are decompressed on a thread of their own.
+   ePricerCompression compression = inputStream.EnableDecompress(options->readerCpu);
+   if ((kPC_None != compression) && (!inputStream.IsDecompressing()))
+   {
+      result = kPR_NoDecompressor;
+      parser.PricerOutputError(result,errStream);
+      return result;
+   }
+
    PricerOutputStream askStream( outAskNum,PRICER_BUFFER_SIZE);
 
    // Usually we'll have bid/ask going to the same stream.
@@ -34,11 +409,138 @@ int PRICER_CALL Pricer(   int targetShares,
    if (outAskNum != outBidNum)
       bidStream = new PricerOutputStream(outBidNum,PRICER_BUFFER_SIZE);
 
-   result = parser.ProcessStream(targetShares,
-                                 inputStream,
-                                 askStream,
-                                 *bidStream,
-                                 errStream);
+   // Before any orders are allocated, checkpoint ones included.
+   parser.SetMemory(0 != options->hugePages, options->preallocOrders);
+   parser.Start(targetShares, askStream, *bidStream, errStream);
+   parser.SetWindow(options->windowStart, options->windowEnd);
+   parser.SetLazyBooks(0 != options->lazyBook);
+   parser.SetCoalesce(0 != options->coalesce);
+   parser.SetPublishFilters(options->bidFilter,options->askFilter);
+
+   if (options->shmName)
+   {
+      if (!shm.Open(options->shmName))
+      {
+         result = kPR_ShmFailed;
+         parser.PricerOutputError(result,errStream);
+         if (outAskNum != outBidNum)
+            delete bidStream;
+         return result;
+      }
+      parser.SetStateSink(&shm);
+   }
+
+   // Replaying a window - start from the last indexed checkpoint 
+   // before it if there is one.
+   std::string restoreFile;
+   if (options->restoreFile)
+   {
+      restoreFile = options->restoreFile;
+   }
+   else if ((options->indexFile) && (options->windowStart > 0))
+   {
+      PricerCheckpointIndex::FindBefore(options->indexFile,
+                                        options->windowStart,
+                                        restoreFile);
+   }
+
+   // Pick up where a checkpoint left off - the books, then the input.
+   if (!restoreFile.empty())
+   {
+      PXInt64 offset = 0;
+      if ((!parser.LoadCheckpoint(restoreFile.c_str(),offset)) ||
+          (!inputStream.SeekTo(offset)))
+      {
+         result = kPR_CheckpointFailed;
+         parser.PricerOutputError(result,errStream);
+         if (outAskNum != outBidNum)
+            delete bidStream;
+         return result;
+      }
+   }
+
+   PricerSetupStreams(options, inputStream, askStream, *bidStream);
+   PricerSetupSystem(options, pinned, inputStream, askStream, *bidStream,
+                     errStream);
+   if ((options->cpu >= 0) || (options->readerCpu >= 0))
+      PricerReportPlacement(options, pinned, inputStream, errStream);
+   if ((options->hugePages) || (options->preallocOrders > 0))
+      parser.ReportMemory(errStream);
+
+   if (options->metricsFile)
+   {
+      metrics.SetSources(&parser.GetCounters(),
+                         &parser.GetBuyCounters(),
+                         &parser.GetSellCounters(),
+                         &askStream.GetCounters(),
+                         &bidStream->GetCounters());
+      if (!metrics.Start(options->metricsFile,options->metricsInterval))
+      {
+         result = kPR_MetricsFailed;
+         parser.PricerOutputError(result,errStream);
+         if (outAskNum != outBidNum)
+            delete bidStream;
+         return result;
+      }
+   }
+
+#if (PRICER_TRACE > 0)
+   PricerTraceRing* trace = 0;
+   if (options->traceFile)
+   {
+      trace = new PricerTraceRing(options->traceFile,options->traceEvents);
+      parser.SetTrace(trace);
+      PricerSysWatchSignal(kPSS_Dump);
+   }
+#endif
+
+#if (PRICER_LATENCY_STATS > 0)
+   PricerSysWatchSignal(kPSS_Stats);
+   parser.TimeWrites(askStream);
+   if (bidStream != &askStream)
+      parser.TimeWrites(*bidStream);
+#endif
+
+   if (options->checkpointFile)
+   {
+      result = PricerRunCheckpointed(options, parser, inputStream, 
+                                     askStream, *bidStream, errStream);
+   }
+   else
+   {
+      result = parser.Run(inputStream);
+   }
+
+   // Input that ended on a read/decompression error.
+   if ((PRICEROK(result)) && (inputStream.bad()))
+   {
+      result = kPR_InvalidInStream;
+      parser.PricerOutputError(result,errStream);
+   }
+
+#if (PRICER_LATENCY_STATS > 0)
+   parser.ReportLatency(errStream);
+#endif
+
+#if (PRICER_TRACE > 0)
+   if (trace)
+   {
+      parser.SetTrace(0);
+
+      // The quotes are out; a lost dump is worth saying, not failing for.
+      if (!trace->Dump())
+         parser.PricerOutputError(kPR_TraceFailed,errStream);
+      delete trace;
+   }
+#endif
+
+   // Final counts, output included, while the streams are still around.
+   if (options->metricsFile)
+   {
+      askStream.Flush();
+      bidStream->Flush();
+      metrics.Stop();
+   }
 
    // clean up if bid/ask actually were going to different streams.
    if (outAskNum != outBidNum)
@@ -47,16 +549,273 @@ int PRICER_CALL Pricer(   int targetShares,
    return result;
 }
 
+PricerHandle PRICER_CALL PricerCreate(int                   targetShares,
+                                      PricerWriteFunc       outFunc,
+                                      PricerWriteFunc       errFunc,
+                                      void*                 context,
+                                      const PricerOptions*  options)
+{
+   if ((0 >= targetShares)  || (targetShares == INT_MAX) || (0 == outFunc))
+      return 0;
+
+   PricerInstance* instance = new PricerInstance();
+   instance->fOutFunc = outFunc;
+   instance->fErrFunc = errFunc;
+   instance->fContext = context;
+
+   instance->fOutput.SetWriteCallback(PricerInstanceWriteOut, instance,
+                                      PRICER_BUFFER_SIZE);
+   instance->fErr.SetWriteCallback(errFunc ? PricerInstanceWriteErr : 0,
+                                   instance, 256);
+
+   instance->fParser.Start(targetShares,
+                           instance->fOutput,
+                           instance->fOutput,
+                           instance->fErr);
+   if (options)
+   {
+      instance->fParser.SetWindow(options->windowStart,options->windowEnd);
+      if (options->depthIndex)
+         instance->fParser.EnableDepthIndex();
+      instance->fParser.SetLazyBooks(0 != options->lazyBook);
+      instance->fParser.SetCoalesce(0 != options->coalesce);
+      instance->fParser.SetPublishFilters(options->bidFilter,
+                                          options->askFilter);
+      instance->fParser.SetMemory(0 != options->hugePages,
+                                  options->preallocOrders);
+      if (options->shmName)
+      {
+         if (!instance->fShm.Open(options->shmName))
+         {
+            delete instance;
+            return 0;
+         }
+         instance->fParser.SetStateSink(&instance->fShm);
+      }
+      if (options->snapshotInterval > 0)
+      {
+         // Readers always have one to look at, if only an empty book.
+         instance->fSnapshots        = new PricerSnapshots();
+         instance->fSnapshotInterval = options->snapshotInterval;
+         instance->PublishSnapshot();
+      }
+   }
+   return instance;
+}
+
+int PRICER_CALL PricerFeed(PricerHandle handle, const char* data, int length)
+{
+   if ((0 == handle) || (0 > length) || ((0 == data) && (0 != length)))
+      return kPR_InvalidData;
+
+   const char* end = data + length;
+
+   // Find the last complete line - everything after it waits
+   // for the next chunk.
+   const char* lastLine = end;
+   while ((lastLine != data) && (lastLine[-1] != '\n'))
+      --lastLine;
+
+   if (lastLine == data)
+   {
+      handle->fPartial.append(data,length);
+      return kPR_Success;
+   }
+
+   int result = kPR_Success;
+   const char* start = data;
+
+   // Finish off the line held from the last chunk. That's the
+   // only copy - whole lines are parsed where they are.
+   if (!handle->fPartial.empty())
+   {
+      const char* lineEnd = (const char*)memchr(data,'\n',length) + 1;
+      handle->fPartial.append(data,lineEnd - data);
+      result = PricerInstanceRun(handle,
+                                 handle->fPartial.data(),
+                                 (int)handle->fPartial.size());
+      handle->fPartial.clear();
+      start = lineEnd;
+   }
+
+   if (start != lastLine)
+   {
+      int res = PricerInstanceRun(handle,start,(int)(lastLine - start));
+      if (PRICERERR(res))
+         result = res;
+   }
+
+   handle->fPartial.assign(lastLine,end - lastLine);
+
+   if ((handle->fArraySink) && (handle->fArraySink->TakeDropped()))
+      result = kPR_QuoteOverflow;
+
+   return result;
+}
+
+int PRICER_CALL PricerFlush(PricerHandle handle)
+{
+   if (0 == handle)
+      return kPR_InvalidData;
+
+   handle->fParser.FlushQuotes();
+   if ((handle->fSnapshots) && (handle->fSinceSnapshot > 0))
+      handle->PublishSnapshot();
+   handle->fOutput.Flush();
+   handle->fErr.Flush();
+
+   if (handle->fOutput.HadWriteError() || handle->fErr.HadWriteError())
+      return kPR_InvalidData;
+   return kPR_Success;
+}
+
+int PRICER_CALL PricerSetQuoteCallback(PricerHandle    handle,
+                                       PricerQuoteFunc func,
+                                       void*           context)
+{
+   if (0 == handle)
+      return kPR_InvalidData;
+
+   handle->fOutput.Flush();
+   handle->SetQuoteSink(func ? new PricerCallbackSink(func,context) : 0, 0);
+   return kPR_Success;
+}
+
+int PRICER_CALL PricerSetQuoteArray(PricerHandle      handle,
+                                    PricerQuoteEvent* events,
+                                    int               capacity)
+{
+   if ((0 == handle) || ((events) && (capacity <= 0)))
+      return kPR_InvalidData;
+
+   handle->fOutput.Flush();
+
+   PricerArraySink* sink = events ? new PricerArraySink(events,capacity) : 0;
+   handle->SetQuoteSink(sink,sink);
+   return kPR_Success;
+}
+
+int PRICER_CALL PricerTakeQuotes(PricerHandle handle)
+{
+   if ((0 == handle) || (0 == handle->fArraySink))
+      return 0;
+   return handle->fArraySink->Take();
+}
+
+int PRICER_CALL PricerQueryCost(PricerHandle handle,
+                                char         side,
+                                int          shares,
+                                long long*   totalPrice)
+{
+   PXInt64 total    = 0;
+   PXInt64 marginal = 0;
+   if ((0 == handle) || (0 == totalPrice) ||
+       (!handle->fParser.QueryCost(side,shares,total,marginal)))
+   {
+      return kPR_InvalidData;
+   }
+
+   *totalPrice = total;
+   return kPR_Success;
+}
+
+PricerReader PRICER_CALL PricerOpenReader(PricerHandle handle)
+{
+   if ((0 == handle) || (0 == handle->fSnapshots))
+      return 0;
+
+   int slot = handle->fSnapshots->AddReader();
+   if (slot < 0)
+      return 0;
+
+   PricerSnapshotReader* reader = new PricerSnapshotReader();
+   reader->fSnapshots = handle->fSnapshots;
+   reader->fSlot      = slot;
+   return reader;
+}
+
+int PRICER_CALL PricerReadCost(PricerReader   reader,
+                               char           side,
+                               long long      shares,
+                               long long*     totalPrice,
+                               unsigned int*  timeStamp)
+{
+   if ((0 == reader) || (0 == totalPrice))
+      return kPR_InvalidData;
+
+   PXInt64 total    = 0;
+   PXInt64 marginal = 0;
+   const PricerSnapshot* snapshot = reader->fSnapshots->Enter(reader->fSlot);
+   bool     found   = snapshot->Query(side,shares,total,marginal);
+   PXUInt32 stamp   = snapshot->fTimeStamp;
+   reader->fSnapshots->Leave(reader->fSlot);
+
+   if (!found)
+      return kPR_InvalidData;
+
+   *totalPrice = total;
+   if (timeStamp)
+      *timeStamp = stamp;
+   return kPR_Success;
+}
+
+void PRICER_CALL PricerCloseReader(PricerReader reader)
+{
+   if (0 == reader)
+      return;
+
+   reader->fSnapshots->RemoveReader(reader->fSlot);
+   delete reader;
+}
+
+int PRICER_CALL PricerSetTarget(PricerHandle handle, int targetShares)
+{
+   if (0 == handle)
+      return kPR_InvalidData;
+   return handle->fParser.SetTargetShares(targetShares);
+}
+
+int PRICER_CALL PricerAddTarget(PricerHandle handle, int targetShares)
+{
+   if (0 == handle)
+      return kPR_InvalidData;
+   return handle->fParser.AddTarget(targetShares);
+}
+
+int PRICER_CALL PricerRemoveTarget(PricerHandle handle, int targetShares)
+{
+   if (0 == handle)
+      return kPR_InvalidData;
+   return handle->fParser.RemoveTarget(targetShares);
+}
+
+void PRICER_CALL PricerDestroy(PricerHandle handle)
+{
+   if (0 == handle)
+      return;
+
+   PricerFlush(handle);
+   delete handle;
+}
+
 const char* PRICER_CALL PricerGetResultString(int result)
 {
    const char* msg;
    switch(result)
    {
+      case kPR_TraceFailed:      msg="Could not dump flight recorder.\n"; break;
+      case kPR_MetricsFailed:    msg="Could not write metrics file.\n";  break;
+      case kPR_ShmFailed:        msg="Could not map shared memory.\n";    break;
+      case kPR_ServerFailed:     msg="Could not start the server.\n";    break;
+      case kPR_NoDecompressor:   msg="Input compression not supported.\n"; break;
+      case kPR_CheckpointFailed: msg="Checkpoint write/restore failed.\n"; break;
+      case kPR_QuoteOverflow:    msg="Quote array full.\n";              break;
+      case kPR_SysSetupFailed:   msg="Could not apply system settings.\n"; break;
       case kPR_InvalidInStream:  msg="Input stream invalid.\n";           break;
       case kPR_ParserError:      msg="Parser error.\n";                   break;
       case kPR_ReduceOutOfRange: msg="Not enough shares for reduce.\n";   break;
       case kPR_OrderNotFound:    msg="No matching Add found.\n";          break;
-      case kPR_InvalidCmdLine:   msg="Usage: pricer [targetNumShares]\n"; break;
+      case kPR_InvalidCmdLine:   msg="Usage: pricer [options] targetNumShares\n"; break;
       case kPR_OutOfMemory:      msg="Error allocating memory.\n";        break;
       case kPR_InvalidData:      msg="Invalid input data.\n";             break;
       case kPR_Success:          msg="Success.\n";                        break;
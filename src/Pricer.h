@@ -18,6 +18,14 @@ extern "C" {
  */
 enum ePricerResult
 {
+   kPR_TraceFailed      = -16, /*!< The flight recorder couldn't be dumped */
+   kPR_MetricsFailed    = -15, /*!< The metrics file couldn't be written */
+   kPR_ShmFailed        = -14, /*!< The shared-memory segment couldn't be mapped */
+   kPR_ServerFailed     = -13, /*!< The server couldn't listen on its address */
+   kPR_NoDecompressor   = -12, /*!< Input is compressed in an unsupported format */
+   kPR_CheckpointFailed = -11, /*!< A checkpoint couldn't be written/restored */
+   kPR_QuoteOverflow    = -10, /*!< Quote event array full, quotes dropped */
+   kPR_SysSetupFailed   = -9, /*!< CPU pinning / memory locking failed */
    kPR_InvalidInStream  = -8, /*!< Error opening input stream */
    kPR_ParserError      = -7, /*!< Input data was not parsed correctly */
    kPR_ReduceOutOfRange = -6, /*!< A reduce req. had more shares than exist. */
@@ -29,6 +37,173 @@ enum ePricerResult
    kPR_Exit             =  1  /*!< Exit code ( internal ) */
 };
 
+/*!
+ * Publication filter for one side's quotes. All zero publishes every
+ * change. Changes between a price and "NA" are always published.
+ */
+typedef struct PricerPublishFilter
+{
+   int minMoveCents;  /*!< Smallest move since the last quote published.  */
+   int minMoveBps;    /*!< Smallest move, in basis points of that quote.  */
+   int minInterval;   /*!< Least time (in timestamp units) between quotes;
+                           a move inside it is held and the latest one 
+                           published when it's up.                        */
+} PricerPublishFilter;
+
+/*! 
+ * Runtime options for PricerEx().
+ * 
+ * Always initialize with PricerInitOptions() before setting fields, so
+ * new options added later get sane defaults.
+ */
+typedef struct PricerOptions
+{
+   /*! If > 0 and the output is a pipe/socket, quotes are batched and
+    *  written at most this many microseconds after the oldest one 
+    *  was generated, or sooner if the input goes idle. 
+    *  0 flushes every quote as it is generated.                    (0) */
+   int batchLatencyUsec;
+
+   /*! Max bytes held when batching.                 (PRICER_BATCH_SIZE) */
+   int batchSize;
+
+   /*! Non-zero to use the io_uring stream backend where the kernel 
+    *  supports it (Linux). Falls back to read()/write() otherwise. (0) */
+   int ioUring;
+
+   /*! Non-zero to format quotes directly into a preallocated, mapped
+    *  window of the output file when it is a regular file. The file is
+    *  trimmed to the exact length when done.                        (0) */
+   int mmapOutput;
+
+   /*! Non-zero for latency over throughput: spin on a non-blocking
+    *  input instead of sleeping in read(), flush each quote as it is
+    *  generated, and lock/pre-fault memory at startup.            (0) */
+   int latencyMode;
+
+   /*! CPU to pin the pricing thread - parsing, the books and output -
+    *  to, or -1 to leave it alone. It's pinned before anything is 
+    *  allocated, so its memory is first touched on the CPU's NUMA 
+    *  node. The placement is reported to the error output.       (-1) */
+   int cpu;
+
+   /*! File to write checkpoints of the order books to, or NULL. One is
+    *  written every checkpointInterval messages, on SIGUSR2, and at
+    *  the end of the input.                                      (NULL) */
+   const char* checkpointFile;
+
+   /*! Messages between checkpoints, 0 for only on signal/at the end. (0) */
+   int checkpointInterval;
+
+   /*! Checkpoint file to restore from at startup, or NULL. The input is
+    *  resumed from where the checkpoint was taken - regular files seek
+    *  there, pipes skip the bytes already processed.             (NULL) */
+   const char* restoreFile;
+
+   /*! Replay window: only quotes for messages timestamped windowStart
+    *  to windowEnd are output. Earlier messages update the books with
+    *  no formatting at all, the books' state is output (stamped 
+    *  windowStart) on entering the window, and processing stops at
+    *  the first message after it.                       (0, 0xffffffff) */
+   unsigned int windowStart;
+   unsigned int windowEnd;
+
+   /*! Checkpoint index file, or NULL. With checkpointFile, each 
+    *  checkpoint goes to its own "checkpointFile.offset" file and is
+    *  listed here by timestamp. With a windowStart and no restoreFile,
+    *  the last checkpoint listed before windowStart is restored.  (NULL) */
+   const char* indexFile;
+
+   /*! Non-zero to follow a regular input file like tail -F: wait for
+    *  more data at the end instead of stopping, reopening the file if
+    *  it is rotated and rereading it if truncated. Output is flushed
+    *  whenever the input is waited on. Not with ioUring.            (0) */
+   int follow;
+
+   /*! Non-zero to keep a cumulative depth index on each book, making
+    *  PricerQueryCost() O(log price levels) instead of a walk of the
+    *  book. Costs an update per message. Always kept unless built
+    *  with PRICER_LEVEL_JUMP_STEPS 0.                               (0) */
+   int depthIndex;
+
+   /*! Non-zero to leave orders far behind the marginal price unsorted
+    *  (bucketed by price band) until removals reach them.           (0) */
+   int lazyBook;
+
+   /*! Non-zero to publish only the final quote of each timestamp per
+    *  side (and target), and only if it differs from the last one
+    *  published. Quotes are held until the timestamp advances, the
+    *  input ends, or PricerFlush().                                 (0) */
+   int coalesce;
+
+   /*! Publication filters for the bid ('B') and ask ('S') quotes.   (0) */
+   PricerPublishFilter bidFilter;
+   PricerPublishFilter askFilter;
+
+   /*! Non-zero to map order storage and the id table on huge pages -
+    *  reserved (hugetlbfs) ones if there are any, else transparent 
+    *  ones where the kernel allows.                                 (0) */
+   int hugePages;
+
+   /*! Orders to map and pre-fault room for at startup, along with the
+    *  stream buffers, so the first messages don't take page faults.
+    *  With this or hugePages, the page mix is reported to the error 
+    *  output.                                                       (0) */
+   int preallocOrders;
+
+   /*! CPU to pin the thread decompressing compressed input to, or -1.
+    *  Its buffers are bound to the CPU's NUMA node.               (-1) */
+   int readerCpu;
+
+   /*! PricerServe(): bytes of quotes a subscriber may fall behind
+    *  before it's disconnected.               (PRICER_SERVER_MAX_LAG) */
+   int serverMaxLag;
+
+   /*! Name of a POSIX shared-memory segment to publish the latest bid
+    *  and ask of each target to, or NULL. Every change is published,
+    *  whatever coalescing, filters or the window hold back from the
+    *  output. \see PricerShmOpen                                 (NULL) */
+   const char* shmName;
+
+   /*! Handles: publish a snapshot of the book for PricerReadCost() 
+    *  every snapshotInterval messages and at each PricerFlush(), or 0
+    *  for none. Each costs a walk of the book, and sorts in any 
+    *  orders lazyBook deferred.                                     (0) */
+   int snapshotInterval;
+
+   /*! PricerEx(): file to write operational counters to, in the
+    *  Prometheus text format, or NULL. It's replaced (by a rename)
+    *  every metricsInterval seconds and once more at the end.    (NULL) */
+   const char* metricsFile;
+
+   /*! Seconds between writes of metricsFile.                       (10) */
+   int metricsInterval;
+
+   /*! PricerEx(): keep a flight recorder of the last traceEvents book
+    *  operations - messages, allocation changes, marginal order moves
+    *  and quotes - and dump it to traceFile on SIGQUIT and at the end,
+    *  and to traceFile.error at the first failed message. NULL turns
+    *  it off. Decode with pricer-tracedump. "%p" in it is replaced by
+    *  the process id, so the default doesn't collide between runs.
+    *  A failed dump at the end is reported on the error stream
+    *  (kPR_TraceFailed) but doesn't fail the run.
+    *
+    *  SIGQUIT is acted on between messages, so with no input arriving
+    *  the dump waits for the next message (or the end).
+    *                                               (PRICER_TRACE_FILE) */
+   const char* traceFile;
+
+   /*! Events the flight recorder holds.          (PRICER_TRACE_EVENTS) */
+   int traceEvents;
+} PricerOptions;
+
+/*---------------------------------------------------------------------------
+ *! PricerInitOptions() fills options with the default values.
+ *
+ *  \param options Options structure to initialize.
+ */
+void PRICER_CALL PricerInitOptions(PricerOptions* options);
+
 /*---------------------------------------------------------------------------
  *! Pricer() processes market data from inHandle.
  * 
@@ -50,6 +225,330 @@ int PRICER_CALL Pricer(int targetShares,
                        int outBidNum,
                        int outErrNum);
 
+/*---------------------------------------------------------------------------
+ *! PricerEx() is Pricer() with runtime options.
+ * 
+ *  \param options       Options from PricerInitOptions(), or NULL for
+ *                       the defaults.
+ *  \see Pricer
+ */
+int PRICER_CALL PricerEx(int                   targetShares,
+                         int                   inFileNum,
+                         int                   outAskNum,
+                         int                   outBidNum,
+                         int                   outErrNum,
+                         const PricerOptions*  options);
+
+/*---------------------------------------------------------------------------
+ *! PricerServe() runs a pricer as a local server (Linux).
+ * 
+ *  Listens on a Unix-domain or TCP socket. The first connection to 
+ *  send data is the feed - market data in, as for PricerEx()'s input -
+ *  and every other connection is a subscriber, sent each quote as 
+ *  PricerEx() would write it, from the moment it connects. Quotes are
+ *  formatted once into a buffer shared by all the subscribers, and a
+ *  subscriber more than options->serverMaxLag bytes behind is 
+ *  disconnected. When the feed disconnects, another may connect and
+ *  carry on with the same books. Output is flushed whenever the feed
+ *  is idle.
+ * 
+ *  Runs until SIGTERM or SIGINT.
+ * 
+ *  \param targetShares  Target number of shares for bid/ask calculations.
+ *  \param address       "unix:path", or "tcp:[host:]port" - host 
+ *                       defaults to 127.0.0.1, port 0 picks a free one.
+ *                       The address listened on is written to outErrNum.
+ *  \param outErrNum     File number for errors and diagnostics.
+ *  \param options       Options from PricerInitOptions(), or NULL. As
+ *                       for PricerCreate(), plus cpu and serverMaxLag.
+ * 
+ *  \return int  kPR_Success once stopped, kPR_ServerFailed if it 
+ *               couldn't listen. \see ePricerResult
+ */
+int PRICER_CALL PricerServe(int                   targetShares,
+                            const char*           address,
+                            int                   outErrNum,
+                            const PricerOptions*  options);
+
+/*!
+ * Opaque handle for an in-process pricer. \see PricerCreate
+ */
+typedef struct PricerInstance* PricerHandle;
+
+/*!
+ * Output callback for PricerCreate(). Receives a block of quote (or
+ * diagnostic) text, always whole lines for quotes.
+ * 
+ * \param context  Context pointer given to PricerCreate().
+ * \param data     Text to consume. Only valid during the call.
+ * \param length   Number of bytes in data.
+ * \return int     0 on success, negative on error.
+ */
+typedef int (PRICER_CALL *PricerWriteFunc)(void*       context,
+                                           const char* data,
+                                           int         length);
+
+/*!
+ * A published Bid/Ask state, for in-process consumers that don't want
+ * to parse text. \see PricerSetQuoteCallback, PricerSetQuoteArray
+ */
+typedef struct PricerQuoteEvent
+{
+   unsigned int   timeStamp;   /*!< Timestamp of the message that caused it. */
+   char           side;        /*!< 'B' for a bid, 'S' for an ask.           */
+   char           valid;       /*!< 0 if not enough shares ("NA").           */
+   char           extra;       /*!< 1 for a target from PricerAddTarget().   */
+   long long      totalPrice;  /*!< Total for targetShares, in cents.        */
+   long long      targetShares;/*!< Target the total is for.                 */
+} PricerQuoteEvent;
+
+/*!
+ * Quote event callback. The event is only valid during the call.
+ */
+typedef void (PRICER_CALL *PricerQuoteFunc)(void*                    context,
+                                            const PricerQuoteEvent*  event);
+
+/*---------------------------------------------------------------------------
+ *! PricerCreate() creates an in-process pricer fed with PricerFeed().
+ * 
+ *  Quotes are formatted exactly as Pricer() writes them and delivered
+ *  to outFunc in blocks - when the internal buffer fills, and on
+ *  PricerFlush() / PricerDestroy().
+ * 
+ *  \param targetShares  Target number of shares for bid/ask calculations.
+ *  \param outFunc       Receives quote text. 
+ *  \param errFunc       Receives errors and diagnostics (may be NULL).
+ *  \param context       Passed back to outFunc / errFunc.
+ *  \param options       Options from PricerInitOptions(), or NULL. Only
+ *                       options that aren't about files/fds apply.
+ * 
+ *  \return PricerHandle  New handle, or NULL on bad arguments or if
+ *                        options->shmName couldn't be mapped.
+ */
+PricerHandle PRICER_CALL PricerCreate(int                   targetShares,
+                                      PricerWriteFunc       outFunc,
+                                      PricerWriteFunc       errFunc,
+                                      void*                 context,
+                                      const PricerOptions*  options);
+
+/*---------------------------------------------------------------------------
+ *! PricerFeed() processes a chunk of market data.
+ * 
+ *  Chunks may split messages anywhere - a trailing partial line is 
+ *  kept until the rest of it arrives.  Complete lines are parsed in 
+ *  place without being copied.
+ * 
+ *  Unlike Pricer(), a reduce for an unknown order doesn't stop 
+ *  processing; it is reported and the next message is handled.
+ * 
+ *  \param handle  Handle from PricerCreate().
+ *  \param data    Market data bytes.
+ *  \param length  Number of bytes in data.
+ *  \return int    0 on success, otherwise the last error from this chunk.
+ *  \see ePricerResult
+ */
+int PRICER_CALL PricerFeed(PricerHandle handle, const char* data, int length);
+
+/*---------------------------------------------------------------------------
+ *! PricerFlush() delivers any buffered quotes to the output callback.
+ * 
+ *  A partial line from PricerFeed() is still held, since more of it 
+ *  may be coming.
+ *  With the coalesce option, the quotes held for the last timestamp
+ *  are delivered too.
+ * 
+ *  \param handle  Handle from PricerCreate().
+ *  \return int    0 on success, kPR_InvalidData if a callback failed.
+ */
+int PRICER_CALL PricerFlush(PricerHandle handle);
+
+/*---------------------------------------------------------------------------
+ *! PricerSetQuoteCallback() delivers quotes as PricerQuoteEvent structs
+ *  to func instead of as text to PricerCreate()'s outFunc.
+ * 
+ *  \param handle   Handle from PricerCreate().
+ *  \param func     Callback, or NULL to go back to text output.
+ *  \param context  Passed back to func.
+ *  \return int     0 on success.
+ */
+int PRICER_CALL PricerSetQuoteCallback(PricerHandle    handle,
+                                       PricerQuoteFunc func,
+                                       void*           context);
+
+/*---------------------------------------------------------------------------
+ *! PricerSetQuoteArray() stores quotes into a caller-owned array instead
+ *  of formatting them.  Drain it with PricerTakeQuotes() between feeds;
+ *  once it's full further quotes are dropped and PricerFeed() returns
+ *  kPR_QuoteOverflow.
+ * 
+ *  \param handle    Handle from PricerCreate().
+ *  \param events    Array to fill, or NULL to go back to text output.
+ *  \param capacity  Number of entries in events.
+ *  \return int      0 on success.
+ */
+int PRICER_CALL PricerSetQuoteArray(PricerHandle      handle,
+                                    PricerQuoteEvent* events,
+                                    int               capacity);
+
+/*---------------------------------------------------------------------------
+ *! PricerTakeQuotes() returns how many events are in the quote array and
+ *  starts filling it from the beginning again.
+ * 
+ *  \param handle  Handle from PricerCreate().
+ *  \return int    Number of events stored since the last call.
+ */
+int PRICER_CALL PricerTakeQuotes(PricerHandle handle);
+
+/*---------------------------------------------------------------------------
+ *! PricerQueryCost() prices any number of shares against the current
+ *  book, the same way the quotes price targetShares.
+ *
+ *  \param handle      Handle from PricerCreate().
+ *  \param side        'B' for the cost of buying shares from the sell
+ *                     orders, 'S' for the income from selling them to
+ *                     the buy orders.
+ *  \param shares      Number of shares.
+ *  \param totalPrice  On success, total price in cents.
+ *
+ *  \return int 0 on success, kPR_InvalidData if the side doesn't hold
+ *              that many shares or the arguments are bad.
+ */
+int PRICER_CALL PricerQueryCost(PricerHandle handle,
+                                char         side,
+                                int          shares,
+                                long long*   totalPrice);
+
+/*!
+ * A thread's view of a handle's book snapshots. 
+ * \see PricerOptions::snapshotInterval
+ */
+typedef struct PricerSnapshotReader* PricerReader;
+
+/*---------------------------------------------------------------------------
+ *! PricerOpenReader() lets a thread other than the one feeding the 
+ *  handle price shares against it, with PricerReadCost().
+ * 
+ *  Open and close readers from any thread, but use each from one 
+ *  thread at a time, and close them all before PricerDestroy().
+ *
+ *  \param handle  Handle from PricerCreate(), with snapshotInterval set.
+ *  \return        The reader, or NULL if the handle has no snapshots or
+ *                 PRICER_SNAPSHOT_READERS are already open.
+ */
+PricerReader PRICER_CALL PricerOpenReader(PricerHandle handle);
+
+/*---------------------------------------------------------------------------
+ *! PricerReadCost() is PricerQueryCost() against the latest snapshot,
+ *  safe to call while another thread feeds the handle. 
+ * 
+ *  It never waits for the feeding thread or holds it up - no locks, 
+ *  just a binary search of the snapshot's price levels. The snapshot
+ *  is consistent (both sides as they were after one message) but may
+ *  be up to snapshotInterval messages old.
+ *
+ *  \param reader      Reader from PricerOpenReader().
+ *  \param side        'B' or 'S', as for PricerQueryCost().
+ *  \param shares      Number of shares.
+ *  \param totalPrice  On success, total price in cents.
+ *  \param timeStamp   On success, timestamp of the snapshot's last 
+ *                     message. May be NULL.
+ *
+ *  \return int 0 on success, kPR_InvalidData if the side didn't hold
+ *              that many shares or the arguments are bad.
+ */
+int PRICER_CALL PricerReadCost(PricerReader   reader,
+                               char           side,
+                               long long      shares,
+                               long long*     totalPrice,
+                               unsigned int*  timeStamp);
+
+/*---------------------------------------------------------------------------
+ *! PricerCloseReader() frees a reader from PricerOpenReader().
+ */
+void PRICER_CALL PricerCloseReader(PricerReader reader);
+
+/*---------------------------------------------------------------------------
+ *! PricerSetTarget() changes targetShares mid-stream.
+ *
+ *  The books move their allocations at the margin rather than being
+ *  rebuilt, and any quote that changes is delivered right away,
+ *  stamped with the last message's timestamp.  The same as a
+ *  "timeStamp T S targetShares" message in the input.
+ *
+ *  \return int 0 on success, kPR_InvalidData if targetShares <= 0.
+ */
+int PRICER_CALL PricerSetTarget(PricerHandle handle, int targetShares);
+
+/*---------------------------------------------------------------------------
+ *! PricerAddTarget() publishes quotes for another target size too,
+ *  starting with the current state.  Its quotes have extra set and
+ *  their text lines end with " targetShares".  The same as a
+ *  "timeStamp T A targetShares" message.  Turns on the depth index.
+ *
+ *  \return int 0 on success, kPR_InvalidData if targetShares <= 0.
+ */
+int PRICER_CALL PricerAddTarget(PricerHandle handle, int targetShares);
+
+/*---------------------------------------------------------------------------
+ *! PricerRemoveTarget() stops publishing a target from 
+ *  PricerAddTarget(). The same as a "timeStamp T R targetShares" message.
+ *
+ *  \return int 0 on success, kPR_InvalidData if it wasn't published.
+ */
+int PRICER_CALL PricerRemoveTarget(PricerHandle handle, int targetShares);
+
+/*---------------------------------------------------------------------------
+ *! PricerDestroy() flushes output and frees the handle.
+ *  Any partial line held from PricerFeed() is discarded.
+ * 
+ *  \param handle  Handle from PricerCreate().
+ */
+void PRICER_CALL PricerDestroy(PricerHandle handle);
+
+/*!
+ * A shared-memory segment of latest quotes. \see PricerOptions::shmName
+ */
+typedef struct PricerShmQuotes PricerShmQuotes;
+
+/*---------------------------------------------------------------------------
+ *! PricerShmOpen() maps a pricer's quote segment, read-only, in any
+ *  process. The pricer needn't be running - the last quotes it
+ *  published stay until the next one reopens the segment.
+ * 
+ *  \param name  Segment name, as given in PricerOptions::shmName.
+ *  \return      The segment, or NULL if it's missing or not a pricer's.
+ */
+const PricerShmQuotes* PRICER_CALL PricerShmOpen(const char* name);
+
+/*---------------------------------------------------------------------------
+ *! PricerShmRead() copies the latest quote for one side of a target.
+ * 
+ *  Reads are plain memory reads - no syscalls, no locks, and nothing
+ *  the writer ever waits on. A read that overlaps an update simply 
+ *  copies again.
+ * 
+ *  \param quotes        Segment from PricerShmOpen().
+ *  \param side          'B' or 'S'.
+ *  \param targetShares  Extra target size, or 0 for the main target.
+ *  \param quote         Receives the quote (timeStamp 0 and not valid
+ *                       until the first one is published).
+ *  \param sequence      Receives the quote's update count, to tell a 
+ *                       new quote from one already seen. It only grows,
+ *                       across runs too. May be NULL.
+ *  \return int          0 on success, kPR_InvalidData if nothing's 
+ *                       published for that side/target.
+ */
+int PRICER_CALL PricerShmRead(const PricerShmQuotes*  quotes,
+                              char                    side,
+                              long long               targetShares,
+                              PricerQuoteEvent*       quote,
+                              unsigned int*           sequence);
+
+/*---------------------------------------------------------------------------
+ *! PricerShmClose() unmaps a segment from PricerShmOpen().
+ */
+void PRICER_CALL PricerShmClose(const PricerShmQuotes* quotes);
+
 /*---------------------------------------------------------------------------
  *! PricerGetResultString() retrieves a result code string.
  * 
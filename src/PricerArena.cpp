@@ -0,0 +1,74 @@
+/// \file  PricerArena.cpp
+/// \brief Page-backed arena and fixed-size pools for order storage.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include "PricerArena.h"
+
+PricerArena::PricerArena()
+: fChunks(),
+  fNext(0),
+  fEnd(0),
+  fMapped(0),
+  fPages(kPSP_Small),
+  fPrefault(false)
+{
+}
+
+PricerArena::~PricerArena()
+{
+   for (size_t i = 0; i < fChunks.size(); ++i)
+      PricerSysFreePages(fChunks[i].fMem,fChunks[i].fSize);
+}
+
+void PricerArena::SetPages(ePricerSysPages pages, bool prefault)
+{
+   fPages    = pages;
+   fPrefault = prefault;
+}
+
+void PricerArena::Reserve(size_t size)
+{
+   if ((size_t)(fEnd - fNext) < size)
+      NewChunk(size);
+}
+
+ePricerSysPages PricerArena::GetPages() const
+{
+   ePricerSysPages pages = fPages;
+   for (size_t i = 0; i < fChunks.size(); ++i)
+   {
+      if (fChunks[i].fPages < pages)
+         pages = fChunks[i].fPages;
+   }
+   return pages;
+}
+
+void PricerArena::GetRegions(std::vector<PricerSysRegion>& regions) const
+{
+   for (size_t i = 0; i < fChunks.size(); ++i)
+   {
+      PricerSysRegion region;
+      region.fMem  = fChunks[i].fMem;
+      region.fSize = fChunks[i].fSize;
+      regions.push_back(region);
+   }
+}
+
+void PricerArena::NewChunk(size_t size)
+{
+   // Whole huge pages, so any backing can be used.
+   size = (size + kPricerSysHugePage - 1) & ~(kPricerSysHugePage - 1);
+
+   Chunk chunk;
+   chunk.fPages = fPages;
+   chunk.fSize  = size;
+   chunk.fMem   = (char*)PricerSysAllocPages(size,chunk.fPages,fPrefault);
+   if (0 == chunk.fMem)
+      throw std::bad_alloc();
+
+   // Whatever's left of the current chunk is abandoned.
+   fChunks.push_back(chunk);
+   fNext    = chunk.fMem;
+   fEnd     = chunk.fMem + size;
+   fMapped += size;
+}
@@ -0,0 +1,236 @@
+/// \file  PricerArena.h
+/// \brief Page-backed arena and fixed-size pools for order storage.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerArena_H_
+#define _PricerArena_H_
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include "PricerXplat.h"
+#include "PricerSys.h"
+
+/// \class PricerArena
+/// \brief Bump allocator over large mapped chunks.
+///
+/// Chunks come from PricerSysAllocPages(), so they can be backed by
+/// huge pages and pre-faulted (\see SetPages).  Nothing is freed until
+/// the arena is destroyed - PricerPool recycles what's handed back.
+class PricerArena
+{
+   public:
+      PricerArena();
+      ~PricerArena();
+
+      /// Backing for the chunks mapped from now on.
+      void SetPages(ePricerSysPages pages, bool prefault);
+
+      /// Returns size bytes, aligned for any of our types.
+      void* Alloc(size_t size)
+      {
+         size = (size + kAlign - 1) & ~(kAlign - 1);
+         if ((size_t)(fEnd - fNext) < size)
+            NewChunk(size);
+
+         void* mem = fNext;
+         fNext += size;
+         return mem;
+      }
+
+      /// Maps (and with SetPages' prefault, faults in) room for size
+      /// more bytes now, so the allocations that use it don't stall.
+      void Reserve(size_t size);
+
+      /// The backing actually obtained - the least of the chunks'.
+      ePricerSysPages GetPages() const;
+
+      /// Bytes mapped.
+      size_t GetMapped() const { return fMapped; }
+
+      /// Adds the chunks' address ranges to regions.
+      void GetRegions(std::vector<PricerSysRegion>& regions) const;
+
+   protected:
+      static const size_t kAlign = 8;
+
+      /// Mapped memory.
+      struct Chunk
+      {
+         char*             fMem;
+         size_t            fSize;
+         ePricerSysPages   fPages;
+      };
+
+      /// Maps a chunk with at least size bytes and moves to it.
+      void NewChunk(size_t size);
+
+      std::vector<Chunk>   fChunks;
+      char*                fNext;      ///< Next free byte in the chunk.
+      char*                fEnd;       ///< End of the current chunk.
+      size_t               fMapped;
+      ePricerSysPages      fPages;     ///< Wanted for new chunks.
+      bool                 fPrefault;
+
+   private:
+      /// Not implemented.
+      PricerArena(const PricerArena&);
+      /// Not implemented.
+      PricerArena& operator=(const PricerArena&);
+};
+
+/// \class PricerPool
+/// \brief Free list of fixed-size blocks carved from a PricerArena.
+///
+/// The block size is set by the first Alloc(); blocks of any other
+/// size are refused (Alloc() returns 0) so the caller can go to the
+/// heap instead.  \see PricerPoolAllocator
+class PricerPool
+{
+   public:
+      PricerPool(PricerArena& arena, size_t size = 0)
+      : fArena(arena),
+        fSize(size),
+        fFree(0)
+      {
+      }
+
+      /// A block of size bytes, or 0 if this pool has another size.
+      void* Alloc(size_t size)
+      {
+         if (!Holds(size))
+            return 0;
+
+         if (fFree)
+         {
+            FreeBlock* block = fFree;
+            fFree = block->fNext;
+            return block;
+         }
+         return fArena.Alloc((fSize < sizeof(FreeBlock)) ? sizeof(FreeBlock)
+                                                          : fSize);
+      }
+
+      /// Returns a block from Alloc().
+      void Free(void* mem)
+      {
+         FreeBlock* block = (FreeBlock*)mem;
+         block->fNext = fFree;
+         fFree = block;
+      }
+
+      /// True if blocks of size come from this pool.
+      bool Holds(size_t size)
+      {
+         if (0 == fSize)
+            fSize = size;
+         return (size == fSize);
+      }
+
+      /// Block size (0 until the first Alloc()).
+      size_t GetSize() const { return fSize; }
+
+   protected:
+      struct FreeBlock
+      {
+         FreeBlock* fNext;
+      };
+
+      PricerArena&   fArena;
+      size_t         fSize;
+      FreeBlock*     fFree;
+
+   private:
+      /// Not implemented.
+      PricerPool(const PricerPool&);
+      /// Not implemented.
+      PricerPool& operator=(const PricerPool&);
+};
+
+/// \class PricerPoolAllocator
+/// \brief STL allocator taking single nodes from a PricerPool.
+///
+/// For node containers (set, map, list): every node comes from the
+/// pool, anything else - or everything, with no pool - from the heap.
+template<class T>
+class PricerPoolAllocator
+{
+   public:
+      typedef T                  value_type;
+      typedef T*                 pointer;
+      typedef const T*           const_pointer;
+      typedef T&                 reference;
+      typedef const T&           const_reference;
+      typedef size_t             size_type;
+      typedef ptrdiff_t          difference_type;
+
+      template<class U>
+      struct rebind
+      {
+         typedef PricerPoolAllocator<U> other;
+      };
+
+      PricerPoolAllocator(PricerPool* pool = 0)
+      : fPool(pool)
+      {
+      }
+
+      template<class U>
+      PricerPoolAllocator(const PricerPoolAllocator<U>& other)
+      : fPool(other.fPool)
+      {
+      }
+
+      pointer allocate(size_type count, const void* = 0)
+      {
+         if ((1 == count) && (fPool))
+         {
+            void* mem = fPool->Alloc(sizeof(T));
+            if (mem)
+               return (pointer)mem;
+         }
+         return (pointer)::operator new(count * sizeof(T));
+      }
+
+      void deallocate(pointer mem, size_type count)
+      {
+         if ((1 == count) && (fPool) && (fPool->Holds(sizeof(T))))
+            fPool->Free(mem);
+         else
+            ::operator delete(mem);
+      }
+
+      void construct(pointer mem, const T& value)
+      {
+         new ((void*)mem) T(value);
+      }
+
+      void destroy(pointer mem)
+      {
+         mem->~T();
+      }
+
+      pointer       address(reference value) const       { return &value; }
+      const_pointer address(const_reference value) const { return &value; }
+
+      size_type max_size() const
+      {
+         return ((size_type)-1) / sizeof(T);
+      }
+
+      template<class U>
+      bool operator==(const PricerPoolAllocator<U>& other) const
+      {
+         return (fPool == other.fPool);
+      }
+
+      template<class U>
+      bool operator!=(const PricerPoolAllocator<U>& other) const
+      {
+         return (fPool != other.fPool);
+      }
+
+      PricerPool*    fPool;
+};
+
+#endif // _PricerArena_H_
@@ -6,14 +6,24 @@
 #ifndef _PricerBook_H_
 #define _PricerBook_H_
 
+#include <algorithm>
+#include <map>
+#include <vector>
 #include "PricerConfig.h"
 #include "PricerOrder.h"
+#include "PricerSink.h"
+#include "PricerCheckpoint.h"
+#include "PricerDepthIndex.h"
+#include "PricerSnapshot.h"
+#include "PricerMetrics.h"
+#include "PricerTrace.h"
 
 /// \class PricerBook
 /// \brief PricerBook tracks the state of the current order book.
 ///
 /// PricerOrder objects are not copied and are owned by the caller.
-/// PricerBook just keeps pointers.
+/// PricerBook just keeps pointers.  Its set's nodes come from the 
+/// caller's PricerOrderPool, as do orders it loads from checkpoints.
 ///
 /// PricerOrder objects are sorted from low to high price (Sell/Bid) or
 /// from high to low price (Buy/Ask), depending on the type.
@@ -21,25 +31,66 @@
 /// PricerBook may be instantiated using ostreams or any other relatively
 /// compatible object type. \see PricerOutputStream
 ///
+/// New Bid/Ask states go to a PricerQuoteSink - by default a text sink
+/// on the output stream. \see SetSink
+///
+/// Besides the main target, a book can publish quotes for any number
+/// of extra target sizes (\see AddExtraTarget), priced from a depth
+/// index after every change to the book.
+///
+/// A lazy book (\see SetLazy) doesn't sort orders that land well behind
+/// the marginal order.  They go unsorted into per-band buckets instead,
+/// and a bucket is only sorted into fOrders when FillOrder() runs out
+/// of sorted orders and reaches it.
+///
 template<class OutStream>
 class PricerBook
 {
    public:
-      PricerBook(ePricerOrderType buyOrSell)
+      PricerBook(ePricerOrderType buyOrSell, PricerOrderPool& orderPool)
       : fOrderType(buyOrSell),
+        fOrderPool(&orderPool),
         fTargetShares(0),
-        fOrders(),
+        fOrders(PricerOrder::PricerOrderCompare_Cmp(),
+                orderPool.GetSetAllocator()),
         fBookValid(false),
         fTotalPrice(0),
         fNumShares(0),
         fLastUsedOrder(fOrders.end()),
+        fMarginalOwned(0),
+        fSortSeq(0),
+        fProbe(buyOrSell),
         fOutStream(0),
-        fErrStream(0)
+        fErrStream(0),
+        fTextSink(),
+        fNullSink(),
+        fQuoteSink(&fTextSink),
+        fCoalesceSink(),
+        fCoalesce(false),
+        fFilterSink(),
+        fCountSink(&fTextSink,&fCounters.fPublished),
+        fPublishSink(&fCountSink),
+        fSink(&fCountSink),
+        fStateSink(0),
+        fDepth(0),
+        fLazy(false),
+        fDeferred(),
+        fExtraTargets(),
+        fCounters()
+#if (PRICER_LATENCY_STATS > 0)
+        ,fFills(0),
+        fOutputs(0)
+#endif
+#if (PRICER_TRACE > 0)
+        ,fTrace(0),
+        fTraceMarginal(0)
+#endif
       {
       }
 
       ~PricerBook()
       {
+         delete fDepth;
       }
 
       /// Initialize should be called before other use.
@@ -51,18 +102,372 @@ class PricerBook
          fOutStream        = &outStream;
          fErrStream        = &errStream;
          fTargetShares     = targetShares;
+         fTextSink.SetStream(&outStream);
+#if (PRICER_LEVEL_JUMP_STEPS > 0)
+         EnableDepthIndex();
+#endif
+      }
+
+      /// Sends quotes to sink instead of formatting them to the
+      /// output stream. Pass 0 to go back to text output.
+      void SetSink(PricerQuoteSink* sink)
+      {
+         fQuoteSink = sink ? sink : &fTextSink;
+         LinkSinks();
+      }
+
+      /// Also sends every new state to sink, ahead of coalescing, the
+      /// publication filter and quiet - so it always has the latest.
+      /// Pass 0 to stop.
+      void SetStateSink(PricerQuoteSink* sink)
+      {
+         fStateSink = sink;
+      }
+
+      /// A quiet book keeps its state up to date but publishes nothing,
+      /// not even to the formatter - for fast-forwarding to a window.
+      void SetQuiet(bool quiet)
+      {
+         fSink = quiet ? (PricerQuoteSink*)&fNullSink : fPublishSink;
+      }
+
+      /// Coalescing books publish only the last state of each 
+      /// timestamp. \see PricerCoalesceSink
+      void SetCoalesce(bool coalesce)
+      {
+         fCoalesce = coalesce;
+         LinkSinks();
+      }
+
+      /// Filters what's published by size of move and rate.
+      /// \see PricerFilterSink
+      void SetPublishFilter(const PricerPublishFilter& filter)
+      {
+         FlushHeld(0);
+         fFilterSink.SetFilter(filter);
+         LinkSinks();
+      }
+
+      /// Time has moved on to timeStamp: publishes what coalescing
+      /// held for earlier ones and rate-limited quotes that are due.
+      void ReleaseHeld(PXUInt32 timeStamp)
+      {
+         fCoalesceSink.Flush();
+         fFilterSink.Release(timeStamp);
+      }
+
+      /// Publishes every quote held back, stamping rate-limited ones no 
+      /// earlier than timeStamp.
+      void FlushHeld(PXUInt32 timeStamp)
+      {
+         fCoalesceSink.Flush();
+         fFilterSink.Flush(timeStamp);
+      }
+
+      bool IsQuiet() const { return (fSink == &fNullSink); }
+
+      PXInt64 GetTargetShares() const { return fTargetShares; }
+
+      /// Changes the target mid-stream, publishing the new state if it
+      /// changed.  Only the allocation at the margin moves: a smaller 
+      /// target gives shares back from the last order used toward the
+      /// best price, a larger one takes more from where the last fill
+      /// stopped.
+      void SetTargetShares(PXInt64 targetShares, PXUInt32 timeStamp)
+      {
+         PXInt64 curPrice = fTotalPrice;
+         bool    curValid = true;
+
+         fTargetShares = targetShares;
+         if (fNumShares > fTargetShares)
+         {
+            ShedOverflow(curPrice);
+         }
+         else if (fNumShares < fTargetShares)
+         {
+            PricerOrderSetIter scanIter(fLastUsedOrder);
+            curValid = FillOrder(scanIter,curPrice);
+         }
+
+         bool changed = ( (curValid != fBookValid) ||
+                          (curValid && (curPrice != fTotalPrice)) );
+
+         fBookValid    = curValid;
+         fTotalPrice   = curPrice;
+         TraceMarginal();
+
+         if (changed)
+         {
+            OutputNewState( timeStamp);
+         }
+      }
+
+      /// Publishes quotes for shares as well as the main target, 
+      /// starting with its current state.  Keeps a depth index.
+      /// Returns false if it's already published.
+      bool AddExtraTarget(PXInt64 shares, PXUInt32 timeStamp)
+      {
+         if ((shares == fTargetShares) || (FindExtraTarget(shares) >= 0))
+            return false;
+
+         EnableDepthIndex();
+
+         PricerExtraTarget extra;
+         extra.fShares     = shares;
+         extra.fTotalPrice = 0;
+         extra.fValid      = false;
+         fExtraTargets.push_back(extra);
+         OutputExtraTargets(timeStamp);
+         return true;
+      }
+
+      /// Stops publishing shares. Returns false if it wasn't.
+      bool RemoveExtraTarget(PXInt64 shares)
+      {
+         PXInt64 index = FindExtraTarget(shares);
+         if (index < 0)
+            return false;
+
+         fExtraTargets.erase(fExtraTargets.begin() + index);
+         return true;
+      }
+
+      /// Turns lazy ordering of far-away orders on or off.
+      /// Turning it off sorts any deferred orders in.
+      void SetLazy(bool lazy)
+      {
+         if (!lazy)
+            SortDeferred();
+         fLazy = lazy;
+      }
+
+      /// Sorts every deferred order into fOrders.
+      void SortDeferred()
+      {
+         while (!fDeferred.empty())
+            PullDeferred();
+      }
+
+      /// Keeps a PricerDepthIndex of the book from here on, so
+      /// QueryCost() is O(log ticks) rather than a walk of the book.
+      void EnableDepthIndex()
+      {
+         if (fDepth)
+            return;
+
+         fDepth = new PricerDepthIndex(0 != (fOrderType & kPOT_Buy));
+         PricerOrderSetIter iter;
+         for (iter = fOrders.begin(); iter != fOrders.end(); ++iter)
+            fDepth->Update((*iter)->fLimitPrice,(*iter)->fNumShares);
+
+         PricerBucketMap::iterator bucket;
+         for (bucket = fDeferred.begin(); bucket != fDeferred.end(); ++bucket)
+         {
+            for (size_t i = 0; i < bucket->second.size(); ++i)
+            {
+               PricerOrder* order = bucket->second[i];
+               fDepth->Update(order->fLimitPrice,order->fNumShares);
+            }
+         }
+      }
+
+      /// Prices an arbitrary number of shares against the whole book,
+      /// best prices first - the same calculation as the quote, for
+      /// any size.
+      ///
+      /// \param shares         Number of shares (> 0).
+      /// \param totalPrice     On success, their total price.
+      /// \param marginalPrice  On success, price of the last share.
+      ///
+      /// \return bool false if the book doesn't hold that many.
+      bool QueryCost(PXInt64   shares,
+                     PXInt64&  totalPrice,
+                     PXInt64&  marginalPrice)
+      {
+         if ((fDepth) && (fDepth->IsValid()))
+            return fDepth->Query(shares,totalPrice,marginalPrice);
+
+         // No index (or it gave up) - walk the book.
+         if (shares <= 0)
+            return false;
+
+         SortDeferred();
+
+         PXInt64 total = 0;
+         PricerOrderSet::const_iterator iter;
+         for (iter = fOrders.begin(); iter != fOrders.end(); ++iter)
+         {
+            const PricerOrder* order = *iter;
+            PXInt64 taken = (order->fNumShares < shares) ? 
+                            order->fNumShares : shares;
+            total  += taken * order->fLimitPrice;
+            shares -= taken;
+            if (0 == shares)
+            {
+               totalPrice    = total;
+               marginalPrice = order->fLimitPrice;
+               return true;
+            }
+         }
+         return false;
+      }
+
+      /// Operational counters, for a PricerMetricsExporter.
+      const PricerBookCounters& GetCounters() const { return fCounters; }
+
+#if (PRICER_TRACE > 0)
+      /// Logs allocation changes, marginal order moves and quotes to
+      /// ring. Pass 0 to stop.
+      void SetTrace(PricerTraceRing* ring)
+      {
+         fTrace         = ring;
+         fTraceMarginal = 0;
+      }
+#endif
+
+#if (PRICER_LATENCY_STATS > 0)
+      /// FillOrder() calls so far - book rescans.
+      PXUInt32 GetFills() const { return fFills; }
+
+      /// New states output so far.
+      PXUInt32 GetOutputs() const { return fOutputs; }
+#endif
+
+      /// Fills levels with the book's price levels, best first, and
+      /// their cumulative shares and totals - what a PricerSnapshot
+      /// queries.  Deferred orders are sorted in first.
+      void GetLevels(std::vector<PricerSnapshotLevel>& levels)
+      {
+         SortDeferred();
+
+         levels.clear();
+         PXInt64 shares = 0;
+         PXInt64 total  = 0;
+         PricerOrderSet::const_iterator iter;
+         for (iter = fOrders.begin(); iter != fOrders.end(); ++iter)
+         {
+            const PricerOrder* order = *iter;
+            shares += order->fNumShares;
+            total  += order->fNumShares * order->fLimitPrice;
+
+            if ((!levels.empty()) && (levels.back().fPrice == order->fLimitPrice))
+            {
+               levels.back().fShares = shares;
+               levels.back().fTotal  = total;
+               continue;
+            }
+
+            PricerSnapshotLevel level = { order->fLimitPrice, shares, total };
+            levels.push_back(level);
+         }
+      }
+
+      /// Writes the book state and its orders, best first, to file.
+      /// isIndexed(order) tells whether order is the one the caller's
+      /// id table holds for its id (duplicate ids aren't).
+      /// Deferred orders are sorted in first.
+      template<class IsIndexed>
+      void Save(PricerCheckpointFile& file, IsIndexed& isIndexed)
+      {
+         PXInt64 numExtra = (PXInt64)fExtraTargets.size();
+         file.Put(numExtra);
+         for (size_t i = 0; i < fExtraTargets.size(); ++i)
+         {
+            PXUInt8 extraValid = fExtraTargets[i].fValid ? 1 : 0;
+            file.Put(fExtraTargets[i].fShares);
+            file.Put(fExtraTargets[i].fTotalPrice);
+            file.Put(extraValid);
+         }
+
+         SortDeferred();
+
+         PXInt64 count    = (PXInt64)fOrders.size();
+         PXInt64 lastUsed = -1;
+         PXInt64 index    = 0;
+         PricerOrderSet::const_iterator iter;
+         for (iter = fOrders.begin(); iter != fOrders.end(); ++iter, ++index)
+         {
+            if (iter == PricerOrderSet::const_iterator(fLastUsedOrder))
+               lastUsed = index;
+         }
+
+         PXUInt8 valid = fBookValid ? 1 : 0;
+         file.Put(valid);
+         file.Put(fTotalPrice);
+         file.Put(fNumShares);
+         file.Put(count);
+         file.Put(lastUsed);
+
+         for (iter = fOrders.begin(); iter != fOrders.end(); ++iter)
+         {
+            const PricerOrder* order = *iter;
+            PXUInt8 indexed = isIndexed(order) ? 1 : 0;
+            file.PutId(order->fId);
+            file.Put(order->fLimitPrice);
+            file.Put(order->fNumShares);
+            file.Put(Owned(order));
+            file.Put(indexed);
+         }
+      }
+
+      /// Rebuilds the book from Save()'s output.  The orders come back
+      /// in book order, so each is appended at the end in constant time
+      /// rather than searched for.  Orders the id table should hold are
+      /// added to indexed; all of them are owned by the caller.
+      /// Call on an empty book.  targetShares is the target the 
+      /// checkpoint was taken with; SetTargetShares() can move to 
+      /// another once it's loaded.  Returns false (and leaves the book
+      /// empty) if the data is bad.
+      bool Load(PricerCheckpointFile&        file,
+                PXInt64                      targetShares,
+                std::vector<PricerOrder*>&   indexed)
+      {
+         size_t numIndexed = indexed.size();
+         fTargetShares     = targetShares;
+         if (LoadOrders(file,indexed))
+         {
+            fCounters.fOrders = fOrders.size();
+            return true;
+         }
+
+         indexed.resize(numIndexed);
+         DeleteOrders();
+         return false;
+      }
+
+      /// Deletes every order in the book and empties it, keeping the
+      /// target. Only for books whose orders nobody else references.
+      void DeleteOrders()
+      {
+         SortDeferred();
+         PricerOrderSetIter iter;
+         for (iter = fOrders.begin(); iter != fOrders.end(); ++iter)
+            fOrderPool->Delete(*iter);
+
+         PXInt64 targetShares = fTargetShares;
+         Reset();
+         fTargetShares = targetShares;
       }
 
       /// Resets the book values, but not the
       /// streams.
       void Reset()
       {
+         if (fDepth)
+            fDepth->Clear();
          fOrders.clear();
+         fDeferred.clear();
+         fExtraTargets.clear();
          fTargetShares  = 0;
          fBookValid     = false;
          fTotalPrice    = 0;
          fNumShares     = 0;
          fLastUsedOrder = fOrders.end();
+         fMarginalOwned = 0;
+         fCounters.fOrders = 0;
+#if (PRICER_TRACE > 0)
+         fTraceMarginal = 0;
+#endif
       }
 
       /// Adds an order to the book and updates the
@@ -71,6 +476,24 @@ class PricerBook
       {  
          ePricerResult result = kPR_Success;
 
+         if (fDepth)
+            fDepth->Update(order->fLimitPrice,order->fNumShares);
+         ++fCounters.fOrders;
+
+         // Far enough behind the marginal order that it can't change
+         // the quote until removals reach it - don't sort it yet.
+         if ((fLazy) && (fBookValid) && (IsFarAway(order->fLimitPrice)))
+         {
+            std::vector<PricerOrder*>& bucket = 
+               fDeferred[BandKey(order->fLimitPrice)];
+            order->fBucketIndex = (PXInt64)bucket.size();
+            bucket.push_back(order);
+            if (!fExtraTargets.empty())
+               OutputExtraTargets(timeStamp);
+            return result;
+         }
+
+         order->fSortSeq = ++fSortSeq;
          PricerOrderSetIter newOrderIter = fOrders.insert(order);
 
          // Save a copy of the iterator for reduce/removal
@@ -95,7 +518,7 @@ class PricerBook
                if (newShares >= needed)
                {
                   // Got enough to fill the order now.
-                  order->fNumOwned += needed;
+                  fMarginalOwned    = needed;
                   curPrice         += needed * order->fLimitPrice;
                   fNumShares       += needed;
                   curValid          = true;
@@ -103,60 +526,36 @@ class PricerBook
                else
                {
                   // Not enough... take 'em all.
-                  order->fNumOwned += newShares;
+                  fMarginalOwned    = newShares;
                   curPrice         += newShares * order->fLimitPrice;
                   fNumShares       += newShares;
                }
                fLastUsedOrder = newOrderIter;
+               TraceAlloc(order,fMarginalOwned);
             }
          }
-         else if ((*nextIter)->fNumOwned != 0)
+         else if ((fLastUsedOrder != fOrders.end()) &&
+                  (SortsBefore(order,*fLastUsedOrder)))
          {
             // If this one doesn't yet fill the order, 
             // or fills it exactly, no traversal needed.
             // Just take 'em.
             if (newShares <= needed)
             {
-               order->fNumOwned += newShares;
                curPrice         += newShares * order->fLimitPrice;
                fNumShares       += newShares;
                curValid          = (fNumShares == fTargetShares);
+               TraceAlloc(order,newShares);
             }
             else
             {
                // Overfill the order then reduce.
-               order->fNumOwned += newShares;
                fNumShares       += newShares;   
                curPrice         += newShares * order->fLimitPrice;
+               TraceAlloc(order,newShares);
 
-               PXInt64 overFlow = fNumShares - fTargetShares;
-               
-               while (fNumShares != fTargetShares)
-               {            
-                  PricerOrder* curLast = *fLastUsedOrder;
-                  if (curLast->fNumOwned < overFlow )
-                  {
-                     PXInt64 numOwned   = curLast->fNumOwned;
-                     overFlow          -= numOwned;
-                     fNumShares        -= numOwned;
-                     curPrice          -= numOwned * 
-                                          curLast->fLimitPrice;
-                     curLast->fNumOwned = 0;
-                  }
-                  else
-                  {
-                     fNumShares         -= overFlow;
-                     curPrice           -= overFlow * curLast->fLimitPrice;
-                     curLast->fNumOwned -= overFlow;
-                     curValid = true;
-
-                     if (curLast->fNumOwned != 0)
-                        break;
-
-                     overFlow = 0;
-                  }
-                  --fLastUsedOrder;
-               }
+               ShedOverflow(curPrice);
+               curValid = true;
             }
          }
 
@@ -166,6 +565,7 @@ class PricerBook
          // Store state
          fTotalPrice   = curPrice;
          fBookValid    = curValid;
+         TraceMarginal();
 
          // Output new if changed and valid
          if (changed)
@@ -173,6 +573,8 @@ class PricerBook
             OutputNewState( timeStamp);
          }
 
+         if (!fExtraTargets.empty())
+            OutputExtraTargets(timeStamp);
          return result;
       }
 
@@ -185,16 +587,30 @@ class PricerBook
 
          ePricerResult      result = kPR_Success;
 
+         if (fDepth)
+            fDepth->Update(order->fLimitPrice,-order->fNumShares);
+         --fCounters.fOrders;
+
+         // Never sorted, so never owned - just drop it from its bucket.
+         if (order->fBucketIndex >= 0)
+         {
+            RemoveDeferred(order);
+            if (!fExtraTargets.empty())
+               OutputExtraTargets(timeStamp);
+            return result;
+         }
+
          // Retrieve stored iterator
          PricerOrderSetIter iter(order->fOrderBookIter);
 
-         PXInt64 numRemoved  = order->fNumOwned;
+         PXInt64 numRemoved  = Owned(order);
          if (numRemoved > 0)
          {
             // We own more than is left... find replacements if we can.
             fNumShares   -= numRemoved;
             curPrice     -= numRemoved * order->fLimitPrice;
             curValid      = false;
+            TraceAlloc(order,0);
 
             // Update it
             if (fLastUsedOrder == iter)
@@ -202,12 +618,14 @@ class PricerBook
                if (fLastUsedOrder != fOrders.begin())
                {
                   --fLastUsedOrder;
+                  fMarginalOwned = (*fLastUsedOrder)->fNumShares;
                   fOrders.erase(iter);
                }
                else
                {
                   fOrders.erase(iter);
                   fLastUsedOrder = fOrders.begin();
+                  fMarginalOwned = 0;
                }
             }
             else
@@ -229,12 +647,15 @@ class PricerBook
 
          fBookValid     = curValid;
          fTotalPrice    = curPrice;
+         TraceMarginal();
 
          if (changed)
          {
             OutputNewState( timeStamp);
          }
 
+         if (!fExtraTargets.empty())
+            OutputExtraTargets(timeStamp);
          return result;
       }
 
@@ -245,20 +666,24 @@ class PricerBook
 
          ePricerResult      result = kPR_Success;
          
-         // Retrieve the stored iterator (to skip re-finding it)
-         PricerOrderSetIter iter(order->fOrderBookIter);
-
+         PXInt64 numOwned     = Owned(order);
          order->fNumShares   -= order->fReduceCount;
-         PXInt64 numRemoved   = order->fNumOwned - order->fNumShares;
 
-         if (order->fNumOwned > order->fNumShares)
+         if (fDepth)
+            fDepth->Update(order->fLimitPrice,-order->fReduceCount);
+         PXInt64 numRemoved   = numOwned - order->fNumShares;
+
+         if (numOwned > order->fNumShares)
          {
             // We own more than is left... find replacements if we can.
             fNumShares -= numRemoved;
             curPrice   -= numRemoved * order->fLimitPrice;
             curValid    = false;
 
-            order->fNumOwned -= numRemoved;
+            // Orders ahead of the marginal one stay wholly owned.
+            if (order == *fLastUsedOrder)
+               fMarginalOwned -= numRemoved;
+            TraceAlloc(order,order->fNumShares);
 
             // Find replacements if we can.
             PricerOrderSetIter scanIter(fLastUsedOrder);
@@ -270,32 +695,60 @@ class PricerBook
 
          fBookValid    = curValid;
          fTotalPrice   = curPrice;
+         TraceMarginal();
 
          if (changed)
          {
             OutputNewState( timeStamp);
          }
 
+         if (!fExtraTargets.empty())
+            OutputExtraTargets(timeStamp);
          return result;
       }
 
 
       /// Scans for orders to try to fill the target shares.
       /// Returns number of shares held and total price.
+      ///
+      /// A scan that's stepped over PRICER_LEVEL_JUMP_STEPS orders
+      /// stops walking and settles the target from the depth index.
       bool FillOrder(PricerOrderSetIter& scanIter,
                      PXInt64&            curPrice)
       {
+#if (PRICER_LATENCY_STATS > 0)
+         ++fFills;
+#endif
          bool curValid = false;
          PXInt64 sharesLeft = fTargetShares - fNumShares;
+         PXUInt64 steps = 0;
 
-         while (scanIter != fOrders.end())
+         while (true)
          {
+            if (IsJumpDue(steps))
+            {
+               curValid = SettleFromLevels(curPrice);
+               break;
+            }
+
+            if (scanIter == fOrders.end())
+            {
+               // Out of sorted orders - sort in the next band, if any.
+               if (fDeferred.empty())
+                  break;
+               scanIter = PullDeferred();
+            }
+
             PricerOrder* curOrder = *scanIter;
 
             PXInt64 scanPrice  = curOrder->fLimitPrice;
-          
-            PXInt64 scanShares = (curOrder->fNumShares - 
-                                  curOrder->fNumOwned);
+
+            // Orders past the marginal one are unowned.
+            PXInt64 numOwned   = (scanIter == fLastUsedOrder) ? 
+                                 fMarginalOwned : 0;
+            PXInt64 scanShares = curOrder->fNumShares - numOwned;
+
+            ++steps;
 
             // skip to the next one if this one's allocated.
             if (scanShares == 0)
@@ -308,7 +761,8 @@ class PricerBook
             {
                curPrice            += scanPrice*sharesLeft;
                fNumShares          += sharesLeft;
-               curOrder->fNumOwned += sharesLeft;
+               fMarginalOwned       = numOwned + sharesLeft;
+               TraceAlloc(curOrder,fMarginalOwned);
                
                sharesLeft      = 0;
                curValid        = true;
@@ -319,58 +773,518 @@ class PricerBook
             {
                sharesLeft          -= scanShares;
                curPrice            += scanPrice * scanShares;
-               curOrder->fNumOwned += scanShares;
+               fMarginalOwned       = curOrder->fNumShares;
                fNumShares          += scanShares;
                fLastUsedOrder       = scanIter;
+               TraceAlloc(curOrder,fMarginalOwned);
             }
 
             ++scanIter;
          }
-         
+
+         ++fCounters.fFills;
+         fCounters.fFillSteps += steps;
+         ++fCounters.fFillScans[PricerScanBucket(steps)];
          return curValid;
       }
 
-      /// Outputs new Bid/Ask state to the output stream.
+      /// Publishes the new Bid/Ask state to the sink.
       void OutputNewState( PXUInt32         timeStamp)
       {
-         // inverted from input (e.g. they buy, we're selling)
-         char orderChar = (fOrderType & kPOT_Buy)?'S':'B';
+         OutputState(timeStamp,fBookValid,fTotalPrice,fTargetShares,false);
+      }
 
-         if (fBookValid)
+      /// Publishes the current state of the main target and every 
+      /// extra one, changed or not.
+      void OutputAllStates(PXUInt32 timeStamp)
+      {
+         OutputNewState(timeStamp);
+         for (size_t i = 0; i < fExtraTargets.size(); ++i)
          {
-            PXUInt32 cents = (PXUInt32)(fTotalPrice%100);
-            (*fOutStream) << timeStamp      << ' '
-                          << orderChar      << ' '
-                          << (PXUInt64)fTotalPrice/100
-                          << ((cents<10)?".0":".")
-                          << cents
-                          << '\n';
+            const PricerExtraTarget& extra = fExtraTargets[i];
+            OutputState(timeStamp,extra.fValid,extra.fTotalPrice,
+                        extra.fShares,true);
          }
+      }
+   protected:
+      /// Chains the coalescing and filter sinks (those in use) and the
+      /// published-quote count ahead of fQuoteSink, flushing anything
+      /// they held first.
+      void LinkSinks()
+      {
+         bool quiet = IsQuiet();
+         FlushHeld(0);
+
+         fCountSink.SetSink(fQuoteSink);
+         PricerQuoteSink* sink = &fCountSink;
+         if (!fFilterSink.IsOpen())
+         {
+            fFilterSink.SetSink(sink);
+            sink = &fFilterSink;
+         }
+         if (fCoalesce)
+         {
+            fCoalesceSink.SetSink(sink);
+            sink = &fCoalesceSink;
+         }
+
+         fPublishSink = sink;
+         SetQuiet(quiet);
+      }
+
+      /// Traces order now allocating owned shares.
+      void TraceAlloc(const PricerOrder* order, PXInt64 owned)
+      {
+#if (PRICER_TRACE > 0)
+         if (fTrace)
+            fTrace->Record(kPTE_Alloc,TraceSide(),PricerTraceId(order->fId),
+                           order->fLimitPrice,owned);
+#else
+         (void)order;
+         (void)owned;
+#endif
+      }
+
+      /// Traces the marginal order if it's moved since the last call.
+      void TraceMarginal()
+      {
+#if (PRICER_TRACE > 0)
+         if (0 == fTrace)
+            return;
+
+         const PricerOrder* marginal = (fLastUsedOrder != fOrders.end()) ?
+                                       *fLastUsedOrder : 0;
+         if (marginal == fTraceMarginal)
+            return;
+
+         fTraceMarginal = marginal;
+         if (marginal)
+            fTrace->Record(kPTE_Marginal,TraceSide(),
+                           PricerTraceId(marginal->fId),
+                           marginal->fLimitPrice,fNumShares);
          else
+            fTrace->Record(kPTE_Marginal,TraceSide(),0,0,fNumShares);
+#endif
+      }
+
+      /// This book's side in trace events - its orders'.
+      char TraceSide() const
+      {
+         return (fOrderType & kPOT_Buy) ? 'B' : 'S';
+      }
+
+      /// An extra target size and its last published state.
+      struct PricerExtraTarget
+      {
+         PXInt64  fShares;
+         PXInt64  fTotalPrice;
+         bool     fValid;
+      };
+
+      /// Publishes a state to the sink.
+      void OutputState(PXUInt32   timeStamp,
+                       bool       valid,
+                       PXInt64    totalPrice,
+                       PXInt64    targetShares,
+                       bool       extra)
+      {
+         PricerQuoteEvent event;
+         event.timeStamp    = timeStamp;
+         // inverted from input (e.g. they buy, we're selling)
+         event.side         = (fOrderType & kPOT_Buy)?'S':'B';
+         event.valid        = valid;
+         event.extra        = extra;
+         event.totalPrice   = totalPrice;
+         event.targetShares = targetShares;
+
+#if (PRICER_LATENCY_STATS > 0)
+         ++fOutputs;
+#endif
+         ++fCounters.fStates;
+#if (PRICER_TRACE > 0)
+         if (fTrace)
          {
-            (*fOutStream) << timeStamp << ' '
-                          << orderChar << ' '
-                          << "NA\n";
+            fTrace->Record(kPTE_Quote,event.side,0,totalPrice,targetShares,
+                           (PXUInt16)((valid ? kPTQ_Valid : 0) | 
+                                      (extra ? kPTQ_Extra : 0)));
          }
+#endif
+         if (fStateSink)
+            fStateSink->OnQuote(event);
+         fSink->OnQuote(event);
       }
-   protected:
+
+      /// Reprices the extra targets after a change to the book and
+      /// publishes those that changed.
+      void OutputExtraTargets(PXUInt32 timeStamp)
+      {
+         for (size_t i = 0; i < fExtraTargets.size(); ++i)
+         {
+            PricerExtraTarget& extra = fExtraTargets[i];
+            PXInt64 totalPrice    = 0;
+            PXInt64 marginalPrice = 0;
+            bool valid = QueryCost(extra.fShares,totalPrice,marginalPrice);
+            if ((valid == extra.fValid) && 
+                ((!valid) || (totalPrice == extra.fTotalPrice)))
+            {
+               continue;
+            }
+
+            extra.fValid = valid;
+            if (valid)
+               extra.fTotalPrice = totalPrice;
+            OutputState(timeStamp,valid,extra.fTotalPrice,extra.fShares,true);
+         }
+      }
+
+      /// Index of shares in fExtraTargets, or -1.
+      PXInt64 FindExtraTarget(PXInt64 shares) const
+      {
+         for (size_t i = 0; i < fExtraTargets.size(); ++i)
+         {
+            if (fExtraTargets[i].fShares == shares)
+               return (PXInt64)i;
+         }
+         return -1;
+      }
+
+      /// Gives back owned shares from the last order used toward the 
+      /// best price until only fTargetShares are held - or, past 
+      /// PRICER_LEVEL_JUMP_STEPS orders, settles them from the depth
+      /// index.
+      void ShedOverflow(PXInt64& curPrice)
+      {
+         PXInt64 overFlow = fNumShares - fTargetShares;
+         PXUInt64 steps   = 0;
+         
+         while (fNumShares != fTargetShares)
+         {            
+            if (IsJumpDue(steps++))
+            {
+               SettleFromLevels(curPrice);
+               return;
+            }
+
+            ++fCounters.fOverflowSteps;
+            PricerOrder* curLast = *fLastUsedOrder;
+            if (fMarginalOwned < overFlow )
+            {
+               PXInt64 numOwned   = fMarginalOwned;
+               overFlow          -= numOwned;
+               fNumShares        -= numOwned;
+               curPrice          -= numOwned * 
+                                    curLast->fLimitPrice;
+               TraceAlloc(curLast,0);
+            }
+            else
+            {
+               fNumShares         -= overFlow;
+               curPrice           -= overFlow * curLast->fLimitPrice;
+               fMarginalOwned     -= overFlow;
+               TraceAlloc(curLast,fMarginalOwned);
+
+               if (fMarginalOwned != 0)
+                  break;
+
+               overFlow = 0;
+            }
+            --fLastUsedOrder;
+            fMarginalOwned = (*fLastUsedOrder)->fNumShares;
+         }
+      }
+
+      /// True once a fill or shed has stepped over enough orders that
+      /// the depth index should take over.
+      bool IsJumpDue(PXUInt64 steps) const
+      {
+#if (PRICER_LEVEL_JUMP_STEPS > 0)
+         return (steps >= PRICER_LEVEL_JUMP_STEPS) && (fDepth) && 
+                (fDepth->IsValid());
+#else
+         (void)steps;
+         return false;
+#endif
+      }
+
+      /// Sets the allocation straight from the depth index rather than
+      /// by walking orders: the index's trees and level scan give the
+      /// cost of the target and the marginal price, and only orders at
+      /// that price are stepped over to find the marginal order.  Every
+      /// order ahead of it is owned by being ahead of it.  Deferred 
+      /// bands up to the marginal price are sorted in first.  Returns
+      /// false if the book is short, with all of it held.
+      bool SettleFromLevels(PXInt64& curPrice)
+      {
+         ++fCounters.fLevelJumps;
+
+         PXInt64 shares  = fTargetShares;
+         bool    valid   = (shares <= fDepth->GetTotalShares());
+         if (!valid)
+            shares = fDepth->GetTotalShares();
+
+         PXInt64 totalPrice     = 0;
+         PXInt64 marginalPrice  = 0;
+         PXInt64 marginalShares = 0;
+         if (!fDepth->Query(shares,totalPrice,marginalPrice,marginalShares))
+         {
+            // Nothing in the book.
+            fLastUsedOrder = fOrders.end();
+            fMarginalOwned = 0;
+            fNumShares     = 0;
+            curPrice       = 0;
+            return false;
+         }
+
+         PXInt64 band = BandKey(marginalPrice);
+         while ((!fDeferred.empty()) && (fDeferred.begin()->first <= band))
+            PullDeferred();
+
+         fProbe.fLimitPrice = marginalPrice;
+         PricerOrderSetIter iter = fOrders.lower_bound(&fProbe);
+         while ((*iter)->fNumShares < marginalShares)
+         {
+            marginalShares -= (*iter)->fNumShares;
+            ++iter;
+         }
+
+         fLastUsedOrder = iter;
+         fMarginalOwned = marginalShares;
+         fNumShares     = shares;
+         curPrice       = totalPrice;
+         TraceAlloc(*iter,fMarginalOwned);
+         return valid;
+      }
+
+      /// True if order is ahead of other in fOrders.
+      bool SortsBefore(const PricerOrder* order, 
+                       const PricerOrder* other) const
+      {
+         PricerOrder::PricerOrderCompare_Cmp cmp;
+         if (cmp(order,other))
+            return true;
+         if (cmp(other,order))
+            return false;
+         return (order->fSortSeq < other->fSortSeq);
+      }
+
+      /// Shares of order held toward the target.  Ownership is a prefix
+      /// of fOrders: all of every order ahead of the marginal order, 
+      /// fMarginalOwned of it, and none of those behind it or deferred.
+      PXInt64 Owned(const PricerOrder* order) const
+      {
+         if ((order->fBucketIndex >= 0) || (fLastUsedOrder == fOrders.end()))
+            return 0;
+
+         const PricerOrder* marginal = *fLastUsedOrder;
+         if (order == marginal)
+            return fMarginalOwned;
+         return SortsBefore(order,marginal) ? order->fNumShares : 0;
+      }
+
+      /// Deferred orders by price band, nearest band first. 
+      /// Unsorted within a band.
+      typedef std::map<PXInt64, std::vector<PricerOrder*> > PricerBucketMap;
+
+      /// Band key of price - lower keys are better prices.
+      PXInt64 BandKey(PXInt64 price) const
+      {
+         PXInt64 band = price / PRICER_LAZY_BAND_TICKS;
+         return (fOrderType & kPOT_Buy) ? -band : band;
+      }
+
+      /// True if a new order at price can wait in a bucket: it's beyond
+      /// the band after the marginal order's, and beyond every sorted
+      /// order's band (so all deferred orders stay behind all sorted 
+      /// ones). Only valid while the book is full.
+      ///
+      /// It must also wait if its band already has - or is behind - a
+      /// bucket: the frontier moves back as the marginal order improves
+      /// and sorted orders go, and sorting it would put it ahead of
+      /// deferred orders at better prices.
+      bool IsFarAway(PXInt64 price) const
+      {
+         PXInt64 key = BandKey(price);
+         if ((!fDeferred.empty()) && (key >= fDeferred.begin()->first))
+            return true;
+
+         PXInt64 frontier = BandKey((*fLastUsedOrder)->fLimitPrice) + 1;
+         PXInt64 worst    = BandKey((*fOrders.rbegin())->fLimitPrice);
+         if (worst > frontier)
+            frontier = worst;
+         return (key > frontier);
+      }
+
+      /// Sorts the nearest bucket onto the end of fOrders.
+      /// Returns an iterator to the first order moved.
+      PricerOrderSetIter PullDeferred()
+      {
+         PricerBucketMap::iterator   bucket = fDeferred.begin();
+         std::vector<PricerOrder*>&  orders = bucket->second;
+         std::sort(orders.begin(),orders.end(),
+                   PricerOrder::PricerOrderCompare_Cmp());
+
+         // Everything in it sorts after everything already in fOrders.
+         PricerOrderSetIter first = fOrders.end();
+         for (size_t i = 0; i < orders.size(); ++i)
+         {
+            PricerOrder* order    = orders[i];
+            order->fBucketIndex   = -1;
+            order->fSortSeq       = ++fSortSeq;
+            order->fOrderBookIter = fOrders.insert(fOrders.end(),order);
+            if (0 == i)
+               first = order->fOrderBookIter;
+         }
+
+         fDeferred.erase(bucket);
+         return first;
+      }
+
+      /// Takes a deferred order out of its bucket.
+      void RemoveDeferred(PricerOrder* order)
+      {
+         PricerBucketMap::iterator  bucket = 
+            fDeferred.find(BandKey(order->fLimitPrice));
+         std::vector<PricerOrder*>& orders = bucket->second;
+
+         PricerOrder* moved         = orders.back();
+         orders[order->fBucketIndex] = moved;
+         moved->fBucketIndex        = order->fBucketIndex;
+         orders.pop_back();
+         order->fBucketIndex        = -1;
+
+         if (orders.empty())
+            fDeferred.erase(bucket);
+      }
+
+      /// Load() without the cleanup on failure.
+      bool LoadOrders(PricerCheckpointFile&        file,
+                      std::vector<PricerOrder*>&   indexed)
+      {
+         PXUInt8 valid    = 0;
+         PXInt64 count    = 0;
+         PXInt64 lastUsed = -1;
+         PXInt64 numExtra = 0;
+         file.Get(numExtra);
+         for (PXInt64 i = 0; (i < numExtra) && (!file.Failed()); ++i)
+         {
+            PricerExtraTarget extra;
+            PXUInt8           extraValid = 0;
+            file.Get(extra.fShares);
+            file.Get(extra.fTotalPrice);
+            file.Get(extraValid);
+            extra.fValid = (extraValid != 0);
+            fExtraTargets.push_back(extra);
+         }
+         if ((numExtra > 0) && (!file.Failed()))
+            EnableDepthIndex();
+
+         file.Get(valid);
+         file.Get(fTotalPrice);
+         file.Get(fNumShares);
+         file.Get(count);
+         file.Get(lastUsed);
+
+         if ((file.Failed()) || (count < 0) || (lastUsed >= count))
+            return false;
+
+         fBookValid     = (valid != 0);
+         fLastUsedOrder = fOrders.end();
+
+         for (PXInt64 i = 0; i < count; ++i)
+         {
+            PricerOrder* order = fOrderPool->New(fOrderType);
+            PXInt64 numOwned  = 0;
+            PXUInt8 isIndexed = 0;
+            file.GetId(order->fId);
+            file.Get(order->fLimitPrice);
+            file.Get(order->fNumShares);
+            file.Get(numOwned);
+            file.Get(isIndexed);
+            order->fType |= kPOT_Add;
+
+            if ((file.Failed()) || (numOwned < 0) ||
+                (numOwned > order->fNumShares))
+            {
+               fOrderPool->Delete(order);
+               return false;
+            }
+
+            order->fSortSeq       = ++fSortSeq;
+            order->fOrderBookIter = fOrders.insert(fOrders.end(),order);
+            if (fDepth)
+               fDepth->Update(order->fLimitPrice,order->fNumShares);
+            if (i == lastUsed)
+            {
+               fLastUsedOrder = order->fOrderBookIter;
+               fMarginalOwned = numOwned;
+            }
+            if (isIndexed)
+               indexed.push_back(order);
+         }
+         return true;
+      }
+
       ePricerOrderType             fOrderType;     ///< kPOT_Buy | kPOT_Sell
+      PricerOrderPool*             fOrderPool;     ///< Caller's storage.
       PXInt64                      fTargetShares;
       PricerOrderSet               fOrders;
 
       bool                         fBookValid;
       PXInt64                      fTotalPrice;
       PXInt64                      fNumShares;
-      PricerOrderSetIter           fLastUsedOrder;
+      PricerOrderSetIter           fLastUsedOrder; ///< Marginal order.
+      PXInt64                      fMarginalOwned; ///< Shares held of it.
+      PXUInt64                     fSortSeq;       ///< Last fSortSeq given.
+      PricerOrder                  fProbe;         ///< Price to look up.
 
       OutStream*                   fOutStream;
       OutStream*                   fErrStream;
 
+      PricerTextSink<OutStream>    fTextSink;      ///< Default sink.
+      PricerNullSink               fNullSink;      ///< Sink while quiet.
+      PricerQuoteSink*             fQuoteSink;     ///< Sink when not quiet.
+      PricerCoalesceSink           fCoalesceSink;  ///< Ahead of fFilterSink.
+      bool                         fCoalesce;
+      PricerFilterSink             fFilterSink;    ///< Ahead of fCountSink.
+      PricerCountSink              fCountSink;     ///< Ahead of fQuoteSink.
+      PricerQuoteSink*             fPublishSink;   ///< First of the above.
+      PricerQuoteSink*             fSink;          ///< Where quotes go.
+      PricerQuoteSink*             fStateSink;     ///< Every state, or 0.
+
+      PricerDepthIndex*            fDepth;         ///< Depth index, or 0.
+
+      bool                         fLazy;          ///< Defer far orders.
+      PricerBucketMap              fDeferred;      ///< Unsorted far orders.
+
+      std::vector<PricerExtraTarget> fExtraTargets; ///< Besides the main.
+
+      PricerBookCounters           fCounters;
+
+#if (PRICER_LATENCY_STATS > 0)
+      PXUInt32                     fFills;         ///< FillOrder() calls.
+      PXUInt32                     fOutputs;       ///< States output.
+#endif
+
+#if (PRICER_TRACE > 0)
+      PricerTraceRing*             fTrace;         ///< Flight recorder, or 0.
+      const PricerOrder*           fTraceMarginal; ///< Last traced; compared only.
+#endif
+
    private:
       /// Copy not implemented.
       PricerBook(const PricerBook&)
-      : fOrderType(kPOT_None),fTargetShares(0),fOrders(),fBookValid(false),
-        fTotalPrice(0),fNumShares(0),fLastUsedOrder(fOrders.end()),fOutStream(0),fErrStream(0)
+      : fOrderType(kPOT_None),fOrderPool(0),fTargetShares(0),fOrders(),fBookValid(false),
+        fTotalPrice(0),fNumShares(0),fLastUsedOrder(fOrders.end()),fMarginalOwned(0),
+        fSortSeq(0),fProbe(),fOutStream(0),fErrStream(0),
+        fTextSink(),fNullSink(),fQuoteSink(0),fCoalesceSink(),fCoalesce(false),
+        fFilterSink(),fCountSink(0,0),fPublishSink(0),fSink(0),fStateSink(0),fDepth(0),
+        fLazy(false),fDeferred(),fExtraTargets(),fCounters()
+#if (PRICER_LATENCY_STATS > 0)
+        ,fFills(0),fOutputs(0)
+#endif
+#if (PRICER_TRACE > 0)
+        ,fTrace(0),fTraceMarginal(0)
+#endif
       {throw;}
       
       /// Assignment not implemented.
@@ -0,0 +1,217 @@
+/// \file  PricerCheckpoint.h
+/// \brief Binary checkpoint file for saving/restoring the order books.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerCheckpoint_H_
+#define _PricerCheckpoint_H_
+
+#include <string>
+#include "PricerDefs.h"
+
+/// "PRCK" - first four bytes of a checkpoint file.
+static const PXUInt32 kPricerCheckpointMagic   = 0x4b435250;
+
+/// Bump whenever the layout changes.
+static const PXUInt32 kPricerCheckpointVersion = 2;
+
+/// \class PricerCheckpointFile
+/// \brief Raw binary reader/writer for checkpoint files.
+///
+/// Values are written in native byte order - checkpoints are for
+/// restarting on the same machine, not for interchange.
+///
+/// Writes go to "path.tmp", which replaces path only when Close()
+/// succeeds, so a crash mid-write never leaves a torn checkpoint.
+/// Errors are sticky; check Close()'s result.
+class PricerCheckpointFile
+{
+   public:
+      PricerCheckpointFile()
+      : fFile(0),
+        fError(false),
+        fWriting(false),
+        fPath(),
+        fTmpPath()
+      {
+      }
+
+      ~PricerCheckpointFile()
+      {
+         if (fFile)
+         {
+            fclose(fFile);
+            if (fWriting)
+               remove(fTmpPath.c_str());
+         }
+      }
+
+      bool OpenWrite(const char* path)
+      {
+         fPath    = path;
+         fTmpPath = fPath + ".tmp";
+         fWriting = true;
+         fError   = false;
+         fFile    = fopen(fTmpPath.c_str(),"wb");
+         return (0 != fFile);
+      }
+
+      bool OpenRead(const char* path)
+      {
+         fPath    = path;
+         fWriting = false;
+         fError   = false;
+         fFile    = fopen(path,"rb");
+         return (0 != fFile);
+      }
+
+      /// Closes the file, and when writing, moves it into place.
+      /// Returns false if anything failed along the way.
+      bool Close()
+      {
+         if (0 == fFile)
+            return false;
+
+         if (0 != fclose(fFile))
+            fError = true;
+         fFile = 0;
+
+         if (fWriting)
+         {
+            if (fError)
+            {
+               remove(fTmpPath.c_str());
+               return false;
+            }
+#if defined(_WIN32)
+            remove(fPath.c_str());
+#endif
+            if (0 != rename(fTmpPath.c_str(),fPath.c_str()))
+               fError = true;
+         }
+         return !fError;
+      }
+
+      template<class T>
+      void Put(const T& val)
+      {
+         if ((!fError) && (1 != fwrite(&val,sizeof(T),1,fFile)))
+            fError = true;
+      }
+
+      template<class T>
+      void Get(T& val)
+      {
+         if ((!fError) && (1 != fread(&val,sizeof(T),1,fFile)))
+            fError = true;
+      }
+
+#if (PRICER_USE_64BIT_IDS > 0)
+      void PutId(const PricerOrderId& id) { Put(id); }
+      void GetId(PricerOrderId& id)       { Get(id); }
+#else
+      void PutId(const PricerOrderId& id)
+      {
+         PXUInt32 length = (PXUInt32)id.size();
+         Put(length);
+         if ((!fError) && (length) && 
+             (1 != fwrite(id.data(),length,1,fFile)))
+         {
+            fError = true;
+         }
+      }
+
+      void GetId(PricerOrderId& id)
+      {
+         PXUInt32 length = 0;
+         Get(length);
+         id.resize(length);
+         if ((!fError) && (length) &&
+             (1 != fread(&id[0],length,1,fFile)))
+         {
+            fError = true;
+         }
+      }
+#endif
+
+      bool Failed() const { return fError; }
+
+   protected:
+      FILE*          fFile;
+      bool           fError;
+      bool           fWriting;
+      std::string    fPath;
+      std::string    fTmpPath;
+   private:
+      /// Not implemented.
+      PricerCheckpointFile(const PricerCheckpointFile&);
+      /// Not implemented.
+      PricerCheckpointFile& operator=(const PricerCheckpointFile&);
+};
+
+/// \class PricerCheckpointIndex
+/// \brief Sparse timestamp -> checkpoint index.
+///
+/// A text file with one "timeStamp inputOffset checkpointPath" line
+/// per checkpoint taken, in input order, so a replay can start from
+/// the last checkpoint before the time it's interested in instead of
+/// rebuilding the books from the start of the log.
+class PricerCheckpointIndex
+{
+   public:
+      /// Adds an entry for a checkpoint just written.
+      static bool Append(const char*  indexPath,
+                         PXUInt32     timeStamp,
+                         PXInt64      inputOffset,
+                         const char*  checkpointPath)
+      {
+         FILE* file = fopen(indexPath,"a");
+         if (0 == file)
+            return false;
+
+         bool ok = (0 < fprintf(file,"%u %lld %s\n",timeStamp,
+                                (long long)inputOffset,checkpointPath));
+         return (0 == fclose(file)) && ok;
+      }
+
+      /// Finds the latest checkpoint taken before timeStamp.
+      /// Returns false if there's none (or no index).
+      static bool FindBefore(const char*   indexPath,
+                             PXUInt32      timeStamp,
+                             std::string&  checkpointPath)
+      {
+         FILE* file = fopen(indexPath,"r");
+         if (0 == file)
+            return false;
+
+         bool found = false;
+         char line[1024];
+         while (fgets(line,sizeof(line),file))
+         {
+            unsigned int entryTime = 0;
+            long long    offset    = 0;
+            int          pathPos   = 0;
+            if ((2 > sscanf(line,"%u %lld %n",&entryTime,&offset,&pathPos)) ||
+                (0 == pathPos))
+            {
+               continue;
+            }
+
+            // In input order, so the last one before timeStamp wins.
+            if (entryTime < timeStamp)
+            {
+               checkpointPath = line + pathPos;
+               while ((!checkpointPath.empty()) && 
+                      ((checkpointPath[checkpointPath.size()-1] == '\n') ||
+                       (checkpointPath[checkpointPath.size()-1] == '\r')))
+               {
+                  checkpointPath.erase(checkpointPath.size()-1);
+               }
+               found = !checkpointPath.empty();
+            }
+         }
+         fclose(file);
+         return found;
+      }
+};
+
+#endif // _PricerCheckpoint_H_
@@ -14,6 +14,40 @@
    #define PRICER_LOG_TIME 1
 #endif
 
+/*!
+ *  If set to 1, times every message with the cycle counter and keeps
+ *  latency histograms per message type and path, reported to stderr
+ *  at exit and on SIGUSR1. Compiled out (no cost at all) when 0.
+ */
+#ifndef PRICER_LATENCY_STATS
+   #define PRICER_LATENCY_STATS 0
+#endif
+
+/*!
+ *  If set to 1, books and the parser log compact binary events to an
+ *  in-memory flight recorder (the traceFile option / --trace), on
+ *  unless turned off (--no-trace).  0 compiles the hooks out.
+ */
+#ifndef PRICER_TRACE
+   #define PRICER_TRACE 1
+#endif
+
+/*!
+ *  Default flight-recorder size, in events (32 bytes each). Rounded
+ *  up to a power of two.
+ */
+#ifndef PRICER_TRACE_EVENTS
+   #define PRICER_TRACE_EVENTS 65536
+#endif
+
+/*!
+ *  Default flight-recorder dump file, relative to the working
+ *  directory. "%p" becomes the process id.
+ */
+#ifndef PRICER_TRACE_FILE
+   #define PRICER_TRACE_FILE "pricer.%p.trace"
+#endif
+
 /*
  *! Numeric ids make it faster, but the spec for the ids is
  *  somewhat unknown. If they might blow a 64-bit integer,
@@ -51,6 +85,157 @@
    #define PRICER_BUFFER_SIZE        1024*128
 #endif
 
+/*
+ *! Maximum number of bytes held back when batching output to a pipe
+ *  or socket. \see PricerOptions::batchLatencyUsec
+*/
+#ifndef PRICER_BATCH_SIZE
+   #define PRICER_BATCH_SIZE         1024*16
+#endif
+
+/*
+ *! Latency bound (microseconds) used by --batch when no value is given.
+ *  Quotes are held at most this long before being written to a 
+ *  non-file output.
+*/
+#ifndef PRICER_BATCH_LATENCY_USEC
+   #define PRICER_BATCH_LATENCY_USEC 200
+#endif
+
+/*
+ *! Build the io_uring stream backend (Linux only). It's only used
+ *  when requested (--io-uring) and the running kernel supports it,
+ *  otherwise the streams stay on plain read()/write().
+*/
+#ifndef PRICER_USE_IO_URING
+   #if defined(__linux__)
+      #define PRICER_USE_IO_URING 1
+   #else
+      #define PRICER_USE_IO_URING 0
+   #endif
+#endif
+
+/*
+ *! Window sizes for memory-mapped file output (--mmap-output). The
+ *  first window is PRICER_MMAP_WINDOW bytes, and each new window 
+ *  doubles up to PRICER_MMAP_MAX_WINDOW. Must be page multiples.
+*/
+#ifndef PRICER_MMAP_WINDOW
+   #define PRICER_MMAP_WINDOW        1024*1024
+#endif
+
+#ifndef PRICER_MMAP_MAX_WINDOW
+   #define PRICER_MMAP_MAX_WINDOW    1024*1024*64
+#endif
+
+/*
+ *! --follow: longest wait (milliseconds) for a followed file to change
+ *  before its size is rechecked anyway. inotify normally wakes us well
+ *  before this; without it (non-Linux) it's the polling interval.
+*/
+#ifndef PRICER_FOLLOW_POLL_MSEC
+   #define PRICER_FOLLOW_POLL_MSEC   1000
+#endif
+
+/*
+ *! Compressed input support. gzip input needs zlib (-lz), zstd needs
+ *  libzstd (-lzstd); both decompress on a separate thread (-lpthread).
+ *  Off by default since neither library is a given - the unix 
+ *  Makefiles turn on zlib.
+*/
+#ifndef PRICER_USE_ZLIB
+   #define PRICER_USE_ZLIB           0
+#endif
+
+#ifndef PRICER_USE_ZSTD
+   #define PRICER_USE_ZSTD           0
+#endif
+
+/*
+ *! Number of PRICER_BUFFER_SIZE blocks in the decompressed-input ring.
+ *  The decompression thread can run this many blocks ahead of parsing.
+*/
+#ifndef PRICER_DECOMPRESS_BUFFERS
+   #define PRICER_DECOMPRESS_BUFFERS 4
+#endif
+
+/*
+ *! Widest price range (in cents) the depth index covers. It needs 24 
+ *  bytes per cent; books spread wider than this are walked instead.
+*/
+#ifndef PRICER_DEPTH_MAX_TICKS
+   #define PRICER_DEPTH_MAX_TICKS    1024*1024
+#endif
+
+/*
+ *! Orders a book steps through, re-filling or shedding its target,
+ *  before it takes the crossing from its depth index's levels instead
+ *  of walking on. Every book keeps a depth index when this is set;
+ *  0 turns the jump (and that index) off.
+*/
+#ifndef PRICER_LEVEL_JUMP_STEPS
+   #define PRICER_LEVEL_JUMP_STEPS   16
+#endif
+
+/*
+ *! Lazy books (--lazy-book): width, in cents, of the price bands that
+ *  orders far behind the marginal price are bucketed by, unsorted.
+ *  The marginal order's band and the one after it stay sorted.
+*/
+#ifndef PRICER_LAZY_BAND_TICKS
+   #define PRICER_LAZY_BAND_TICKS    100
+#endif
+
+/*
+ *! Vectorized level scans for the depth index. x86 gcc/clang builds
+ *  carry AVX-512 and AVX2 kernels and use the widest the CPU runs,
+ *  plain C++ otherwise.
+*/
+#ifndef PRICER_USE_SIMD
+   #define PRICER_USE_SIMD           1
+#endif
+
+/*
+ *! Bytes of quotes a PricerServe() subscriber may fall behind before
+ *  it's disconnected. \see PricerOptions::serverMaxLag
+*/
+#ifndef PRICER_SERVER_MAX_LAG
+   #define PRICER_SERVER_MAX_LAG     1024*1024*4
+#endif
+
+/*
+ *! Quote slots in a shared-memory segment (\see PricerOptions::shmName):
+ *  a bid and an ask for the main target, the rest for extra targets.
+*/
+#ifndef PRICER_SHM_SLOTS
+   #define PRICER_SHM_SLOTS          16
+#endif
+
+/*
+ *! Threads that may hold a book snapshot reader at once.
+ *  \see PricerOpenReader
+*/
+#ifndef PRICER_SNAPSHOT_READERS
+   #define PRICER_SNAPSHOT_READERS   64
+#endif
+
+/*
+ *! Messages read ahead by PricerParser::Run() so the id table slots 
+ *  and orders they touch can be prefetched before they're applied.
+ *  Read-ahead stops early if the input has nothing more buffered.
+ *  1 applies each message as it's read.
+*/
+#ifndef PRICER_APPLY_BATCH
+   #define PRICER_APPLY_BATCH        16
+#endif
+
+/*
+ *! Bytes of stack pre-faulted at startup in latency mode.
+*/
+#ifndef PRICER_PREFAULT_STACK
+   #define PRICER_PREFAULT_STACK     1024*256
+#endif
+
 /* 
  *! Call type for PricerProcess() and PricerGetResultString() functions.
  *  Useful if you want to call from another language
@@ -0,0 +1,423 @@
+/// \file  PricerDecompress.cpp
+/// \brief Background decompression of gzip/zstd input.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+   #define _GNU_SOURCE
+#endif
+
+#include "PricerDecompress.h"
+#include "PricerSys.h"
+
+#if (PRICER_USE_ZLIB > 0)
+   #include <zlib.h>
+#endif
+#if (PRICER_USE_ZSTD > 0)
+   #include <zstd.h>
+#endif
+
+ePricerCompression PricerDetectCompression(const char* data, int length)
+{
+   const unsigned char* bytes = (const unsigned char*)data;
+
+   if ((length >= 2) && (bytes[0] == 0x1f) && (bytes[1] == 0x8b))
+      return kPC_Gzip;
+
+   if ((length >= 4) && (bytes[0] == 0x28) && (bytes[1] == 0xb5) &&
+       (bytes[2] == 0x2f) && (bytes[3] == 0xfd))
+   {
+      return kPC_Zstd;
+   }
+   return kPC_None;
+}
+
+bool PricerCanDecompress(ePricerCompression format)
+{
+#if (PRICER_USE_DECOMPRESS > 0)
+   switch (format)
+   {
+      case kPC_Gzip: return (PRICER_USE_ZLIB > 0);
+      case kPC_Zstd: return (PRICER_USE_ZSTD > 0);
+      default:       return false;
+   }
+#else
+   (void)format;
+   return false;
+#endif
+}
+
+#if (PRICER_USE_DECOMPRESS > 0)
+
+/// How often (msec) a thread blocked on an idle pipe checks for Stop.
+static const int kPricerDecompressPollMsec = 100;
+
+PricerDecompressor::PricerDecompressor()
+: fFileNum(-1),
+  fFormat(kPC_None),
+  fBlockSize(0),
+  fInBuf(0),
+  fInSize(0),
+  fInLen(0),
+  fFillIndex(0),
+  fReadIndex(0),
+  fFilled(0),
+  fHolding(false),
+  fDone(false),
+  fStopping(false),
+  fError(false),
+  fStarted(false),
+  fCpu(-1),
+  fNode(-1),
+  fThread()
+{
+   for (int i = 0; i < PRICER_DECOMPRESS_BUFFERS; ++i)
+   {
+      fBlocks[i].fData   = 0;
+      fBlocks[i].fLength = 0;
+   }
+   pthread_mutex_init(&fLock,0);
+   pthread_cond_init(&fChanged,0);
+}
+
+PricerDecompressor::~PricerDecompressor()
+{
+   if (fStarted)
+   {
+      // Wake the thread if it's waiting on us, then wait for it.
+      pthread_mutex_lock(&fLock);
+      fStopping = true;
+      pthread_cond_signal(&fChanged);
+      pthread_mutex_unlock(&fLock);
+      pthread_join(fThread,0);
+   }
+
+   for (int i = 0; i < PRICER_DECOMPRESS_BUFFERS; ++i)
+      PricerSysFreePages(fBlocks[i].fData,fBlockSize);
+   PricerSysFreePages(fInBuf,fInSize);
+
+   pthread_cond_destroy(&fChanged);
+   pthread_mutex_destroy(&fLock);
+}
+
+bool PricerDecompressor::Start(int                 fileNum,
+                               ePricerCompression  format,
+                               const char*         prefix,
+                               int                 prefixLen,
+                               int                 blockSize,
+                               int                 cpu)
+{
+   if ((fStarted) || (!PricerCanDecompress(format)) || (blockSize <= 0))
+      return false;
+
+   fFileNum   = fileNum;
+   fFormat    = format;
+   fBlockSize = blockSize;
+   fInSize    = (prefixLen > blockSize) ? prefixLen : blockSize;
+
+   // Mapped, so they can be bound to the thread's node before 
+   // anything touches them.
+   ePricerSysPages pages = kPSP_Small;
+   fInBuf = (char*)PricerSysAllocPages(fInSize,pages,false);
+   for (int i = 0; i < PRICER_DECOMPRESS_BUFFERS; ++i)
+   {
+      pages = kPSP_Small;
+      fBlocks[i].fData = (char*)PricerSysAllocPages(blockSize,pages,false);
+      if (0 == fBlocks[i].fData)
+         return false;
+   }
+   if (0 == fInBuf)
+      return false;
+
+   int node = PricerSysCpuNode(cpu);
+   if (node >= 0)
+   {
+      bool bound = PricerSysBindMemory(fInBuf,fInSize,node);
+      for (int i = 0; i < PRICER_DECOMPRESS_BUFFERS; ++i)
+         bound = PricerSysBindMemory(fBlocks[i].fData,blockSize,node) && bound;
+      if (bound)
+         fNode = node;
+   }
+
+   // The bytes already read go through first.
+   fInLen = prefixLen;
+   if (prefixLen > 0)
+      memcpy(fInBuf,prefix,prefixLen);
+
+#if defined(__linux__)
+   // Pinned from its first instruction, so whatever the decoder 
+   // allocates is first touched on the right node too.
+   if (cpu >= 0)
+   {
+      cpu_set_t      cpus;
+      pthread_attr_t attr;
+      CPU_ZERO(&cpus);
+      CPU_SET(cpu,&cpus);
+      pthread_attr_init(&attr);
+      if ((0 == pthread_attr_setaffinity_np(&attr,sizeof(cpus),&cpus)) &&
+          (0 == pthread_create(&fThread,&attr,ThreadProc,this)))
+      {
+         fStarted = true;
+         fCpu     = cpu;
+      }
+      pthread_attr_destroy(&attr);
+   }
+#endif
+
+   // Unpinned if that failed - slower perhaps, but still correct.
+   if (!fStarted)
+      fStarted = (0 == pthread_create(&fThread,0,ThreadProc,this));
+   return fStarted;
+}
+
+bool PricerDecompressor::NextBlock(char*& data, int& length)
+{
+   pthread_mutex_lock(&fLock);
+
+   // Done with the last one - back to the thread.
+   if (fHolding)
+   {
+      fReadIndex = (fReadIndex + 1) % PRICER_DECOMPRESS_BUFFERS;
+      --fFilled;
+      fHolding = false;
+      pthread_cond_signal(&fChanged);
+   }
+
+   while ((0 == fFilled) && (!fDone))
+      pthread_cond_wait(&fChanged,&fLock);
+
+   bool gotBlock = (0 != fFilled);
+   if (gotBlock)
+   {
+      data     = fBlocks[fReadIndex].fData;
+      length   = fBlocks[fReadIndex].fLength;
+      fHolding = true;
+   }
+
+   pthread_mutex_unlock(&fLock);
+   return gotBlock;
+}
+
+void* PricerDecompressor::ThreadProc(void* context)
+{
+   ((PricerDecompressor*)context)->Run();
+   return 0;
+}
+
+void PricerDecompressor::Run()
+{
+   bool ok = (kPC_Gzip == fFormat) ? InflateGzip() : DecompressZstd();
+   Finish(!ok);
+}
+
+int PricerDecompressor::ReadInput()
+{
+   if (fInLen > 0)
+   {
+      int length = fInLen;
+      fInLen = 0;
+      return length;
+   }
+
+   for (;;)
+   {
+      if (fStopping)
+         return 0;
+
+      // Don't block forever on a pipe - we may be asked to stop.
+      struct pollfd input;
+      input.fd      = fFileNum;
+      input.events  = POLLIN;
+      input.revents = 0;
+      if (0 == poll(&input,1,kPricerDecompressPollMsec))
+         continue;
+
+      xplat_ssize_t res = xplat_read(fFileNum,fInBuf,fBlockSize);
+      if (res >= 0)
+         return (int)res;
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+         return -1;
+   }
+}
+
+PricerDecompressor::Block* PricerDecompressor::AcquireBlock()
+{
+   Block* block = 0;
+
+   pthread_mutex_lock(&fLock);
+   while ((PRICER_DECOMPRESS_BUFFERS == fFilled) && (!fStopping))
+      pthread_cond_wait(&fChanged,&fLock);
+
+   if (!fStopping)
+      block = &fBlocks[fFillIndex];
+   pthread_mutex_unlock(&fLock);
+
+   return block;
+}
+
+void PricerDecompressor::PublishBlock()
+{
+   pthread_mutex_lock(&fLock);
+   fFillIndex = (fFillIndex + 1) % PRICER_DECOMPRESS_BUFFERS;
+   ++fFilled;
+   pthread_cond_signal(&fChanged);
+   pthread_mutex_unlock(&fLock);
+}
+
+void PricerDecompressor::Finish(bool error)
+{
+   pthread_mutex_lock(&fLock);
+   fError = error;
+   fDone  = true;
+   pthread_cond_signal(&fChanged);
+   pthread_mutex_unlock(&fLock);
+}
+
+bool PricerDecompressor::InflateGzip()
+{
+#if (PRICER_USE_ZLIB > 0)
+   z_stream stream;
+   memset(&stream,0,sizeof(stream));
+
+   // 16 + window bits: gzip wrapper only.
+   if (Z_OK != inflateInit2(&stream,16 + MAX_WBITS))
+      return false;
+
+   Block* block = AcquireBlock();
+   if (block)
+   {
+      stream.next_out  = (Bytef*)block->fData;
+      stream.avail_out = fBlockSize;
+   }
+
+   bool ok          = true;
+   bool atMemberEnd = false;
+   while (block)
+   {
+      if (0 == stream.avail_in)
+      {
+         int length = ReadInput();
+         if (length <= 0)
+         {
+            // Clean only if we finished a gzip member.
+            ok = (0 == length) && (atMemberEnd || fStopping);
+            break;
+         }
+         stream.next_in  = (Bytef*)fInBuf;
+         stream.avail_in = length;
+      }
+
+      int res = inflate(&stream,Z_NO_FLUSH);
+      if (Z_STREAM_END == res)
+      {
+         // Concatenated gzip files are valid gzip - keep going.
+         atMemberEnd = true;
+         inflateReset(&stream);
+      }
+      else if (Z_OK == res)
+      {
+         atMemberEnd = false;
+      }
+      else if (Z_BUF_ERROR != res)
+      {
+         // Corrupt data, or not enough memory.
+         ok = false;
+         break;
+      }
+
+      if (0 == stream.avail_out)
+      {
+         block->fLength = fBlockSize;
+         PublishBlock();
+         if (0 != (block = AcquireBlock()))
+         {
+            stream.next_out  = (Bytef*)block->fData;
+            stream.avail_out = fBlockSize;
+         }
+      }
+   }
+
+   // Whatever's left in the last block.
+   if ((block) && (stream.avail_out != (uInt)fBlockSize))
+   {
+      block->fLength = fBlockSize - (int)stream.avail_out;
+      PublishBlock();
+   }
+
+   inflateEnd(&stream);
+   return ok;
+#else
+   return false;
+#endif
+}
+
+bool PricerDecompressor::DecompressZstd()
+{
+#if (PRICER_USE_ZSTD > 0)
+   ZSTD_DStream* stream = ZSTD_createDStream();
+   if ((0 == stream) || (ZSTD_isError(ZSTD_initDStream(stream))))
+   {
+      ZSTD_freeDStream(stream);
+      return false;
+   }
+
+   ZSTD_inBuffer  input  = { fInBuf, 0, 0 };
+   ZSTD_outBuffer output = { 0, 0, 0 };
+
+   Block* block = AcquireBlock();
+   if (block)
+   {
+      output.dst  = block->fData;
+      output.size = fBlockSize;
+   }
+
+   bool   ok      = true;
+   size_t lastRes = 0;
+   while (block)
+   {
+      if (input.pos == input.size)
+      {
+         int length = ReadInput();
+         if (length <= 0)
+         {
+            // lastRes is 0 when a frame has just been completed.
+            ok = (0 == length) && ((0 == lastRes) || fStopping);
+            break;
+         }
+         input.size = length;
+         input.pos  = 0;
+      }
+
+      lastRes = ZSTD_decompressStream(stream,&output,&input);
+      if (ZSTD_isError(lastRes))
+      {
+         ok = false;
+         break;
+      }
+
+      if (output.pos == output.size)
+      {
+         block->fLength = fBlockSize;
+         PublishBlock();
+         if (0 != (block = AcquireBlock()))
+         {
+            output.dst  = block->fData;
+            output.size = fBlockSize;
+            output.pos  = 0;
+         }
+      }
+   }
+
+   if ((block) && (output.pos))
+   {
+      block->fLength = (int)output.pos;
+      PublishBlock();
+   }
+
+   ZSTD_freeDStream(stream);
+   return ok;
+#else
+   return false;
+#endif
+}
+
+#endif // PRICER_USE_DECOMPRESS
@@ -0,0 +1,140 @@
+/// \file  PricerDecompress.h
+/// \brief Background decompression of gzip/zstd input.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerDecompress_H_
+#define _PricerDecompress_H_
+
+#include "PricerXplat.h"
+
+#if ((PRICER_USE_ZLIB > 0) || (PRICER_USE_ZSTD > 0)) && !defined(_WIN32)
+   #define PRICER_USE_DECOMPRESS 1
+   #include <pthread.h>
+#else
+   #define PRICER_USE_DECOMPRESS 0
+#endif
+
+/// Compressed formats we recognize by their magic bytes.
+enum ePricerCompression
+{
+   kPC_None = 0,
+   kPC_Gzip,      ///< 1f 8b
+   kPC_Zstd       ///< 28 b5 2f fd
+};
+
+/// Bytes needed to tell the formats apart.
+static const int kPricerCompressionMagicSize = 4;
+
+/// Identifies the compression of data from its first bytes.
+ePricerCompression PricerDetectCompression(const char* data, int length);
+
+/// True if this build can decompress format.
+bool PricerCanDecompress(ePricerCompression format);
+
+#if (PRICER_USE_DECOMPRESS > 0)
+
+/// \class PricerDecompressor
+/// \brief Decompresses a file descriptor on its own thread.
+///
+/// The thread reads the compressed input and inflates it into a ring
+/// of fixed-size blocks.  The reader takes blocks in order with 
+/// NextBlock() and parses them in place - the block it holds is 
+/// returned to the ring on its next call - so decompression of the 
+/// following blocks overlaps the parsing of the current one.
+class PricerDecompressor
+{
+   public:
+      PricerDecompressor();
+      ~PricerDecompressor();
+
+      /// Starts decompressing fileNum on a new thread.
+      ///
+      /// \param fileNum   Compressed input.
+      /// \param format    Its compression (from PricerDetectCompression).
+      /// \param prefix    Input already read from fileNum (may be 0).
+      /// \param prefixLen Length of prefix.
+      /// \param blockSize Size of each ring block.
+      /// \param cpu       CPU to pin the thread to, or -1.  Its ring
+      ///                  is bound to the CPU's NUMA node.
+      ///
+      /// \return bool false if the thread or decoder can't be started.
+      bool Start(int                 fileNum,
+                 ePricerCompression  format,
+                 const char*         prefix,
+                 int                 prefixLen,
+                 int                 blockSize,
+                 int                 cpu = -1);
+
+      /// Releases the previously returned block and waits for the next.
+      /// Returns false at the end of the data; check HadError() then.
+      bool NextBlock(char*& data, int& length);
+
+      /// True if reading or decompressing failed.
+      bool HadError() const { return fError; }
+
+      /// CPU the thread is pinned to, or -1 if it isn't.
+      int GetCpu() const { return fCpu; }
+
+      /// NUMA node the ring is bound to, or -1 if it isn't.
+      int GetNode() const { return fNode; }
+
+   protected:
+      struct Block
+      {
+         char* fData;
+         int   fLength;
+      };
+
+      static void* ThreadProc(void* context);
+
+      /// Thread body - fills blocks until the input ends.
+      void Run();
+
+      /// Reads more compressed input. Returns bytes read, 0 at the end.
+      int ReadInput();
+
+      /// Waits for a free block to fill. Returns 0 if stopping.
+      Block* AcquireBlock();
+
+      /// Hands a filled block to the reader.
+      void PublishBlock();
+
+      /// Marks the end of the data (or an error) for the reader.
+      void Finish(bool error);
+
+      bool InflateGzip();
+      bool DecompressZstd();
+
+      int                  fFileNum;
+      ePricerCompression   fFormat;
+      int                  fBlockSize;
+
+      char*                fInBuf;          ///< Compressed input.
+      int                  fInSize;         ///< Size of fInBuf.
+      int                  fInLen;          ///< Bytes in fInBuf.
+
+      Block                fBlocks[PRICER_DECOMPRESS_BUFFERS];
+      int                  fFillIndex;      ///< Next block to fill.
+      int                  fReadIndex;      ///< Next block to read.
+      int                  fFilled;         ///< Filled or being read.
+      bool                 fHolding;        ///< Reader has fReadIndex.
+      bool                 fDone;           ///< No more blocks coming.
+      volatile bool        fStopping;       ///< Reader's going away.
+      volatile bool        fError;
+
+      bool                 fStarted;
+      int                  fCpu;
+      int                  fNode;
+      pthread_t            fThread;
+      pthread_mutex_t      fLock;
+      pthread_cond_t       fChanged;
+   private:
+      /// Not implemented.
+      PricerDecompressor(const PricerDecompressor&);
+      /// Not implemented.
+      PricerDecompressor& operator=(const PricerDecompressor&);
+};
+
+#endif // PRICER_USE_DECOMPRESS
+
+#endif // _PricerDecompress_H_
@@ -32,7 +32,11 @@ enum ePricerOrderType
    kPOT_RemoveSell  = 0x42, // kPOT_Remove | kPOT_Sell,
    kPOT_BuySellMask = 0x03,
    kPOT_ActionMask  = 0x70,
-   kPOT_Exit        = 0x80
+   kPOT_Exit        = 0x80,
+   kPOT_SetTarget   = 0x100, // "T S shares" - change the target
+   kPOT_AddTarget   = 0x200, // "T A shares" - publish another target
+   kPOT_RemoveTarget = 0x400, // "T R shares" - stop publishing one
+   kPOT_TargetMask  = 0x700
 };
 
 /// Retrieve the char used for messages of specified type
@@ -43,6 +47,19 @@ xplat_inline char PricerGetMsgChar(ePricerOrderType msgType)
    return 'S';
 }
 
+/// Retrieve the message type for a target control message's action
+/// char ('S'et, 'A'dd, 'R'emove), or kPOT_None.
+xplat_inline PricerOrderType PricerGetTargetAction(char action)
+{
+   switch (action)
+   {
+      case 'S': return kPOT_SetTarget;
+      case 'A': return kPOT_AddTarget;
+      case 'R': return kPOT_RemoveTarget;
+      default:  return kPOT_None;
+   }
+}
+
 /// Returns true on non-error codes.
 /// \see ePricerResult
 #define PRICEROK(x)      ((x)>=0)
@@ -52,34 +69,44 @@ xplat_inline char PricerGetMsgChar(ePricerOrderType msgType)
 #define PRICERERR(x)     ((x)<0)
 
 // If we're using numeric ids, define them.
-// Otherwise define string comparison usage.
+// Otherwise define string hashing usage.
 #if (PRICER_USE_64BIT_IDS > 0)
    
    typedef PXPacked64 PricerOrderId;
+
+   /// PricerOrderIdHash() is a bijection - equal hashes mean equal ids.
+   static const bool kPricerIdHashIsId = true;
    
-   /// PricerOrderId* comparator for std::map searching by id.
-   struct PricerOrderId_cmp
+   /// Hash for the id table (splitmix64 finalizer).
+   xplat_inline PXUInt64 PricerOrderIdHash(const PricerOrderId& id)
    {
-      bool operator()(const PricerOrderId* cmp1, 
-                      const PricerOrderId* cmp2) const
-      {
-         return ( (*cmp1) < (*cmp2) );
-      }
-   };
+      PXUInt64 h = id;
+      h ^= h >> 30;
+      h *= 0xBF58476D1CE4E5B9ULL;
+      h ^= h >> 27;
+      h *= 0x94D049BB133111EBULL;
+      h ^= h >> 31;
+      return h;
+   }
 
 #else
 
    typedef std::string PricerOrderId;
+
+   /// Ids must be compared when their hashes match.
+   static const bool kPricerIdHashIsId = false;
    
-   /// String ptr comparator for std:map searching by id.
-   struct PricerOrderId_cmp
+   /// Hash for the id table (FNV-1a).
+   xplat_inline PXUInt64 PricerOrderIdHash(const PricerOrderId& id)
    {
-      bool operator()(const PricerOrderId* cmp1, 
-                      const PricerOrderId* cmp2) const
+      PXUInt64 h = 0xCBF29CE484222325ULL;
+      for (size_t i = 0; i < id.size(); ++i)
       {
-         return ( cmp1->compare(*cmp2) < 0);
+         h ^= (PXUInt8)id[i];
+         h *= 0x100000001B3ULL;
       }
-   };
+      return h;
+   }
 #endif
 
 
@@ -0,0 +1,151 @@
+/// \file  PricerDepthIndex.cpp
+/// \brief Cumulative depth index over a book side's price levels.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include "PricerDepthIndex.h"
+
+/// Ticks covered when the first price arrives.
+static const PXInt64 kPricerDepthInitialTicks = 4096;
+
+PricerDepthIndex::PricerDepthIndex(bool descending)
+: fDescending(descending),
+  fOverflow(false),
+  fMinKey(0),
+  fSize(0),
+  fBlocks(0),
+  fTotal(0),
+  fLevels(0),
+  fQtyTree(0),
+  fNotionalTree(0)
+{
+}
+
+PricerDepthIndex::~PricerDepthIndex()
+{
+   delete [] fLevels;
+   delete [] fQtyTree;
+   delete [] fNotionalTree;
+}
+
+void PricerDepthIndex::Clear()
+{
+   delete [] fLevels;
+   delete [] fQtyTree;
+   delete [] fNotionalTree;
+   fLevels       = 0;
+   fQtyTree      = 0;
+   fNotionalTree = 0;
+   fSize         = 0;
+   fBlocks       = 0;
+   fMinKey       = 0;
+   fTotal        = 0;
+   fOverflow     = false;
+}
+
+bool PricerDepthIndex::Grow(PXInt64 price)
+{
+   PXInt64 key = fDescending ? -price : price;
+
+   PXInt64 newSize;
+   PXInt64 newMinKey;
+   if (0 == fSize)
+   {
+      // First price - center the range on it.
+      newSize   = kPricerDepthInitialTicks;
+      newMinKey = key - newSize/2;
+   }
+   else
+   {
+      // Double (toward the new key) until it fits.
+      newSize   = fSize;
+      newMinKey = fMinKey;
+      while ((key < newMinKey) || (key >= newMinKey + newSize))
+      {
+         if (key < newMinKey)
+            newMinKey -= newSize;
+         newSize *= 2;
+
+         if (newSize > PRICER_DEPTH_MAX_TICKS)
+         {
+            Clear();
+            fOverflow = true;
+            return false;
+         }
+      }
+   }
+
+   PXInt64* levels = new PXInt64[newSize];
+   memset(levels,0,sizeof(PXInt64)*newSize);
+   if (fLevels)
+      memcpy(levels + (fMinKey - newMinKey),fLevels,sizeof(PXInt64)*fSize);
+
+   delete [] fLevels;
+   delete [] fQtyTree;
+   delete [] fNotionalTree;
+
+   fLevels       = levels;
+   fSize         = newSize;
+   fBlocks       = newSize >> kBlockShift;
+   fMinKey       = newMinKey;
+   fQtyTree      = new PXInt64[fBlocks + 1];
+   fNotionalTree = new PXInt64[fBlocks + 1];
+
+   // Linear-time build: each node passes its sum up to its parent.
+   memset(fQtyTree,0,sizeof(PXInt64)*(fBlocks + 1));
+   memset(fNotionalTree,0,sizeof(PXInt64)*(fBlocks + 1));
+   for (PXInt64 pos = 0; pos < newSize; ++pos)
+   {
+      fQtyTree[(pos >> kBlockShift) + 1]      += fLevels[pos];
+      fNotionalTree[(pos >> kBlockShift) + 1] += fLevels[pos] * PriceAt(pos);
+   }
+   for (PXInt64 i = 1; i <= fBlocks; ++i)
+   {
+      PXInt64 parent = i + (i & -i);
+      if (parent <= fBlocks)
+      {
+         fQtyTree[parent]      += fQtyTree[i];
+         fNotionalTree[parent] += fNotionalTree[i];
+      }
+   }
+   return true;
+}
+
+bool PricerDepthIndex::Query(PXInt64  shares,
+                             PXInt64& totalPrice,
+                             PXInt64& marginalPrice,
+                             PXInt64& marginalShares) const
+{
+   if ((fOverflow) || (shares <= 0) || (shares > fTotal))
+      return false;
+
+   // Find the last block whose running total is still short of
+   // shares; the block after it is where they run out.
+   PXInt64 block    = 0;
+   PXInt64 qty      = 0;
+   PXInt64 notional = 0;
+   for (PXInt64 step = fBlocks; step > 0; step >>= 1)
+   {
+      PXInt64 next = block + step;
+      if ((next <= fBlocks) && (qty + fQtyTree[next] < shares))
+      {
+         block     = next;
+         qty      += fQtyTree[next];
+         notional += fNotionalTree[next];
+      }
+   }
+
+   // Then the level within it. Prices step by one tick per level.
+   PXInt64 base = block << kBlockShift;
+   PricerLevelScanResult scan = PricerLevelScan(fLevels + base,
+                                                kBlockTicks,
+                                                shares - qty);
+   PXInt64 step = fDescending ? -1 : 1;
+   notional += PriceAt(base) * scan.qtyBefore +
+               step * (scan.level * scan.qtyBefore - scan.runBefore);
+   qty      += scan.qtyBefore;
+
+   marginalPrice  = PriceAt(base + scan.level);
+   marginalShares = shares - qty;
+   totalPrice     = notional + marginalShares * marginalPrice;
+   return true;
+}
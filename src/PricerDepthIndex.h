@@ -0,0 +1,123 @@
+/// \file  PricerDepthIndex.h
+/// \brief Cumulative depth index over a book side's price levels.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerDepthIndex_H_
+#define _PricerDepthIndex_H_
+
+#include "PricerXplat.h"
+#include "PricerLevelScan.h"
+
+/// \class PricerDepthIndex
+/// \brief Answers "what do N shares cost?" for any N in O(log ticks).
+///
+/// Shares are kept per price tick (one cent) in a dense array, best
+/// price first, with two Fenwick trees over blocks of kBlockTicks of
+/// it - one of quantity, one of notional (quantity times price).  A
+/// descent of the quantity tree finds the block where N shares run 
+/// out, summing the notional of the blocks before it on the way, and
+/// PricerLevelScan() finds the level within the block.  Keeping the 
+/// trees per block rather than per tick makes them small enough to 
+/// stay in cache and takes kBlockShift steps off every update.
+///
+/// The tick range starts around the first price seen and doubles as
+/// prices arrive outside it, up to PRICER_DEPTH_MAX_TICKS.  Past that
+/// the index gives up (IsValid() goes false) and callers fall back to
+/// walking the book.
+class PricerDepthIndex
+{
+   public:
+      /// descending is true for buy books, whose best price is highest.
+      PricerDepthIndex(bool descending);
+      ~PricerDepthIndex();
+
+      /// Adds shares at price (negative to take them away).
+      void Update(PXInt64 price, PXInt64 shares)
+      {
+         if (fOverflow)
+            return;
+
+         PXInt64 pos = (fDescending ? -price : price) - fMinKey;
+         if (((PXUInt64)pos >= (PXUInt64)fSize) && (!Grow(price)))
+            return;
+
+         pos = (fDescending ? -price : price) - fMinKey;
+         fLevels[pos] += shares;
+         fTotal       += shares;
+
+         PXInt64 notional = shares * price;
+         PXInt64 block    = (pos >> kBlockShift) + 1;
+         for (PXInt64 i = block; i <= fBlocks; i += (i & -i))
+         {
+            fQtyTree[i]      += shares;
+            fNotionalTree[i] += notional;
+         }
+      }
+
+      /// Prices shares against the book, best levels first.
+      ///
+      /// \param shares         Number of shares wanted (> 0).
+      /// \param totalPrice     On success, total cost of them.
+      /// \param marginalPrice  On success, price of the last share.
+      ///
+      /// \return bool false if the book doesn't hold that many.
+      bool Query(PXInt64  shares,
+                 PXInt64& totalPrice,
+                 PXInt64& marginalPrice) const
+      {
+         PXInt64 marginalShares = 0;
+         return Query(shares,totalPrice,marginalPrice,marginalShares);
+      }
+
+      /// Query() that also gives how many of the shares come from the
+      /// marginal price level, so a book can find its marginal order
+      /// without walking the levels ahead of it.
+      bool Query(PXInt64  shares,
+                 PXInt64& totalPrice,
+                 PXInt64& marginalPrice,
+                 PXInt64& marginalShares) const;
+
+      /// Shares across every level.
+      PXInt64 GetTotalShares() const { return fTotal; }
+
+      /// False once prices have spread past PRICER_DEPTH_MAX_TICKS.
+      bool IsValid() const { return !fOverflow; }
+
+      /// Empties the index.
+      void Clear();
+
+   protected:
+      enum
+      {
+         kBlockShift = 5,
+         kBlockTicks = 1 << kBlockShift    ///< Ticks per tree entry.
+      };
+
+      /// Widens the tick range to take price, rebuilding the trees.
+      /// Returns false (and invalidates the index) if it can't.
+      bool Grow(PXInt64 price);
+
+      /// Price of the level at pos.
+      PXInt64 PriceAt(PXInt64 pos) const
+      {
+         return fDescending ? -(pos + fMinKey) : (pos + fMinKey);
+      }
+
+      bool        fDescending;
+      bool        fOverflow;
+      PXInt64     fMinKey;          ///< Key (signed price) of fLevels[0].
+      PXInt64     fSize;            ///< Ticks covered, a power of 2.
+      PXInt64     fBlocks;          ///< fSize / kBlockTicks.
+      PXInt64     fTotal;
+
+      PXInt64*    fLevels;          ///< Shares per tick.
+      PXInt64*    fQtyTree;         ///< Fenwick tree of blocks, 1-based.
+      PXInt64*    fNotionalTree;    ///< Fenwick tree of blocks, 1-based.
+   private:
+      /// Not implemented.
+      PricerDepthIndex(const PricerDepthIndex&);
+      /// Not implemented.
+      PricerDepthIndex& operator=(const PricerDepthIndex&);
+};
+
+#endif // _PricerDepthIndex_H_
@@ -0,0 +1,222 @@
+/// \file  PricerIdTable.h
+/// \brief Open-addressing table of orders by id.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerIdTable_H_
+#define _PricerIdTable_H_
+
+#include <new>
+#include "PricerOrder.h"
+#include "PricerSys.h"
+
+/// \class PricerIdTable
+/// \brief Orders by id - linear probing, power of two slots.
+///
+/// Replaces a std::map<id,order>: a lookup is usually one cache line
+/// (the id's home slot, holding the hash and order pointer), and its
+/// address is known from the id alone - so Prefetch() can start the
+/// load well before the message is applied, which a tree can't.
+///
+/// The slots are mapped with PricerSysAllocPages(), so they can be
+/// on huge pages too (\see SetPages).
+///
+/// The table doesn't own the orders; the parser deletes them.
+class PricerIdTable
+{
+   public:
+      PricerIdTable()
+      : fSlots(0),
+        fMask(0),
+        fCount(0),
+        fPages(kPSP_Small),
+        fWantPages(kPSP_Small),
+        fPrefault(false)
+      {
+         Rehash(kMinSlots);
+      }
+
+      ~PricerIdTable()
+      {
+         PricerSysFreePages(fSlots,(fMask + 1) * sizeof(Slot));
+      }
+
+      size_t size() const  { return fCount; }
+      bool   empty() const { return (0 == fCount); }
+
+      /// Order with id, or 0.
+      PricerOrder* Find(const PricerOrderId& id) const
+      {
+         PXUInt64 hash = PricerOrderIdHash(id);
+         for (size_t i = (size_t)hash & fMask; ; i = (i + 1) & fMask)
+         {
+            const Slot& slot = fSlots[i];
+            if (0 == slot.fOrder)
+               return 0;
+            if ((slot.fHash == hash) && (Matches(slot.fOrder,id)))
+               return slot.fOrder;
+         }
+      }
+
+      /// Adds order under its id.  If the id is already there, that
+      /// order stays and false is returned.
+      bool Insert(PricerOrder* order)
+      {
+         if ((fCount + 1) * 2 > (fMask + 1))
+            Grow();
+
+         PXUInt64 hash = PricerOrderIdHash(order->fId);
+         size_t   i    = (size_t)hash & fMask;
+         for (; 0 != fSlots[i].fOrder; i = (i + 1) & fMask)
+         {
+            if ((fSlots[i].fHash == hash) &&
+                (Matches(fSlots[i].fOrder,order->fId)))
+               return false;
+         }
+
+         fSlots[i].fHash  = hash;
+         fSlots[i].fOrder = order;
+         ++fCount;
+         return true;
+      }
+
+      /// Removes the entry for id, if any.
+      void Erase(const PricerOrderId& id)
+      {
+         PXUInt64 hash = PricerOrderIdHash(id);
+         size_t   i    = (size_t)hash & fMask;
+         for (;; i = (i + 1) & fMask)
+         {
+            if (0 == fSlots[i].fOrder)
+               return;
+            if ((fSlots[i].fHash == hash) &&
+                (Matches(fSlots[i].fOrder,id)))
+               break;
+         }
+
+         // Shift back the entries after it that would no longer be
+         // reachable across the hole, so there are no tombstones.
+         size_t hole = i;
+         for (size_t j = (i + 1) & fMask; 0 != fSlots[j].fOrder;
+              j = (j + 1) & fMask)
+         {
+            size_t home = (size_t)fSlots[j].fHash & fMask;
+            if (((j - home) & fMask) >= ((j - hole) & fMask))
+            {
+               fSlots[hole] = fSlots[j];
+               hole = j;
+            }
+         }
+         fSlots[hole].fOrder = 0;
+         --fCount;
+      }
+
+      /// Starts loading id's home slot into the cache.
+      void Prefetch(const PricerOrderId& id) const
+      {
+         xplat_prefetch(&fSlots[(size_t)PricerOrderIdHash(id) & fMask]);
+      }
+
+      /// Makes room for count entries without growing.
+      void Reserve(size_t count)
+      {
+         size_t slots = fMask + 1;
+         while (count * 2 > slots)
+            slots *= 2;
+         if (slots != fMask + 1)
+            Rehash(slots);
+      }
+
+      /// Backing for the slots from the next Reserve() or growth on.
+      void SetPages(ePricerSysPages pages, bool prefault)
+      {
+         fWantPages = pages;
+         fPrefault  = prefault;
+      }
+
+      /// Backing of the current slots.
+      ePricerSysPages GetPages() const { return fPages; }
+
+      /// Address range of the slots.
+      PricerSysRegion GetRegion() const
+      {
+         PricerSysRegion region;
+         region.fMem  = fSlots;
+         region.fSize = (fMask + 1) * sizeof(Slot);
+         return region;
+      }
+
+      /// Deletes every order in the table into pool and empties it.
+      void DeleteAll(PricerOrderPool& pool)
+      {
+         for (size_t i = 0; i <= fMask; ++i)
+         {
+            pool.Delete(fSlots[i].fOrder);
+            fSlots[i].fOrder = 0;
+         }
+         fCount = 0;
+      }
+
+   protected:
+      /// Mapped zeroed, which is free.
+      struct Slot
+      {
+         PXUInt64       fHash;
+         PricerOrder*   fOrder;   ///< 0 if the slot is free.
+      };
+
+      static const size_t kMinSlots = 1024;
+
+      /// Called once the hashes match.
+      static bool Matches(const PricerOrder* order, const PricerOrderId& id)
+      {
+         return (kPricerIdHashIsId) || (order->fId == id);
+      }
+
+      void Grow()
+      {
+         Rehash((fMask + 1) * 2);
+      }
+
+      void Rehash(size_t slots)
+      {
+         // Too small for a huge page - don't waste one.
+         size_t          bytes = slots * sizeof(Slot);
+         ePricerSysPages pages = (bytes < kPricerSysHugePage) ? kPSP_Small
+                                                              : fWantPages;
+         Slot* newSlots = (Slot*)PricerSysAllocPages(bytes,pages,fPrefault);
+         if (0 == newSlots)
+            throw std::bad_alloc();
+
+         Slot*  old     = fSlots;
+         size_t oldSize = old ? (fMask + 1) : 0;
+         fSlots = newSlots;
+         fMask  = slots - 1;
+         fPages = pages;
+
+         for (size_t i = 0; i < oldSize; ++i)
+         {
+            if (0 == old[i].fOrder)
+               continue;
+            size_t j = (size_t)old[i].fHash & fMask;
+            while (0 != fSlots[j].fOrder)
+               j = (j + 1) & fMask;
+            fSlots[j] = old[i];
+         }
+         PricerSysFreePages(old,oldSize * sizeof(Slot));
+      }
+
+      Slot*             fSlots;
+      size_t            fMask;
+      size_t            fCount;
+      ePricerSysPages   fPages;       ///< Backing of fSlots.
+      ePricerSysPages   fWantPages;   ///< Backing for the next fSlots.
+      bool              fPrefault;
+
+   private:
+      /// Not implemented.
+      PricerIdTable(const PricerIdTable&);
+      /// Not implemented.
+      PricerIdTable& operator=(const PricerIdTable&);
+};
+
+#endif // _PricerIdTable_H_
@@ -0,0 +1,102 @@
+/// \file  PricerLatency.cpp
+/// \brief Per-message latency histograms (PRICER_LATENCY_STATS builds).
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include <stdio.h>
+#include <string.h>
+#include "PricerLatency.h"
+
+/// Shortest span the tick rate is measured over.
+static const PXUInt64 kPricerCalibrateUsec = 20000;
+
+void PricerHistogram::Clear()
+{
+   memset(fCounts,0,sizeof(fCounts));
+   fCount = 0;
+   fMax   = 0;
+}
+
+PXUInt64 PricerHistogram::GetPercentile(double fraction) const
+{
+   if (0 == fCount)
+      return 0;
+
+   PXUInt64 wanted = (PXUInt64)(fraction * (double)fCount + 0.5);
+   if (wanted < 1)
+      wanted = 1;
+
+   PXUInt64 seen = 0;
+   for (int i = 0; i < kBuckets; ++i)
+   {
+      seen += fCounts[i];
+      if (seen >= wanted)
+      {
+         PXUInt64 top = BucketTop(i);
+         return (top < fMax) ? top : fMax;
+      }
+   }
+   return fMax;
+}
+
+PricerLatencyStats::PricerLatencyStats()
+: fStartTicks(xplat_ticks()),
+  fStartUsec(xplat_usec())
+{
+}
+
+double PricerLatencyStats::TicksPerNsec()
+{
+   PXUInt64 usec  = xplat_usec();
+   while (usec - fStartUsec < kPricerCalibrateUsec)
+      usec = xplat_usec();
+   PXUInt64 ticks = xplat_ticks();
+
+   return (double)(ticks - fStartTicks) / ((double)(usec - fStartUsec) * 1000.0);
+}
+
+void PricerLatencyStats::AddRow(std::string&            text,
+                                const char*             name,
+                                const PricerHistogram&  histogram,
+                                double                  ticksPerNsec)
+{
+   if (0 == histogram.GetCount())
+      return;
+
+   char buf[160];
+   sprintf(buf,"  %-10s %12llu %10.0f %10.0f %10.0f %12.0f\n",
+           name,
+           (unsigned long long)histogram.GetCount(),
+           (double)histogram.GetPercentile(0.5)   / ticksPerNsec,
+           (double)histogram.GetPercentile(0.99)  / ticksPerNsec,
+           (double)histogram.GetPercentile(0.999) / ticksPerNsec,
+           (double)histogram.GetMax()             / ticksPerNsec);
+   text += buf;
+}
+
+void PricerLatencyStats::Report(std::string& text)
+{
+   static const char* kTypeNames[kPLM_Count] =
+   {
+      "AddBuy", "AddSell", "Reduce", "Remove"
+   };
+   static const char* kPathNames[kPLP_Count] =
+   {
+      "no-change", "output", "rescan"
+   };
+
+   double ticksPerNsec = TicksPerNsec();
+
+   char buf[160];
+   sprintf(buf,"%-12s %12s %10s %10s %10s %12s\n",
+           "Latency (ns)","count","p50","p99","p99.9","max");
+   text += buf;
+
+   AddRow(text,"parse",fParse,ticksPerNsec);
+   AddRow(text,"apply",fApply,ticksPerNsec);
+   AddRow(text,"total",fTotal,ticksPerNsec);
+   AddRow(text,"write",fWrite,ticksPerNsec);
+   for (int i = 0; i < kPLM_Count; ++i)
+      AddRow(text,kTypeNames[i],fByType[i],ticksPerNsec);
+   for (int i = 0; i < kPLP_Count; ++i)
+      AddRow(text,kPathNames[i],fByPath[i],ticksPerNsec);
+}
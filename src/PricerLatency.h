@@ -0,0 +1,178 @@
+/// \file  PricerLatency.h
+/// \brief Per-message latency histograms (PRICER_LATENCY_STATS builds).
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerLatency_H_
+#define _PricerLatency_H_
+
+#include <string>
+#include "PricerDefs.h"
+
+/// \class PricerHistogram
+/// \brief Log-linear histogram of tick counts, HDR style.
+///
+/// Values below 2 * kSubCount get a bucket each; above that every
+/// power of two is split into kSubCount buckets, so any value is
+/// reported within 1 / kSubCount (about 3%) of itself.  Recording is
+/// an increment - no search, no allocation.
+class PricerHistogram
+{
+   public:
+      PricerHistogram()
+      {
+         Clear();
+      }
+
+      void Record(PXUInt64 value)
+      {
+         if (value > kMaxValue)
+            value = kMaxValue;
+         ++fCounts[Index(value)];
+         ++fCount;
+         if (value > fMax)
+            fMax = value;
+      }
+
+      void Clear();
+
+      PXUInt64 GetCount() const { return fCount; }
+      PXUInt64 GetMax() const { return fMax; }
+
+      /// Value at or below which fraction (0 to 1) of the recorded
+      /// values fall - the top of its bucket, so never understated.
+      PXUInt64 GetPercentile(double fraction) const;
+
+   protected:
+      enum
+      {
+         kSubBits    = 5,
+         kSubCount   = 1 << kSubBits,
+         kMaxBits    = 40,
+         kBuckets    = (kMaxBits - kSubBits + 1) * kSubCount
+      };
+
+      static const PXUInt64 kMaxValue = (((PXUInt64)1) << kMaxBits) - 1;
+
+      static int Index(PXUInt64 value)
+      {
+         if (value < 2 * kSubCount)
+            return (int)value;
+
+         int shift = HighBit(value) - kSubBits;
+         return (int)(value >> shift) + shift * kSubCount;
+      }
+
+      /// Largest value in bucket index.
+      static PXUInt64 BucketTop(int index)
+      {
+         if (index < 2 * kSubCount)
+            return (PXUInt64)index;
+
+         int shift = index / kSubCount - 1;
+         PXUInt64 sub = (PXUInt64)(index - shift * kSubCount);
+         return ((sub + 1) << shift) - 1;
+      }
+
+      /// Position of value's highest set bit (value > 0).
+      static int HighBit(PXUInt64 value)
+      {
+#if defined(__GNUC__)
+         return 63 - __builtin_clzll(value);
+#else
+         int bit = 0;
+         while (value >>= 1)
+            ++bit;
+         return bit;
+#endif
+      }
+
+      PXUInt64    fCounts[kBuckets];
+      PXUInt64    fCount;
+      PXUInt64    fMax;
+};
+
+/// Message kinds timed separately.
+enum ePricerLatencyMsg
+{
+   kPLM_AddBuy = 0,
+   kPLM_AddSell,
+   kPLM_Reduce,
+   kPLM_Remove,         ///< A reduce that took the whole order.
+   kPLM_Count
+};
+
+/// What applying a message took.
+enum ePricerLatencyPath
+{
+   kPLP_NoChange = 0,   ///< No new state for either book.
+   kPLP_Output,         ///< A new state was published.
+   kPLP_Rescan,         ///< FillOrder() rescanned the book.
+   kPLP_Count
+};
+
+/// \class PricerLatencyStats
+/// \brief Timings of every message, from xplat_ticks().
+///
+/// Four points per message: the start and end of its parse, and the
+/// start and end of its book update (which, with line flushing,
+/// includes writing its quote).  The book update is also kept by
+/// message type and path.  Messages read ahead in a batch are applied
+/// after the whole batch is parsed, so the total - parse start to 
+/// book updated - includes that wait.  Output writes are timed on 
+/// their own.
+class PricerLatencyStats
+{
+   public:
+      PricerLatencyStats();
+
+      void RecordMessage(ePricerLatencyMsg   type,
+                         ePricerLatencyPath  path,
+                         PXUInt64            start,
+                         PXUInt64            parsed,
+                         PXUInt64            applying,
+                         PXUInt64            applied)
+      {
+         fParse.Record(parsed - start);
+         fApply.Record(applied - applying);
+         fTotal.Record(applied - start);
+         fByType[type].Record(applied - applying);
+         fByPath[path].Record(applied - applying);
+      }
+
+      void RecordWrite(PXUInt64 ticks)
+      {
+         fWrite.Record(ticks);
+      }
+
+      /// Appends a table of counts and p50/p99/p99.9/max, in
+      /// nanoseconds, to text.
+      void Report(std::string& text);
+
+   protected:
+      /// Ticks per nanosecond, measured against xplat_usec() since
+      /// construction (waiting out at least 20ms of it).
+      double TicksPerNsec();
+
+      static void AddRow(std::string&            text,
+                         const char*             name,
+                         const PricerHistogram&  histogram,
+                         double                  ticksPerNsec);
+
+      PXUInt64          fStartTicks;
+      PXUInt64          fStartUsec;
+
+      PricerHistogram   fParse;                 ///< Parse of a message.
+      PricerHistogram   fApply;                 ///< Its book update.
+      PricerHistogram   fTotal;                 ///< Parse start to applied.
+      PricerHistogram   fWrite;                 ///< Each output write.
+      PricerHistogram   fByType[kPLM_Count];    ///< Book updates.
+      PricerHistogram   fByPath[kPLP_Count];    ///< Likewise.
+
+   private:
+      /// Not implemented.
+      PricerLatencyStats(const PricerLatencyStats&);
+      /// Not implemented.
+      PricerLatencyStats& operator=(const PricerLatencyStats&);
+};
+
+#endif // _PricerLatency_H_
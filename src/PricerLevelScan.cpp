@@ -0,0 +1,144 @@
+/// \file  PricerLevelScan.cpp
+/// \brief Vector kernels of the level scan, and picking one at run time.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include "PricerLevelScan.h"
+
+#if (PRICER_SIMD_DISPATCH > 0)
+   #include <immintrin.h>
+
+   #define PRICER_TARGET_AVX2    __attribute__((target("avx2")))
+   #define PRICER_TARGET_AVX512  __attribute__((target("avx512f")))
+
+/// AVX-512: running totals of 8 levels by three masked permutes.
+PRICER_TARGET_AVX512
+static PricerLevelScanResult PricerLevelScanAvx512(const PXInt64* levels,
+                                                   PXInt64        count,
+                                                   PXInt64        shares)
+{
+   PricerLevelScanResult result;
+   result.level     = 0;
+   result.qtyBefore = 0;
+   result.runBefore = 0;
+   PXInt64 i = 0;
+
+   const __m512i zero   = _mm512_setzero_si512();
+   const __m512i shift1 = _mm512_set_epi64(6,5,4,3,2,1,0,0);
+   const __m512i shift2 = _mm512_set_epi64(5,4,3,2,1,0,0,0);
+   const __m512i shift4 = _mm512_set_epi64(3,2,1,0,0,0,0,0);
+   const __m512i last   = _mm512_set1_epi64(7);
+   const __m512i limit  = _mm512_set1_epi64(shares - 1);
+   __m512i carry = zero;
+   __m512i runs  = zero;
+
+   for (; i + 8 <= count; i += 8)
+   {
+      // Running totals: x[k] = carry + levels[i..i+k]
+      __m512i x = _mm512_loadu_si512((const void*)(levels + i));
+      x = _mm512_add_epi64(x,_mm512_maskz_permutexvar_epi64(0xFE,shift1,x));
+      x = _mm512_add_epi64(x,_mm512_maskz_permutexvar_epi64(0xFC,shift2,x));
+      x = _mm512_add_epi64(x,_mm512_maskz_permutexvar_epi64(0xF0,shift4,x));
+      x = _mm512_add_epi64(x,carry);
+
+      if (_mm512_cmpgt_epi64_mask(x,limit))
+         break;
+
+      runs  = _mm512_add_epi64(runs,x);
+      carry = _mm512_maskz_permutexvar_epi64(0xFF,last,x);
+   }
+
+   PXInt64 carried[8];
+   PXInt64 summed[8];
+   _mm512_storeu_si512((void*)carried,carry);
+   _mm512_storeu_si512((void*)summed,runs);
+   result.qtyBefore = carried[0];
+   for (int lane = 0; lane < 8; ++lane)
+      result.runBefore += summed[lane];
+
+   // The vector loop stops on the block holding the crossing; finding
+   // the exact level in it (and any tail) is left to the scalar loop.
+   PricerLevelScanTail(levels,i,count,shares,result);
+   return result;
+}
+
+/// AVX2: running totals of 4 levels by a byte shift and a permute.
+PRICER_TARGET_AVX2
+static PricerLevelScanResult PricerLevelScanAvx2(const PXInt64* levels,
+                                                 PXInt64        count,
+                                                 PXInt64        shares)
+{
+   PricerLevelScanResult result;
+   result.level     = 0;
+   result.qtyBefore = 0;
+   result.runBefore = 0;
+   PXInt64 i = 0;
+
+   const __m256i zero  = _mm256_setzero_si256();
+   const __m256i limit = _mm256_set1_epi64x(shares - 1);
+   __m256i carry = zero;
+   __m256i runs  = zero;
+
+   for (; i + 4 <= count; i += 4)
+   {
+      // Running totals: x[k] = carry + levels[i..i+k]
+      __m256i x = _mm256_loadu_si256((const __m256i*)(levels + i));
+      x = _mm256_add_epi64(x,_mm256_slli_si256(x,8));
+      x = _mm256_add_epi64(x,_mm256_blend_epi32(zero,
+                 _mm256_permute4x64_epi64(x,_MM_SHUFFLE(1,1,0,0)),0xF0));
+      x = _mm256_add_epi64(x,carry);
+
+      __m256i over = _mm256_cmpgt_epi64(x,limit);
+      if (_mm256_movemask_pd(_mm256_castsi256_pd(over)))
+         break;
+
+      runs  = _mm256_add_epi64(runs,x);
+      carry = _mm256_permute4x64_epi64(x,_MM_SHUFFLE(3,3,3,3));
+   }
+
+   PXInt64 carried[4];
+   PXInt64 summed[4];
+   _mm256_storeu_si256((__m256i*)carried,carry);
+   _mm256_storeu_si256((__m256i*)summed,runs);
+   result.qtyBefore = carried[0];
+   result.runBefore = summed[0] + summed[1] + summed[2] + summed[3];
+
+   PricerLevelScanTail(levels,i,count,shares,result);
+   return result;
+}
+#endif // PRICER_SIMD_DISPATCH
+
+PricerLevelScanFn PricerLevelScanKernel(ePricerLevelScanKernel kernel)
+{
+#if (PRICER_SIMD_DISPATCH > 0)
+   __builtin_cpu_init();
+#endif
+
+   switch (kernel)
+   {
+      case kPLS_Scalar:
+         return PricerLevelScanScalar;
+#if (PRICER_SIMD_DISPATCH > 0)
+      case kPLS_Avx2:
+         return __builtin_cpu_supports("avx2") ? PricerLevelScanAvx2 : 0;
+      case kPLS_Avx512:
+         return __builtin_cpu_supports("avx512f") ? PricerLevelScanAvx512 : 0;
+#endif
+      default:
+         return 0;
+   }
+}
+
+/// The widest kernel this CPU runs.
+static PricerLevelScanFn PricerLevelScanBest()
+{
+   for (int kernel = kPLS_Count - 1; kernel > kPLS_Scalar; --kernel)
+   {
+      PricerLevelScanFn fn = PricerLevelScanKernel((ePricerLevelScanKernel)kernel);
+      if (fn)
+         return fn;
+   }
+   return PricerLevelScanScalar;
+}
+
+// Picked as the program (or libpricer.so) loads, before any book.
+const PricerLevelScanFn gPricerLevelScan = PricerLevelScanBest();
@@ -0,0 +1,107 @@
+/// \file  PricerLevelScan.h
+/// \brief Cumulative-depth scan over contiguous price levels.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerLevelScan_H_
+#define _PricerLevelScan_H_
+
+#include "PricerConfig.h"
+#include "PricerXplat.h"
+
+// The vector kernels are built with per-function target attributes,
+// so they're in every x86 gcc/clang build whatever its -m flags, and
+// chosen at run time by what the CPU supports.
+#if (PRICER_USE_SIMD > 0) && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+   #define PRICER_SIMD_DISPATCH 1
+#else
+   #define PRICER_SIMD_DISPATCH 0
+#endif
+
+/// Result of PricerLevelScan().
+struct PricerLevelScanResult
+{
+   PXInt64 level;       ///< First level where the running total reaches
+                        ///< shares, or count if it never does.
+   PXInt64 qtyBefore;   ///< Sum of the levels before it.
+   PXInt64 runBefore;   ///< Sum of the running totals before it.
+};
+
+/// Scan kernels.
+enum ePricerLevelScanKernel
+{
+   kPLS_Scalar = 0,
+   kPLS_Avx2,           ///< 4 levels at a time.
+   kPLS_Avx512,         ///< 8 levels at a time.
+   kPLS_Count
+};
+
+typedef PricerLevelScanResult (*PricerLevelScanFn)(const PXInt64* levels,
+                                                   PXInt64        count,
+                                                   PXInt64        shares);
+
+/// Scalar tail of PricerLevelScan(): continues from level start with
+/// the totals so far in result.
+inline void PricerLevelScanTail(const PXInt64*          levels,
+                                PXInt64                 start,
+                                PXInt64                 count,
+                                PXInt64                 shares,
+                                PricerLevelScanResult&  result)
+{
+   PXInt64 qty = result.qtyBefore;
+   PXInt64 run = result.runBefore;
+   PXInt64 i;
+   for (i = start; i < count; ++i)
+   {
+      if (qty + levels[i] >= shares)
+         break;
+      qty += levels[i];
+      run += qty;
+   }
+
+   result.level     = i;
+   result.qtyBefore = qty;
+   result.runBefore = run;
+}
+
+/// The plain C++ kernel.
+inline PricerLevelScanResult PricerLevelScanScalar(const PXInt64* levels,
+                                                   PXInt64        count,
+                                                   PXInt64        shares)
+{
+   PricerLevelScanResult result;
+   result.level     = 0;
+   result.qtyBefore = 0;
+   result.runBefore = 0;
+   PricerLevelScanTail(levels,0,count,shares,result);
+   return result;
+}
+
+/// A kernel, or 0 if this build or CPU can't run it.
+PricerLevelScanFn PricerLevelScanKernel(ePricerLevelScanKernel kernel);
+
+/// The kernel PricerLevelScan() uses: the widest this CPU runs.
+extern const PricerLevelScanFn gPricerLevelScan;
+
+/// Walks levels[0..count) summing quantity until shares is reached.
+///
+/// The notional of the levels passed over isn't summed directly: for
+/// evenly spaced prices p0 + step*i it's
+///    p0*qtyBefore + step*(level*qtyBefore - runBefore)
+/// so the scan only ever adds, and can do 4 (AVX2) or 8 (AVX-512)
+/// levels at a time - a prefix sum within the vector, a compare
+/// against shares, and a movemask to find the crossing.
+///
+/// Levels must be non-negative.
+inline PricerLevelScanResult PricerLevelScan(const PXInt64* levels,
+                                             PXInt64        count,
+                                             PXInt64        shares)
+{
+#if (PRICER_SIMD_DISPATCH > 0)
+   return gPricerLevelScan(levels,count,shares);
+#else
+   return PricerLevelScanScalar(levels,count,shares);
+#endif
+}
+
+#endif // _PricerLevelScan_H_
@@ -6,24 +6,390 @@
 #include "PricerXplat.h"
 #include "Pricer.h"
 
+/// Option help, printed after the usage line on a bad command line.
+static const char* kPricerOptionHelp =
+   "Options:\n"
+   "   --batch[=usec]      Batch quotes to pipes/sockets for up to usec\n"
+   "                       microseconds, flushing when input is idle.\n"
+   "   --batch-size=bytes  Max bytes held while batching.\n"
+   "   --io-uring          Use io_uring for input/output where available.\n"
+   "   --mmap-output       Format quotes into a mapping of the output file.\n"
+   "   --latency           Busy-poll input, flush every quote, lock memory.\n"
+   "   --cpu=n             Pin the pricing thread to CPU n.\n"
+   "   --pin=role:cpu[,role:cpu]\n"
+   "                       Pin threads to CPUs, with their memory on the\n"
+   "                       CPUs' NUMA nodes. Roles: pricer (also parser,\n"
+   "                       book and writer - all on that thread) and\n"
+   "                       reader (decompression of compressed input).\n"
+   "   --checkpoint=file   Checkpoint the books to file at the end of the\n"
+   "                       input and on SIGUSR2.\n"
+   "   --checkpoint-every=n  Also checkpoint every n messages.\n"
+   "   --restore=file      Restore a checkpoint and resume the input there.\n"
+   "   --window=start[-end]  Only output quotes for timestamps start..end.\n"
+   "   --index=file        Index checkpoints by timestamp; windows start\n"
+   "                       from the last one before them.\n"
+   "   --follow            Keep reading a growing input file (tail -F).\n"
+   "   --lazy-book         Don't sort orders far behind the marginal price\n"
+   "                       until they're needed.\n"
+   "   --coalesce          Only output the last quote of each timestamp.\n"
+   "   --filter=[B:|S:]cents[,bps[,interval]]\n"
+   "                       Only output a bid (B) or ask (S) quote, or\n"
+   "                       both, when it moves by cents or bps, and at\n"
+   "                       most once every interval timestamps.\n"
+   "   --hugepages         Keep orders and the id table on huge pages.\n"
+   "   --prealloc=n        Map and pre-fault room for n orders at startup.\n"
+   "   --shm=name          Publish the latest bid and ask to shared memory.\n"
+   "   --listen=address    Serve on unix:path or tcp:[host:]port instead\n"
+   "                       of stdin/stdout: the first connection to send\n"
+   "                       is the feed, the rest subscribe to quotes.\n"
+   "   --max-lag=bytes     Disconnect subscribers this far behind.\n"
+   "   --metrics=file      Write counters to file, in the Prometheus text\n"
+   "                       format (not with --listen).\n"
+   "   --metrics-every=s   Rewrite it every s seconds (default 10).\n"
+   "   --trace=file        Dump the flight recorder of book operations\n"
+   "                       to file (default pricer.%p.trace; %p is the\n"
+   "                       process id) on SIGQUIT - at the next\n"
+   "                       message - and at the end, and to file.error\n"
+   "                       at the first error.\n"
+   "   --trace-events=n    Events it holds (default 65536).\n"
+   "   --no-trace          Turn the flight recorder off.\n";
+
+/// Checks if arg is the option "--name" or "--name=value".
+/// On a match, value is set to the text after '=' (or 0 if none).
+static bool PricerMatchOption(const char*  arg,
+                              const char*  name,
+                              const char*& value)
+{
+   size_t nameLen = strlen(name);
+   if ((arg[0] != '-') || (arg[1] != '-'))
+      return false;
+
+   arg += 2;
+   if (0 != strncmp(arg,name,nameLen))
+      return false;
+
+   if (arg[nameLen] == 0)
+   {
+      value = 0;
+      return true;
+   }
+
+   if (arg[nameLen] == '=')
+   {
+      value = arg + nameLen + 1;
+      return true;
+   }
+   return false;
+}
+
+/// Parses "start[-end]" into a replay window.
+static bool PricerParseWindow(const char* value, PricerOptions& options)
+{
+   char* end = 0;
+   if ((0 == value) || (value[0] < '0') || (value[0] > '9'))
+      return false;
+
+   options.windowStart = (unsigned int)strtoul(value,&end,10);
+   if (*end == 0)
+      return true;
+
+   if ((*end != '-') || (end[1] < '0') || (end[1] > '9'))
+      return false;
+
+   options.windowEnd = (unsigned int)strtoul(end + 1,&end,10);
+   return (*end == 0) && (options.windowEnd >= options.windowStart);
+}
+
+/// Parses "[B:|S:]cents[,bps[,interval]]" into the bid and/or ask
+/// publication filters.
+static bool PricerParseFilter(const char* value, PricerOptions& options)
+{
+   if (0 == value)
+      return false;
+
+   bool bid = true;
+   bool ask = true;
+   if ((value[0] != 0) && (value[1] == ':'))
+   {
+      if (value[0] == 'B')
+         ask = false;
+      else if (value[0] == 'S')
+         bid = false;
+      else
+         return false;
+      value += 2;
+   }
+
+   int fields[3] = {0,0,0};
+   for (int i = 0; i < 3; ++i)
+   {
+      char* end = 0;
+      if ((value[0] < '0') || (value[0] > '9'))
+         return false;
+      fields[i] = (int)strtol(value,&end,10);
+      if (*end == 0)
+         break;
+      if ((*end != ',') || (i == 2))
+         return false;
+      value = end + 1;
+   }
+
+   PricerPublishFilter filter;
+   filter.minMoveCents = fields[0];
+   filter.minMoveBps   = fields[1];
+   filter.minInterval  = fields[2];
+   if (bid)
+      options.bidFilter = filter;
+   if (ask)
+      options.askFilter = filter;
+   return true;
+}
+
+/// True if the role (not terminated) of length roleLen is name.
+static bool PricerIsRole(const char* role, size_t roleLen, const char* name)
+{
+   return (strlen(name) == roleLen) && (0 == strncmp(role,name,roleLen));
+}
+
+/// Parses "role:cpu[,role:cpu]" into the threads' CPUs.
+/// The parser, book and writer roles are all the pricing thread, so
+/// they can't be given different CPUs.
+static bool PricerParsePin(const char* value, PricerOptions& options)
+{
+   if (0 == value)
+      return false;
+
+   for (;;)
+   {
+      const char* colon = strchr(value,':');
+      if ((0 == colon) || (colon[1] < '0') || (colon[1] > '9'))
+         return false;
+
+      char*  end     = 0;
+      int    cpu     = (int)strtol(colon + 1,&end,10);
+      size_t roleLen = (size_t)(colon - value);
+      if ((PricerIsRole(value,roleLen,"pricer")) ||
+          (PricerIsRole(value,roleLen,"parser")) ||
+          (PricerIsRole(value,roleLen,"book")) ||
+          (PricerIsRole(value,roleLen,"writer")))
+      {
+         if ((options.cpu >= 0) && (options.cpu != cpu))
+            return false;
+         options.cpu = cpu;
+      }
+      else if (PricerIsRole(value,roleLen,"reader"))
+      {
+         options.readerCpu = cpu;
+      }
+      else
+      {
+         return false;
+      }
+
+      if (*end == 0)
+         return true;
+      if (*end != ',')
+         return false;
+      value = end + 1;
+   }
+}
+
+/// Parses the command line into targetShares, options and the address
+/// to serve on (left alone without --listen).
+/// Returns false on an unknown or malformed option.
+static bool PricerParseArgs(int             argc,
+                            char**          argv,
+                            int&            targetShares,
+                            PricerOptions&  options,
+                            const char*&    listenAddress)
+{
+   for (int i = 1; i < argc; ++i)
+   {
+      const char* arg = argv[i];
+      const char* value = 0;
+
+      if (arg[0] != '-')
+      {
+         targetShares = atoi(arg);
+      }
+      else if (PricerMatchOption(arg,"batch-size",value))
+      {
+         if ((0 == value) || (0 >= (options.batchSize = atoi(value))))
+            return false;
+      }
+      else if (PricerMatchOption(arg,"batch",value))
+      {
+         options.batchLatencyUsec = value ? atoi(value)
+                                          : PRICER_BATCH_LATENCY_USEC;
+         if (options.batchLatencyUsec <= 0)
+            return false;
+      }
+      else if (PricerMatchOption(arg,"io-uring",value))
+      {
+         options.ioUring = 1;
+      }
+      else if (PricerMatchOption(arg,"mmap-output",value))
+      {
+         options.mmapOutput = 1;
+      }
+      else if (PricerMatchOption(arg,"latency",value))
+      {
+         options.latencyMode = 1;
+      }
+      else if (PricerMatchOption(arg,"cpu",value))
+      {
+         if ((0 == value) || (value[0] < '0') || (value[0] > '9'))
+            return false;
+         options.cpu = atoi(value);
+      }
+      else if (PricerMatchOption(arg,"pin",value))
+      {
+         if (!PricerParsePin(value,options))
+            return false;
+      }
+      else if (PricerMatchOption(arg,"checkpoint-every",value))
+      {
+         if ((0 == value) || (0 >= (options.checkpointInterval = atoi(value))))
+            return false;
+      }
+      else if (PricerMatchOption(arg,"checkpoint",value))
+      {
+         if ((0 == value) || (0 == value[0]))
+            return false;
+         options.checkpointFile = value;
+      }
+      else if (PricerMatchOption(arg,"restore",value))
+      {
+         if ((0 == value) || (0 == value[0]))
+            return false;
+         options.restoreFile = value;
+      }
+      else if (PricerMatchOption(arg,"follow",value))
+      {
+         options.follow = 1;
+      }
+      else if (PricerMatchOption(arg,"lazy-book",value))
+      {
+         options.lazyBook = 1;
+      }
+      else if (PricerMatchOption(arg,"coalesce",value))
+      {
+         options.coalesce = 1;
+      }
+      else if (PricerMatchOption(arg,"filter",value))
+      {
+         if (!PricerParseFilter(value,options))
+            return false;
+      }
+      else if (PricerMatchOption(arg,"hugepages",value))
+      {
+         options.hugePages = 1;
+      }
+      else if (PricerMatchOption(arg,"prealloc",value))
+      {
+         if ((0 == value) || (0 >= (options.preallocOrders = atoi(value))))
+            return false;
+      }
+      else if (PricerMatchOption(arg,"shm",value))
+      {
+         if ((0 == value) || (0 == value[0]))
+            return false;
+         options.shmName = value;
+      }
+      else if (PricerMatchOption(arg,"listen",value))
+      {
+         if ((0 == value) || (0 == value[0]))
+            return false;
+         listenAddress = value;
+      }
+      else if (PricerMatchOption(arg,"max-lag",value))
+      {
+         if ((0 == value) || (0 >= (options.serverMaxLag = atoi(value))))
+            return false;
+      }
+      else if (PricerMatchOption(arg,"metrics-every",value))
+      {
+         if ((0 == value) || (0 >= (options.metricsInterval = atoi(value))))
+            return false;
+      }
+      else if (PricerMatchOption(arg,"metrics",value))
+      {
+         if ((0 == value) || (0 == value[0]))
+            return false;
+         options.metricsFile = value;
+      }
+      else if (PricerMatchOption(arg,"trace-events",value))
+      {
+         if ((0 == value) || (0 >= (options.traceEvents = atoi(value))))
+            return false;
+      }
+      else if (PricerMatchOption(arg,"trace",value))
+      {
+         if ((0 == value) || (0 == value[0]))
+            return false;
+         options.traceFile = value;
+      }
+      else if (PricerMatchOption(arg,"no-trace",value))
+      {
+         options.traceFile = 0;
+      }
+      else if (PricerMatchOption(arg,"window",value))
+      {
+         if (!PricerParseWindow(value,options))
+            return false;
+      }
+      else if (PricerMatchOption(arg,"index",value))
+      {
+         if ((0 == value) || (0 == value[0]))
+            return false;
+         options.indexFile = value;
+      }
+      else
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
 /// main() for Pricer.
 /// One integer argument is required - targetShares.
+/// \see kPricerOptionHelp for the optional arguments.
 int main(int argc, char** argv)
 {
    int targetShares = 0;
-   
-   if (argc >= 2)
-      targetShares = atoi(argv[1]);
+   const char* listenAddress = 0;
+   PricerOptions options;
+   PricerInitOptions(&options);
+
+   if (!PricerParseArgs(argc,argv,targetShares,options,listenAddress))
+   {
+      const char* usage = PricerGetResultString(kPR_InvalidCmdLine);
+      xplat_write(xplat_fileno(stderr),usage,(unsigned int)strlen(usage));
+      xplat_write(xplat_fileno(stderr),kPricerOptionHelp,
+                  (unsigned int)strlen(kPricerOptionHelp));
+      return kPR_InvalidCmdLine;
+   }
 
 #if (PRICER_LOG_TIME > 0)
    clock_t start = clock();
 #endif
 
-   int res = Pricer(targetShares,
-                 xplat_fileno(stdin),
-                 xplat_fileno(stdout),
-                 xplat_fileno(stdout),
-                 xplat_fileno(stderr));
+   int res;
+   if (listenAddress)
+   {
+      res = PricerServe(targetShares,listenAddress,xplat_fileno(stderr),
+                        &options);
+   }
+   else
+   {
+      res = PricerEx(targetShares,
+                     xplat_fileno(stdin),
+                     xplat_fileno(stdout),
+                     xplat_fileno(stdout),
+                     xplat_fileno(stderr),
+                     &options);
+   }
 
 #if (PRICER_LOG_TIME > 0)
    float seconds = (float)(clock() - start)/(float)CLOCKS_PER_SEC;
@@ -0,0 +1,323 @@
+/// \file  PricerMetrics.cpp
+/// \brief Operational counters and their Prometheus text export.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include <stdio.h>
+#include "PricerMetrics.h"
+
+#if (PRICER_USE_METRICS > 0)
+   #include <sys/resource.h>
+   #include <sys/time.h>
+   #include <time.h>
+   #include <errno.h>
+#endif
+
+PricerMetricsExporter::PricerMetricsExporter()
+: fParser(0),
+  fPath(),
+  fInterval(0)
+#if (PRICER_USE_METRICS > 0)
+  ,fStarted(false),
+  fStopping(false),
+  fThread()
+#endif
+{
+   fBooks[0]   = fBooks[1]   = 0;
+   fOutputs[0] = fOutputs[1] = 0;
+#if (PRICER_USE_METRICS > 0)
+   pthread_mutex_init(&fLock,0);
+   pthread_cond_init(&fChanged,0);
+#endif
+}
+
+PricerMetricsExporter::~PricerMetricsExporter()
+{
+   Stop();
+#if (PRICER_USE_METRICS > 0)
+   pthread_cond_destroy(&fChanged);
+   pthread_mutex_destroy(&fLock);
+#endif
+}
+
+void PricerMetricsExporter::SetSources(const PricerParserCounters*  parser,
+                                       const PricerBookCounters*    buyBook,
+                                       const PricerBookCounters*    sellBook,
+                                       const PricerStreamCounters*  askOutput,
+                                       const PricerStreamCounters*  bidOutput)
+{
+   fParser     = parser;
+   fBooks[0]   = buyBook;
+   fBooks[1]   = sellBook;
+   fOutputs[0] = askOutput;
+   fOutputs[1] = (bidOutput != askOutput) ? bidOutput : 0;
+}
+
+bool PricerMetricsExporter::Start(const char* path, int intervalSec)
+{
+   if ((0 == path) || (0 == *path) || (!fPath.empty()))
+      return false;
+
+   fPath     = path;
+   fInterval = (intervalSec > 0) ? intervalSec : 1;
+   if (!Write())
+   {
+      fPath.clear();
+      return false;
+   }
+
+#if (PRICER_USE_METRICS > 0)
+   fStarted = (0 == pthread_create(&fThread,0,ThreadProc,this));
+#endif
+   return true;
+}
+
+void PricerMetricsExporter::Stop()
+{
+#if (PRICER_USE_METRICS > 0)
+   if (fStarted)
+   {
+      pthread_mutex_lock(&fLock);
+      fStopping = true;
+      pthread_cond_signal(&fChanged);
+      pthread_mutex_unlock(&fLock);
+      pthread_join(fThread,0);
+      fStarted = false;
+   }
+#endif
+
+   // The final counts.
+   if (!fPath.empty())
+   {
+      Write();
+      fPath.clear();
+   }
+}
+
+#if (PRICER_USE_METRICS > 0)
+void* PricerMetricsExporter::ThreadProc(void* context)
+{
+   ((PricerMetricsExporter*)context)->Run();
+   return 0;
+}
+
+void PricerMetricsExporter::Run()
+{
+   pthread_mutex_lock(&fLock);
+   while (!fStopping)
+   {
+      struct timeval  now;
+      struct timespec due;
+      gettimeofday(&now,0);
+      due.tv_sec  = now.tv_sec + fInterval;
+      due.tv_nsec = now.tv_usec * 1000;
+
+      int res = 0;
+      while ((!fStopping) && (ETIMEDOUT != res))
+         res = pthread_cond_timedwait(&fChanged,&fLock,&due);
+
+      if (!fStopping)
+      {
+         pthread_mutex_unlock(&fLock);
+         Write();
+         pthread_mutex_lock(&fLock);
+      }
+   }
+   pthread_mutex_unlock(&fLock);
+}
+#endif
+
+/// Appends "name{labels} value".
+static void PricerAddSample(std::string&  text,
+                            const char*   name,
+                            const char*   labels,
+                            PXUInt64      value)
+{
+   char buf[256];
+   sprintf(buf,"%s%s%s%s %llu\n",
+           name,
+           labels ? "{" : "",
+           labels ? labels : "",
+           labels ? "}" : "",
+           (unsigned long long)value);
+   text += buf;
+}
+
+/// Appends the HELP and TYPE lines of a metric.
+static void PricerAddHeader(std::string&  text,
+                            const char*   name,
+                            const char*   type,
+                            const char*   help)
+{
+   text += "# HELP ";
+   text += name;
+   text += " ";
+   text += help;
+   text += "\n# TYPE ";
+   text += name;
+   text += " ";
+   text += type;
+   text += "\n";
+}
+
+void PricerMetricsExporter::Format(std::string& text) const
+{
+   static const char* kMessageLabels[kPMM_Count] =
+   {
+      "type=\"add_buy\"", "type=\"add_sell\"", "type=\"reduce\"",
+      "type=\"remove\"",  "type=\"control\""
+   };
+   static const char* kBookLabels[2] =
+   {
+      "book=\"buy\"", "book=\"sell\""
+   };
+
+   char labels[64];
+
+   if (fParser)
+   {
+      PricerAddHeader(text,"pricer_messages_total","counter",
+                      "Messages applied, by type.");
+      for (int i = 0; i < kPMM_Count; ++i)
+         PricerAddSample(text,"pricer_messages_total",kMessageLabels[i],
+                         fParser->fMessages[i]);
+
+      PricerAddHeader(text,"pricer_parse_errors_total","counter",
+                      "Lines that couldn't be parsed.");
+      PricerAddSample(text,"pricer_parse_errors_total",0,
+                      fParser->fParseErrors);
+
+      PricerAddHeader(text,"pricer_id_table_orders","gauge",
+                      "Orders in the id table.");
+      PricerAddSample(text,"pricer_id_table_orders",0,fParser->fIds);
+
+      PricerAddHeader(text,"pricer_input_bytes_total","counter",
+                      "Input consumed.");
+      PricerAddSample(text,"pricer_input_bytes_total",0,
+                      fParser->fBytesRead);
+   }
+
+   PricerAddHeader(text,"pricer_orders","gauge",
+                   "Live orders in each book.");
+   for (int i = 0; i < 2; ++i)
+   {
+      if (fBooks[i])
+         PricerAddSample(text,"pricer_orders",kBookLabels[i],
+                         fBooks[i]->fOrders);
+   }
+
+   PricerAddHeader(text,"pricer_fill_scan_orders","histogram",
+                   "Orders each book rescan stepped over.");
+   for (int i = 0; i < 2; ++i)
+   {
+      const PricerBookCounters* book = fBooks[i];
+      if (0 == book)
+         continue;
+
+      // Cumulative, with le the largest scan in each bucket.
+      PXUInt64 seen = 0;
+      for (int b = 0; b < kPricerScanBuckets - 1; ++b)
+      {
+         seen += book->fFillScans[b];
+         sprintf(labels,"%s,le=\"%llu\"",kBookLabels[i],
+                 (unsigned long long)((((PXUInt64)1) << b) - 1));
+         PricerAddSample(text,"pricer_fill_scan_orders_bucket",labels,seen);
+      }
+      sprintf(labels,"%s,le=\"+Inf\"",kBookLabels[i]);
+      PricerAddSample(text,"pricer_fill_scan_orders_bucket",labels,
+                      seen + book->fFillScans[kPricerScanBuckets - 1]);
+      PricerAddSample(text,"pricer_fill_scan_orders_sum",kBookLabels[i],
+                      book->fFillSteps);
+      PricerAddSample(text,"pricer_fill_scan_orders_count",kBookLabels[i],
+                      book->fFills);
+   }
+
+   PricerAddHeader(text,"pricer_overflow_steps_total","counter",
+                   "Orders stepped back over shedding an overfilled target.");
+   for (int i = 0; i < 2; ++i)
+   {
+      if (fBooks[i])
+         PricerAddSample(text,"pricer_overflow_steps_total",kBookLabels[i],
+                         fBooks[i]->fOverflowSteps);
+   }
+
+   PricerAddHeader(text,"pricer_level_jumps_total","counter",
+                   "Rescans and sheds settled from the depth index's "
+                   "levels rather than walked.");
+   for (int i = 0; i < 2; ++i)
+   {
+      if (fBooks[i])
+         PricerAddSample(text,"pricer_level_jumps_total",kBookLabels[i],
+                         fBooks[i]->fLevelJumps);
+   }
+
+   PricerAddHeader(text,"pricer_quotes_total","counter",
+                   "New book states, published or held back by coalescing, "
+                   "filters or a replay window.");
+   for (int i = 0; i < 2; ++i)
+   {
+      const PricerBookCounters* book = fBooks[i];
+      if (0 == book)
+         continue;
+
+      // Read once each - the suppressed count is their difference.
+      PXUInt64 published = book->fPublished;
+      PXUInt64 states    = book->fStates;
+      sprintf(labels,"%s,result=\"published\"",kBookLabels[i]);
+      PricerAddSample(text,"pricer_quotes_total",labels,published);
+      sprintf(labels,"%s,result=\"suppressed\"",kBookLabels[i]);
+      PricerAddSample(text,"pricer_quotes_total",labels,
+                      (states > published) ? states - published : 0);
+   }
+
+   PXUInt64 bytes  = 0;
+   PXUInt64 writes = 0;
+   for (int i = 0; i < 2; ++i)
+   {
+      if (fOutputs[i])
+      {
+         bytes  += fOutputs[i]->fBytes;
+         writes += fOutputs[i]->fWrites;
+      }
+   }
+   PricerAddHeader(text,"pricer_output_bytes_total","counter",
+                   "Quote output written.");
+   PricerAddSample(text,"pricer_output_bytes_total",0,bytes);
+   PricerAddHeader(text,"pricer_output_writes_total","counter",
+                   "Output buffer flushes.");
+   PricerAddSample(text,"pricer_output_writes_total",0,writes);
+
+#if (PRICER_USE_METRICS > 0)
+   struct rusage usage;
+   if (0 == getrusage(RUSAGE_SELF,&usage))
+   {
+   #if defined(__APPLE__)
+      PXUInt64 peak = (PXUInt64)usage.ru_maxrss;
+   #else
+      PXUInt64 peak = (PXUInt64)usage.ru_maxrss * 1024;
+   #endif
+      PricerAddHeader(text,"pricer_peak_rss_bytes","gauge",
+                      "Peak resident memory.");
+      PricerAddSample(text,"pricer_peak_rss_bytes",0,peak);
+   }
+#endif
+}
+
+bool PricerMetricsExporter::Write() const
+{
+   std::string text;
+   Format(text);
+
+   std::string temp = fPath + ".tmp";
+   FILE* file = fopen(temp.c_str(),"wb");
+   if (0 == file)
+      return false;
+
+   bool ok = (fwrite(text.data(),1,text.size(),file) == text.size());
+   ok = (0 == fclose(file)) && ok;
+   if ((!ok) || (0 != rename(temp.c_str(),fPath.c_str())))
+   {
+      remove(temp.c_str());
+      return false;
+   }
+   return true;
+}
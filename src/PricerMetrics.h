@@ -0,0 +1,192 @@
+/// \file  PricerMetrics.h
+/// \brief Operational counters and their Prometheus text export.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerMetrics_H_
+#define _PricerMetrics_H_
+
+#include <string>
+#include "PricerDefs.h"
+
+#if !defined(_WIN32)
+   #define PRICER_USE_METRICS 1
+   #include <pthread.h>
+#else
+   #define PRICER_USE_METRICS 0
+#endif
+
+/// \class PricerCounter
+/// \brief A counter only the pricing thread updates, read by others.
+///
+/// Updates are a relaxed load and store - no locked instructions, and
+/// on x86-64 the same plain moves as a PXUInt64 - but readers on the
+/// exporter's thread are never racing a plain variable, and never see
+/// half a value on 32-bit targets.  A reader sees some recent value of
+/// each counter, not a consistent set.
+class PricerCounter
+{
+   public:
+      PricerCounter() : fValue(0) {}
+
+      PXUInt64 Get() const { return xplat_load64(&fValue); }
+
+      void Set(PXUInt64 value) { xplat_store64(&fValue,value); }
+
+      operator PXUInt64() const { return Get(); }
+
+      PricerCounter& operator=(PXUInt64 value)
+      {
+         Set(value);
+         return *this;
+      }
+
+      /// Single writer, so a load and a store - not a read-modify-write.
+      PricerCounter& operator+=(PXUInt64 amount)
+      {
+         Set(Get() + amount);
+         return *this;
+      }
+
+      PricerCounter& operator++() { return (*this += 1); }
+      PricerCounter& operator--() { return (*this += (PXUInt64)-1); }
+
+   protected:
+#if defined(__GNUC__)
+      // 32-bit targets only align 64-bit members to 4, and an atomic
+      // access mustn't straddle a cache line.
+      PXUInt64    fValue __attribute__((aligned(8)));
+#else
+      PXUInt64    fValue;
+#endif
+
+   private:
+      /// Not implemented - counters stay where their readers look.
+      PricerCounter(const PricerCounter&);
+      /// Not implemented.
+      PricerCounter& operator=(const PricerCounter&);
+};
+
+/// FillOrder() scan-length buckets: 0 orders, 1, 2-3, 4-7, ... and
+/// the last holding everything longer.
+static const int kPricerScanBuckets = 16;
+
+/// Bucket of a scan over steps orders.
+static xplat_inline int PricerScanBucket(PXUInt64 steps)
+{
+   int bucket = 0;
+   while ((steps) && (bucket < kPricerScanBuckets - 1))
+   {
+      steps >>= 1;
+      ++bucket;
+   }
+   return bucket;
+}
+
+/// Kept by each PricerBook.
+struct PricerBookCounters
+{
+   PricerCounter        fOrders;          ///< Live, sorted or deferred.
+   PricerCounter        fFills;           ///< FillOrder() scans.
+   PricerCounter        fFillSteps;       ///< Orders they stepped over.
+   PricerCounter        fFillScans[kPricerScanBuckets];
+   PricerCounter        fOverflowSteps;   ///< ShedOverflow() iterations.
+   PricerCounter        fLevelJumps;      ///< Fills/sheds settled by the index.
+   PricerCounter        fStates;          ///< New states made.
+   PricerCounter        fPublished;       ///< Quotes published of them.
+};
+
+/// Message kinds counted.
+enum ePricerMetricsMsg
+{
+   kPMM_AddBuy = 0,
+   kPMM_AddSell,
+   kPMM_Reduce,
+   kPMM_Remove,         ///< A reduce that took the whole order.
+   kPMM_Control,        ///< Target changes.
+   kPMM_Count
+};
+
+/// Kept by the PricerParser.
+struct PricerParserCounters
+{
+   PricerCounter        fMessages[kPMM_Count];
+   PricerCounter        fParseErrors;
+   PricerCounter        fIds;             ///< Orders in the id table.
+   PricerCounter        fBytesRead;       ///< Input consumed.
+};
+
+/// Kept by each PricerOutputStream.
+struct PricerStreamCounters
+{
+   PricerCounter        fBytes;           ///< Handed to write()/callbacks.
+   PricerCounter        fWrites;          ///< Buffer flushes that wrote.
+};
+
+/// \class PricerMetricsExporter
+/// \brief Writes the counters to a Prometheus text file periodically.
+///
+/// A thread of its own wakes every interval, formats whatever the
+/// counters hold into "file.tmp" and renames it over file, so a
+/// scraper (node_exporter's textfile collector, say) never sees half
+/// a file.  The pricing thread does nothing for it at all.
+class PricerMetricsExporter
+{
+   public:
+      PricerMetricsExporter();
+
+      ~PricerMetricsExporter();
+
+      /// Counters to export - set before Start().  Output streams may
+      /// be given twice if asks and bids go to one stream.
+      void SetSources(const PricerParserCounters*  parser,
+                      const PricerBookCounters*    buyBook,
+                      const PricerBookCounters*    sellBook,
+                      const PricerStreamCounters*  askOutput,
+                      const PricerStreamCounters*  bidOutput);
+
+      /// Writes path now and then every intervalSec seconds.  Without
+      /// threads (win32) it's next written by Stop().
+      ///
+      /// \return bool false if path can't be written.
+      bool Start(const char* path, int intervalSec);
+
+      /// Stops the thread, writing the file one last time.  Call
+      /// before the sources go away; destruction does if it wasn't.
+      void Stop();
+
+      /// Formats the counters in the Prometheus text format.
+      void Format(std::string& text) const;
+
+      /// Writes the file now.
+      bool Write() const;
+
+   protected:
+#if (PRICER_USE_METRICS > 0)
+      static void* ThreadProc(void* context);
+
+      /// Writes the file every fInterval seconds until stopped.
+      void Run();
+#endif
+
+      const PricerParserCounters*   fParser;
+      const PricerBookCounters*     fBooks[2];     ///< Buy, sell.
+      const PricerStreamCounters*   fOutputs[2];   ///< Ask, bid.
+      std::string                   fPath;
+      int                           fInterval;     ///< Seconds.
+
+#if (PRICER_USE_METRICS > 0)
+      bool                          fStarted;
+      bool                          fStopping;
+      pthread_t                     fThread;
+      pthread_mutex_t               fLock;
+      pthread_cond_t                fChanged;
+#endif
+
+   private:
+      /// Not implemented.
+      PricerMetricsExporter(const PricerMetricsExporter&);
+      /// Not implemented.
+      PricerMetricsExporter& operator=(const PricerMetricsExporter&);
+};
+
+#endif // _PricerMetrics_H_
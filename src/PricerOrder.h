@@ -9,6 +9,7 @@
 #include <string>
 
 #include "PricerDefs.h"
+#include "PricerArena.h"
 
 /// Holds an Order in the PricerParser / PricerBook.
 struct PricerOrder
@@ -32,27 +33,35 @@ struct PricerOrder
    
    // mutable so we can stay const, since these do not
    // affect sorting order.
-   mutable PXInt64    fNumOwned;
    mutable PXInt64    fNumShares;
    mutable PXInt64    fReduceCount;
    
    
    // Iterator into order book.
-   mutable std::multiset<PricerOrder*, PricerOrder::PricerOrderCompare_Cmp>::iterator fOrderBookIter;
+   mutable std::multiset<PricerOrder*, PricerOrder::PricerOrderCompare_Cmp,
+                         PricerPoolAllocator<PricerOrder*> >::iterator fOrderBookIter;
+
+   // Index in a lazy book's unsorted bucket, or -1 if it's in the
+   // sorted set (and fOrderBookIter is valid).
+   mutable PXInt64    fBucketIndex;
+
+   // When it went into the sorted set - orders at one price sit in
+   // the order they went in, so this says which of two is ahead.
+   mutable PXUInt64   fSortSeq;
 
    PricerOrderId      fId;
    
 
    PricerOrder(  ePricerOrderType orderType    = kPOT_None,
                  PXInt64          limitPrice     = 0,
-                 PXInt64          numShares      = 0,
-                 PXInt64          numOwned       = 0)
+                 PXInt64          numShares      = 0)
       : fType(orderType),
         fLimitPrice(limitPrice),
-        fNumOwned(numOwned),
         fNumShares(numShares),
         fReduceCount(0),
         fOrderBookIter(),
+        fBucketIndex(-1),
+        fSortSeq(0),
         fId()
    {
    }
@@ -68,11 +77,80 @@ struct PricerOrder
 };
 
 
+/// Allocator for PricerOrderSet nodes. \see PricerOrderPool
+typedef PricerPoolAllocator<PricerOrder*> PricerOrderSetAllocator;
+
 /// Ordered set of PricerOrder objects 
 /// Sorted by limitPrice depending on order type.
-typedef std::multiset<PricerOrder*,PricerOrder::PricerOrderCompare_Cmp>  PricerOrderSet;
+typedef std::multiset<PricerOrder*,
+                      PricerOrder::PricerOrderCompare_Cmp,
+                      PricerOrderSetAllocator>  PricerOrderSet;
 typedef PricerOrderSet::iterator PricerOrderSetIter;
 
+/// \class PricerOrderPool
+/// \brief Storage for a parser's PricerOrders and their set nodes.
+///
+/// Orders and PricerOrderSet nodes are carved from one PricerArena -
+/// so an order and its node usually share a page, and with SetPages()
+/// those can be huge pages - and recycled through free lists.
+class PricerOrderPool
+{
+   public:
+      PricerOrderPool()
+      : fArena(),
+        fOrders(fArena,sizeof(PricerOrder)),
+        fNodes(fArena)
+      {
+      }
+
+      PricerOrder* New(ePricerOrderType orderType = kPOT_None)
+      {
+         return new (fOrders.Alloc(sizeof(PricerOrder))) PricerOrder(orderType);
+      }
+
+      void Delete(PricerOrder* order)
+      {
+         if (0 == order)
+            return;
+         order->~PricerOrder();
+         fOrders.Free(order);
+      }
+
+      /// Allocator for the books' sets.
+      PricerOrderSetAllocator GetSetAllocator()
+      {
+         return PricerOrderSetAllocator(&fNodes);
+      }
+
+      /// Backing for memory mapped from now on. \see PricerArena
+      void SetPages(ePricerSysPages pages, bool prefault)
+      {
+         fArena.SetPages(pages,prefault);
+      }
+
+      /// Maps room for count more orders and their nodes now.
+      void Reserve(size_t count)
+      {
+         fArena.Reserve(count * (sizeof(PricerOrder) + kNodeSize));
+      }
+
+      const PricerArena& GetArena() const { return fArena; }
+
+   protected:
+      /// Size of a set node, near enough: colour, three links, value.
+      static const size_t kNodeSize = 4*sizeof(void*) + sizeof(PricerOrder*);
+
+      PricerArena    fArena;
+      PricerPool     fOrders;
+      PricerPool     fNodes;
+
+   private:
+      /// Not implemented.
+      PricerOrderPool(const PricerOrderPool&);
+      /// Not implemented.
+      PricerOrderPool& operator=(const PricerOrderPool&);
+};
+
 /// Stream parsing operator for PricerOrders.
 ///
 /// This is used for new stream types, or if you
@@ -123,6 +201,13 @@ InStream& operator>>(InStream&     inStream,
             inStream >> target.fReduceCount;
          }
          break;
+      case 'T':
+         {
+            inStream >> c;
+            inStream >> target.fNumShares;
+            target.fType = PricerGetTargetAction(c);
+         }
+         break;
       default:
          break;
    }
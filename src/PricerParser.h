@@ -5,9 +5,13 @@
 #ifndef _PricerParser_H_
 #define _PricerParser_H_
 
-#include <map>
+#include <vector>
 #include "Pricer.h"
 #include "PricerBook.h"
+#include "PricerIdTable.h"
+#include "PricerLatency.h"
+#include "PricerMetrics.h"
+#include "PricerTrace.h"
 
 /// \class PricerParser
 /// \brief Parser object to read a market log and process it.
@@ -23,15 +27,40 @@ class PricerParser
    public:
       PricerParser()
       : fTimeStamp(0),
-        fBuyToAskHandler(kPOT_Buy),
-        fSellToBidHandler(kPOT_Sell),
-        fIdOrderMap()
+        fOrderPool(),
+        fBuyToAskHandler(kPOT_Buy,fOrderPool),
+        fSellToBidHandler(kPOT_Sell,fOrderPool),
+        fResult(kPR_Success),
+        fReadOrder(0),
+        fErrStream(0),
+        fWindowStart(0),
+        fWindowEnd(0),
+        fWindowMark(kNoWindowMark),
+        fWindowState(kWS_In),
+        fCoalesce(false),
+        fRateLimited(false),
+        fReadAhead(),
+        fCounters(),
+#if (PRICER_LATENCY_STATS > 0)
+        fLatency(),
+        fLatencyType(kPOT_None),
+        fLatencyMarks(0),
+        fLatencyStart(0),
+        fLatencyRemoved(false),
+#endif
+#if (PRICER_TRACE > 0)
+        fTrace(0),
+#endif
+        fIdTable()
       {
       }
       
       ~PricerParser()
       {
          Reset();
+         fOrderPool.Delete(fReadOrder);
+         for (size_t i = 0; i < fReadAhead.size(); ++i)
+            fOrderPool.Delete(fReadAhead[i]);
       }
 
       /// Resets the books and clears out all orders.
@@ -40,13 +69,8 @@ class PricerParser
          fSellToBidHandler.Reset();
          fBuyToAskHandler.Reset();
          
-         PricerIdOrderIter iter = fIdOrderMap.begin();
-         while (iter != fIdOrderMap.end())
-         {
-            delete iter->second;
-            ++iter;
-         }   
-         fIdOrderMap.clear();
+         fIdTable.DeleteAll(fOrderPool);
+         fCounters.fIds = 0;
       }
 
       /// Processes the incoming stream and sends
@@ -65,6 +89,113 @@ class PricerParser
                                     OutStream&  outBidStream,
                                     OutStream&  outAskStream,
                                     OutStream&  errStream)
+      {
+         Start(targetShares, outBidStream, outAskStream, errStream);
+         return Run(inStream);
+      }
+
+      /// Processes inStream to the end after Start() (and possibly
+      /// LoadCheckpoint()).
+      ///
+      /// Reads up to PRICER_APPLY_BATCH messages ahead - as many as the
+      /// input already has buffered - and prefetches the id table slots
+      /// and orders they'll need, so a batch's cache misses overlap
+      /// instead of each waiting on the one before.  The messages are
+      /// still applied strictly in order, one at a time.
+      ePricerResult Run(InStream& inStream)
+      {
+         const int     kBatch = PRICER_APPLY_BATCH;
+         PXUInt32      timeStamps[kBatch];
+         ePricerResult reads[kBatch];
+
+         while (fReadAhead.size() < (size_t)kBatch)
+            fReadAhead.push_back(fOrderPool.New());
+
+#if (PRICER_LATENCY_STATS > 0)
+         PXUInt64      starts[kBatch];
+         PXUInt64      parsed[kBatch];
+#endif
+
+         for (;;)
+         {
+            PXUInt32 timeStamp = fTimeStamp;
+            int      count     = 0;
+#if (PRICER_LATENCY_STATS > 0)
+            PollLatencyReport();
+#endif
+#if (PRICER_TRACE > 0)
+            PollTraceDump();
+#endif
+            do
+            {
+#if (PRICER_LATENCY_STATS > 0)
+               starts[count] = xplat_ticks();
+#endif
+               reads[count] = ReadMessage(inStream,timeStamp,
+                                          *fReadAhead[count]);
+#if (PRICER_LATENCY_STATS > 0)
+               parsed[count] = xplat_ticks();
+#endif
+               timeStamps[count] = timeStamp;
+               ++count;
+            } while ((count < kBatch)                 && 
+                     (kPR_Exit != reads[count - 1])   &&
+                     (!inStream.IsBufferEmpty()));
+            fCounters.fBytesRead = (PXUInt64)inStream.GetOffset();
+
+            if (count > 1)
+               PrefetchReadAhead(reads,count);
+
+#if (PRICER_TRACE > 0)
+            // One cycle count for the batch - they arrived together.
+            if (fTrace)
+               fTrace->Stamp();
+#endif
+
+            for (int i = 0; i < count; ++i)
+            {
+               if (kPR_Exit == reads[i])
+               {
+                  fTimeStamp = timeStamps[i];
+                  FlushQuotes();
+                  return fResult;
+               }
+
+#if (PRICER_LATENCY_STATS > 0)
+               LatencyBegin(*fReadAhead[i]);
+#endif
+               ePricerResult result = ApplyMessage(reads[i],timeStamps[i],
+                                                   fReadAhead[i]);
+#if (PRICER_LATENCY_STATS > 0)
+               LatencyEnd(reads[i],starts[i],parsed[i]);
+#endif
+               if (kPR_Exit == result)
+               {
+                  FlushQuotes();
+                  return fResult;
+               }
+
+               // Stop on a reduce for an unknown order.
+               if (kPR_OrderNotFound == result)
+               {
+                  FlushQuotes();
+                  return kPR_InvalidData;
+               }
+            }
+         }
+      }
+
+      /// Initializes the books for a run.  ProcessNext() may be called
+      /// afterwards to feed messages in one at a time.
+      ///
+      /// \param targetShares Number of shares to track the bid/ask price for.
+      /// \param outBidStream Output stream to receive Bids
+      /// \param outAskStream Output stream to receive Asks
+      /// \param errStream    Output stream to receive errors and diagnostics
+      void Start( PXInt64     targetShares,
+                  OutStream&  outBidStream,
+                  OutStream&  outAskStream,
+                  OutStream&  errStream)
       {
          fSellToBidHandler.Init( targetShares, 
                                  outBidStream, 
@@ -74,95 +205,416 @@ class PricerParser
                                  outAskStream, 
                                  errStream);
 
-         ePricerResult result = kPR_Success;
+         fErrStream = &errStream;
+         fResult    = kPR_Success;
 
          // This is our read buffer. It is re-used on reduces/failures.
          // If we add it to our map, the map becomes the owner and 
          // we create a new one.
-         PricerOrder *readOrder = new PricerOrder();
+         if (0 == fReadOrder)
+            fReadOrder = fOrderPool.New();
+      }
 
-         for (;;)
+      /// Reads and applies the next message from inStream.
+      ///
+      /// \return kPR_Exit at the end of the stream, kPR_OrderNotFound
+      ///         if a reduce named an unknown order, otherwise the 
+      ///         current result (errors stay set until a message 
+      ///         is processed successfully).
+      ePricerResult ProcessNext(InStream& inStream)
+      {
+#if (PRICER_LATENCY_STATS > 0)
+         PollLatencyReport();
+         PXUInt64      start     = xplat_ticks();
+#endif
+#if (PRICER_TRACE > 0)
+         PollTraceDump();
+#endif
+         PXUInt32      timeStamp = fTimeStamp;
+         ePricerResult read      = ReadMessage(inStream,timeStamp,*fReadOrder);
+         fCounters.fBytesRead    = (PXUInt64)inStream.GetOffset();
+         if (kPR_Exit == read)
          {
-            inStream >> fTimeStamp;
-            if (!inStream.fail())
-               inStream >> (*readOrder);
-            
-            if (inStream.bad()  || 
-                inStream.fail() || 
-                (kPOT_None == (readOrder->fType)))
-            {
-               if (inStream.eof())
-                  break;
+            fTimeStamp = timeStamp;
+            return kPR_Exit;
+         }
+#if (PRICER_TRACE > 0)
+         if (fTrace)
+            fTrace->Stamp();
+#endif
+#if (PRICER_LATENCY_STATS > 0)
+         PXUInt64      parsed    = xplat_ticks();
+         LatencyBegin(*fReadOrder);
+         ePricerResult result    = ApplyMessage(read,timeStamp,fReadOrder);
+         LatencyEnd(read,start,parsed);
+         return result;
+#else
+         return ApplyMessage(read,timeStamp,fReadOrder);
+#endif
+      }
 
-               inStream.clear();
-               // skip to next valid line.
-               inStream.ignore(512,'\n');
+      /// Restricts output to messages timestamped [start, end].
+      /// Earlier messages update the books quietly, with no quotes
+      /// formatted; the first message at or after start publishes both
+      /// books' current state (stamped start) before it is applied.
+      /// Processing stops (kPR_Exit) at the first message after end.
+      /// Call after Start().
+      void SetWindow(PXUInt32 start, PXUInt32 end)
+      {
+         fWindowStart = start;
+         fWindowEnd   = end;
 
-               // only spew one error until we get out of an error condition.
-               if (result != kPR_ParserError)
-               {
-                  result = kPR_ParserError;
-                  PricerOutputError(kPR_ParserError, errStream);
-               }
-               continue;
-            }
-            
-            switch ((readOrder->fType))
-            {
-               case kPOT_AddBuy:
-               case kPOT_AddSell:
-                  {
-                     // Saving it to the map - allocate a new read buffer.
-                     fIdOrderMap.insert(PricerIdOrderPair(&readOrder->fId,
-                                                           readOrder));
-                     result = Dispatch(readOrder);
+         bool before  = (start > 0);
+         fWindowState = before ? kWS_Before : kWS_In;
+         fWindowMark  = before ? start : (PXUInt64)end + 1;
+         fBuyToAskHandler.SetQuiet(before);
+         fSellToBidHandler.SetQuiet(before);
+      }
 
-                     readOrder = new PricerOrder();
-                  }
-                  break;
-               case kPOT_Reduce:
-                  {
-                     // Find the order by ID, determine if it's fully reduced,
-                     // then notify PricerBook and remove if needed.
-                     PricerIdOrderIter iter = fIdOrderMap.find(&readOrder->fId);
-                     if (iter == fIdOrderMap.end())
-                        return kPR_InvalidData;
-
-                     PricerOrder* reduceOrder = iter->second;
-
-                     if (reduceOrder->fNumShares <= readOrder->fReduceCount)
-                     {
-                        if (reduceOrder->fNumShares < readOrder->fReduceCount)
-                           PricerOutputError(kPR_ReduceOutOfRange, errStream);
-
-                        reduceOrder->SetReduceInfo(kPOT_Remove,
-                                                   readOrder->fReduceCount);
-
-                        result = Dispatch(reduceOrder);
-
-                        fIdOrderMap.erase(iter);
-
-                        delete reduceOrder;
-                     }
-                     else
-                     {
-                        reduceOrder->SetReduceInfo(kPOT_Reduce,
-                                                   readOrder->fReduceCount);
-                        
-                        result = Dispatch(reduceOrder);
-                     }
-                  }
-                  break;
-               default:
-               case kPOT_Exit:
-                  result = kPR_InvalidData;
-                  break;
-            }
-            if (PRICERERR(result))
-               PricerOutputError(result,errStream);
+      /// True once a message past the window end has been read - it 
+      /// hasn't been applied, so the input offset is past the state.
+      bool IsPastWindow() const { return (kWS_After == fWindowState); }
+
+      /// Timestamp of the last message read.
+      PXUInt32 GetTimeStamp() const { return fTimeStamp; }
+
+      /// Publishes only the last quote of each timestamp from here on,
+      /// or (false) goes back to publishing every change.
+      void SetCoalesce(bool coalesce)
+      {
+         fCoalesce = coalesce;
+         fBuyToAskHandler.SetCoalesce(coalesce);
+         fSellToBidHandler.SetCoalesce(coalesce);
+      }
+
+      /// Maps order storage and the id table on huge pages if asked 
+      /// (reserved ones if there are any, transparent ones if not),
+      /// and maps and pre-faults room for preallocOrders orders now so
+      /// the first messages don't stall on page faults.  Call before 
+      /// feeding messages.  \see ReportMemory
+      void SetMemory(bool hugePages, PXInt64 preallocOrders)
+      {
+         ePricerSysPages pages    = hugePages ? kPSP_Explicit : kPSP_Small;
+         bool            prefault = (preallocOrders > 0);
+         fOrderPool.SetPages(pages,prefault);
+         fIdTable.SetPages(pages,prefault);
+
+         if (preallocOrders > 0)
+         {
+            fOrderPool.Reserve((size_t)preallocOrders);
+            fIdTable.Reserve((size_t)preallocOrders);
          }
-         delete readOrder;
-         return result;
+      }
+
+      /// Writes how much order storage and id table is mapped, on what
+      /// pages, and how much of it is resident and on huge pages.
+      void ReportMemory(OutStream& errStream) const
+      {
+         const PricerArena&   arena = fOrderPool.GetArena();
+         PricerSysRegion      ids   = fIdTable.GetRegion();
+
+         std::vector<PricerSysRegion> regions;
+         arena.GetRegions(regions);
+         regions.push_back(ids);
+
+         char buf[256];
+         int  len = sprintf(buf,"Memory: orders %llu MB (%s), ids %llu MB (%s)",
+                            (unsigned long long)(arena.GetMapped() >> 20),
+                            PricerPagesName(arena.GetPages()),
+                            (unsigned long long)(ids.fSize >> 20),
+                            PricerPagesName(fIdTable.GetPages()));
+
+         PXUInt64 resident = 0;
+         PXUInt64 huge     = 0;
+         if (PricerSysPageMix(&regions[0],regions.size(),resident,huge))
+         {
+            sprintf(buf + len,"; %llu MB resident, %llu MB on huge pages",
+                    (unsigned long long)(resident >> 20),
+                    (unsigned long long)(huge >> 20));
+         }
+         errStream << buf << "\n";
+      }
+
+      /// Sets the publication filters for the bid ('B') and ask ('S')
+      /// quotes. \see PricerFilterSink
+      void SetPublishFilters(const PricerPublishFilter& bidFilter,
+                             const PricerPublishFilter& askFilter)
+      {
+         fSellToBidHandler.SetPublishFilter(bidFilter);
+         fBuyToAskHandler.SetPublishFilter(askFilter);
+         fRateLimited = (bidFilter.minInterval > 0) || 
+                        (askFilter.minInterval > 0);
+      }
+
+      /// Publishes every quote held back by coalescing or rate limits
+      /// - call at the end of the input.
+      void FlushQuotes()
+      {
+         fBuyToAskHandler.FlushHeld(fTimeStamp);
+         fSellToBidHandler.FlushHeld(fTimeStamp);
+      }
+
+      /// Changes the target on both books mid-stream, publishing any
+      /// quote that changes (stamped with the last message's time).
+      ePricerResult SetTargetShares(PXInt64 targetShares)
+      {
+         if (targetShares <= 0)
+            return kPR_InvalidData;
+
+         fBuyToAskHandler.SetTargetShares(targetShares,fTimeStamp);
+         fSellToBidHandler.SetTargetShares(targetShares,fTimeStamp);
+         return kPR_Success;
+      }
+
+      /// Publishes quotes for another target size as well, starting
+      /// with both books' current state for it.
+      ePricerResult AddTarget(PXInt64 targetShares)
+      {
+         if (targetShares <= 0)
+            return kPR_InvalidData;
+
+         fBuyToAskHandler.AddExtraTarget(targetShares,fTimeStamp);
+         fSellToBidHandler.AddExtraTarget(targetShares,fTimeStamp);
+         return kPR_Success;
+      }
+
+      /// Stops publishing a target added with AddTarget().
+      ePricerResult RemoveTarget(PXInt64 targetShares)
+      {
+         if (!fBuyToAskHandler.RemoveExtraTarget(targetShares))
+            return kPR_InvalidData;
+
+         fSellToBidHandler.RemoveExtraTarget(targetShares);
+         return kPR_Success;
+      }
+
+      /// Keeps depth indexes on both books for QueryCost().
+      void EnableDepthIndex()
+      {
+         fBuyToAskHandler.EnableDepthIndex();
+         fSellToBidHandler.EnableDepthIndex();
+      }
+
+      /// Lets both books defer sorting orders far from the marginal
+      /// price. \see PricerBook::SetLazy
+      void SetLazyBooks(bool lazy)
+      {
+         fBuyToAskHandler.SetLazy(lazy);
+         fSellToBidHandler.SetLazy(lazy);
+      }
+
+      /// Prices shares against one side of the market.
+      ///
+      /// \param side           'S' to price selling shares to the buy
+      ///                       orders, 'B' to price buying them from the
+      ///                       sell orders - as in the quote output.
+      /// \param shares         Number of shares.
+      /// \param totalPrice     On success, their total price.
+      /// \param marginalPrice  On success, price of the last share.
+      ///
+      /// \return bool false if that side doesn't hold that many.
+      bool QueryCost(char      side,
+                     PXInt64   shares,
+                     PXInt64&  totalPrice,
+                     PXInt64&  marginalPrice)
+      {
+         if ('S' == side)
+            return fBuyToAskHandler.QueryCost(shares,totalPrice,marginalPrice);
+         if ('B' == side)
+            return fSellToBidHandler.QueryCost(shares,totalPrice,marginalPrice);
+         return false;
+      }
+
+      /// Fills snapshot with both books as they stand now.
+      void GetSnapshot(PricerSnapshot& snapshot)
+      {
+         snapshot.fTimeStamp = fTimeStamp;
+         fSellToBidHandler.GetLevels(snapshot.GetLevels('B'));
+         fBuyToAskHandler.GetLevels(snapshot.GetLevels('S'));
+      }
+
+#if (PRICER_LATENCY_STATS > 0)
+      /// Writes the latency histograms so far. \see PricerLatencyStats
+      void ReportLatency(OutStream& errStream)
+      {
+         std::string text;
+         fLatency.Report(text);
+         errStream << text.c_str();
+      }
+
+      /// Times writes to stream too.
+      void TimeWrites(OutStream& stream)
+      {
+         stream.SetLatencyStats(&fLatency);
+      }
+#endif
+
+      /// Result of the last message processed.
+      ePricerResult GetResult() const { return fResult; }
+
+      /// Writes the complete parser state to a checkpoint file, to be
+      /// picked up by LoadCheckpoint() on restart.
+      ///
+      /// \param path         File to write. It's replaced atomically.
+      /// \param inputOffset  Input position to resume from - the end
+      ///                     of the last message processed.
+      ///
+      /// \return bool true on success.
+      bool SaveCheckpoint(const char* path, PXInt64 inputOffset)
+      {
+         PricerCheckpointFile file;
+         if (!file.OpenWrite(path))
+            return false;
+
+         PXUInt32 idFormat     = kIdFormat;
+         PXInt64  targetShares = fBuyToAskHandler.GetTargetShares();
+         PXInt32  result       = fResult;
+         file.Put(kPricerCheckpointMagic);
+         file.Put(kPricerCheckpointVersion);
+         file.Put(idFormat);
+         file.Put(targetShares);
+         file.Put(inputOffset);
+         file.Put(fTimeStamp);
+         file.Put(result);
+
+         PricerIsIndexed isIndexed(fIdTable);
+         fBuyToAskHandler.Save(file,isIndexed);
+         fSellToBidHandler.Save(file,isIndexed);
+
+         file.Put(kPricerCheckpointMagic);
+         return file.Close();
+      }
+
+      /// Restores the state written by SaveCheckpoint().  Call after 
+      /// Start(), before any messages.  If Start() was given another
+      /// target than the checkpoint's, the books move to it from the
+      /// restored allocation, without publishing.
+      ///
+      /// The books are rebuilt in order and the id table filled once
+      /// sized for them, so this is linear in the number of orders 
+      /// rather than replaying the log.
+      ///
+      /// \param path         Checkpoint file to read.
+      /// \param inputOffset  On success, the input position to resume
+      ///                     reading from.
+      ///
+      /// \return bool true on success.  On failure nothing is loaded.
+      bool LoadCheckpoint(const char* path, PXInt64& inputOffset)
+      {
+         if (!fIdTable.empty())
+            return false;
+
+         PricerCheckpointFile file;
+         if (!file.OpenRead(path))
+            return false;
+
+         PXUInt32 magic        = 0;
+         PXUInt32 version      = 0;
+         PXUInt32 idFormat     = 0;
+         PXInt64  targetShares = 0;
+         PXInt64  offset       = 0;
+         PXUInt32 timeStamp    = 0;
+         PXInt32  result       = 0;
+         file.Get(magic);
+         file.Get(version);
+         file.Get(idFormat);
+         file.Get(targetShares);
+         file.Get(offset);
+         file.Get(timeStamp);
+         file.Get(result);
+
+         if ((file.Failed())                          ||
+             (magic    != kPricerCheckpointMagic)     ||
+             (version  != kPricerCheckpointVersion)   ||
+             (idFormat != kIdFormat)                  ||
+             (targetShares <= 0))
+         {
+            return false;
+         }
+
+         PXInt64 wantedShares = fBuyToAskHandler.GetTargetShares();
+         std::vector<PricerOrder*> indexed;
+         if (!fBuyToAskHandler.Load(file,targetShares,indexed))
+         {
+            fBuyToAskHandler.SetTargetShares(wantedShares,0);
+            return false;
+         }
+
+         bool loaded = fSellToBidHandler.Load(file,targetShares,indexed);
+         magic = 0;
+         file.Get(magic);
+         if ((!loaded) || (file.Failed()) || (magic != kPricerCheckpointMagic))
+         {
+            fBuyToAskHandler.DeleteOrders();
+            fSellToBidHandler.DeleteOrders();
+            fBuyToAskHandler.SetTargetShares(wantedShares,0);
+            fSellToBidHandler.SetTargetShares(wantedShares,0);
+            return false;
+         }
+
+         fIdTable.Reserve(indexed.size());
+         for (size_t i = 0; i < indexed.size(); ++i)
+            fIdTable.Insert(indexed[i]);
+         fCounters.fIds = fIdTable.size();
+
+         fTimeStamp  = timeStamp;
+         fResult     = (ePricerResult)result;
+         inputOffset = offset;
+
+         if (wantedShares != targetShares)
+         {
+            bool askQuiet = fBuyToAskHandler.IsQuiet();
+            bool bidQuiet = fSellToBidHandler.IsQuiet();
+            fBuyToAskHandler.SetQuiet(true);
+            fSellToBidHandler.SetQuiet(true);
+            SetTargetShares(wantedShares);
+            fBuyToAskHandler.SetQuiet(askQuiet);
+            fSellToBidHandler.SetQuiet(bidQuiet);
+         }
+         return true;
+      }
+
+      /// Operational counters, for a PricerMetricsExporter.
+      const PricerParserCounters& GetCounters() const { return fCounters; }
+
+#if (PRICER_TRACE > 0)
+      /// Logs every message, and what the books do with it, to ring.
+      /// It's dumped on SIGQUIT (if watched) and at the first error.
+      /// Pass 0 to stop.
+      void SetTrace(PricerTraceRing* ring)
+      {
+         fTrace = ring;
+         fBuyToAskHandler.SetTrace(ring);
+         fSellToBidHandler.SetTrace(ring);
+      }
+#endif
+
+      /// Counters of the book of buy orders (which publishes asks).
+      const PricerBookCounters& GetBuyCounters() const
+      {
+         return fBuyToAskHandler.GetCounters();
+      }
+
+      /// Counters of the book of sell orders (which publishes bids).
+      const PricerBookCounters& GetSellCounters() const
+      {
+         return fSellToBidHandler.GetCounters();
+      }
+
+      /// Sends quotes from both books to sink instead of formatting
+      /// them to the output streams. Pass 0 to go back to text output.
+      void SetQuoteSink(PricerQuoteSink* sink)
+      {
+         fBuyToAskHandler.SetSink(sink);
+         fSellToBidHandler.SetSink(sink);
+      }
+
+      /// Also sends every new state of both books to sink, whatever 
+      /// is published. \see PricerBook::SetStateSink
+      void SetStateSink(PricerQuoteSink* sink)
+      {
+         fBuyToAskHandler.SetStateSink(sink);
+         fSellToBidHandler.SetStateSink(sink);
       }
 
       /// Dispatches a parsed order to the appropriate handler.
@@ -199,6 +651,29 @@ class PricerParser
          return result;
       }
 
+      /// Moves through the window edge at fWindowMark.
+      /// Returns false once past the end of the window.
+      bool CrossWindowMark()
+      {
+         if (kWS_Before == fWindowState)
+         {
+            fWindowState = kWS_In;
+            fWindowMark  = (PXUInt64)fWindowEnd + 1;
+            fBuyToAskHandler.SetQuiet(false);
+            fSellToBidHandler.SetQuiet(false);
+            fBuyToAskHandler.OutputAllStates(fWindowStart);
+            fSellToBidHandler.OutputAllStates(fWindowStart);
+
+            if (fTimeStamp < fWindowMark)
+               return true;
+         }
+
+         // Everything from here on is past it.
+         fWindowState = kWS_After;
+         fWindowMark  = 0;
+         return false;
+      }
+
       /// Dump an error or status string to errStream
       static void PricerOutputError(int result, OutStream& errStream)
       {
@@ -208,27 +683,404 @@ class PricerParser
    protected:
       PXUInt32                                    fTimeStamp;
 
+      /// Reads the next message into order and its timestamp into
+      /// timeStamp, without applying it.
+      ///
+      /// \return kPR_Success, kPR_Exit at the end of the stream, or
+      ///         kPR_ParserError if the line couldn't be read (and was 
+      ///         skipped).
+      ePricerResult ReadMessage(InStream&    inStream,
+                                PXUInt32&    timeStamp,
+                                PricerOrder& order)
+      {
+         inStream >> timeStamp;
+         if (!inStream.fail())
+            inStream >> order;
+         
+         if (inStream.bad()  || 
+             inStream.fail() || 
+             (kPOT_None == (order.fType)))
+         {
+            if (inStream.eof())
+               return kPR_Exit;
+
+            inStream.clear();
+            // skip to next valid line.
+            inStream.ignore(512,'\n');
+            return kPR_ParserError;
+         }
+         return kPR_Success;
+      }
+
+      /// Applies a message read by ReadMessage().  If it's an add, the
+      /// order is kept (by fIdTable) and a new read buffer left in 
+      /// order.
+      ///
+      /// \return As ProcessNext().
+      ePricerResult ApplyMessage(ePricerResult   read,
+                                 PXUInt32        timeStamp,
+                                 PricerOrder*&   order)
+      {
+         OutStream&   errStream = *fErrStream;
+         PXUInt32     lastTime  = fTimeStamp;
+         fTimeStamp = timeStamp;
+
+#if (PRICER_TRACE > 0)
+         if ((fTrace) && (fTimeStamp != lastTime))
+            fTrace->Record(kPTE_Time,0,0,fTimeStamp,0);
+#endif
+
+         if (kPR_ParserError == read)
+         {
+            ++fCounters.fParseErrors;
+            TraceError(kPR_ParserError,0);
+
+            // only spew one error until we get out of an error condition.
+            if (fResult != kPR_ParserError)
+            {
+               fResult = kPR_ParserError;
+               PricerOutputError(kPR_ParserError, errStream);
+            }
+            return fResult;
+         }
+
+         // Replay window edges - never hit without a window.
+         if ((fTimeStamp >= fWindowMark) && (!CrossWindowMark()))
+            return kPR_Exit;
+
+         // Last timestamp is over - publish its final quotes, and any
+         // rate-limited ones now due.
+         if (((fCoalesce) || (fRateLimited)) && (fTimeStamp != lastTime))
+         {
+            fBuyToAskHandler.ReleaseHeld(fTimeStamp);
+            fSellToBidHandler.ReleaseHeld(fTimeStamp);
+         }
+         
+         switch ((order->fType))
+         {
+            case kPOT_AddBuy:
+            case kPOT_AddSell:
+               {
+                  ++fCounters.fMessages[(kPOT_AddBuy == order->fType) ?
+                                        kPMM_AddBuy : kPMM_AddSell];
+                  Trace(kPTE_Add,TraceSide(*order),PricerTraceId(order->fId),
+                        order->fLimitPrice,order->fNumShares);
+
+                  // Saving it to the map - allocate a new read buffer.
+                  fIdTable.Insert(order);
+                  fCounters.fIds = fIdTable.size();
+                  fResult = Dispatch(order);
+
+                  order = fOrderPool.New();
+               }
+               break;
+            case kPOT_Reduce:
+               {
+                  // Find the order by ID, determine if it's fully reduced,
+                  // then notify PricerBook and remove if needed.
+                  PricerOrder* reduceOrder = fIdTable.Find(order->fId);
+                  if (0 == reduceOrder)
+                  {
+                     fResult = kPR_InvalidData;
+                     TraceError(kPR_OrderNotFound,PricerTraceId(order->fId));
+                     return kPR_OrderNotFound;
+                  }
+
+                  Trace((reduceOrder->fNumShares <= order->fReduceCount) ?
+                           kPTE_Remove : kPTE_Reduce,
+                        TraceSide(*reduceOrder),PricerTraceId(order->fId),
+                        0,order->fReduceCount);
+
+                  if (reduceOrder->fNumShares <= order->fReduceCount)
+                  {
+                     if (reduceOrder->fNumShares < order->fReduceCount)
+                        PricerOutputError(kPR_ReduceOutOfRange, errStream);
+
+                     reduceOrder->SetReduceInfo(kPOT_Remove,
+                                                order->fReduceCount);
+#if (PRICER_LATENCY_STATS > 0)
+                     fLatencyRemoved = true;
+#endif
+
+                     fResult = Dispatch(reduceOrder);
+
+                     fIdTable.Erase(reduceOrder->fId);
+                     fCounters.fIds = fIdTable.size();
+                     ++fCounters.fMessages[kPMM_Remove];
+
+                     fOrderPool.Delete(reduceOrder);
+                  }
+                  else
+                  {
+                     reduceOrder->SetReduceInfo(kPOT_Reduce,
+                                                order->fReduceCount);
+                     
+                     fResult = Dispatch(reduceOrder);
+                     ++fCounters.fMessages[kPMM_Reduce];
+                  }
+               }
+               break;
+            case kPOT_SetTarget:
+               ++fCounters.fMessages[kPMM_Control];
+               Trace(kPTE_Target,0,0,0,order->fNumShares,kPTT_Set);
+               fResult = SetTargetShares(order->fNumShares);
+               break;
+            case kPOT_AddTarget:
+               ++fCounters.fMessages[kPMM_Control];
+               Trace(kPTE_Target,0,0,0,order->fNumShares,kPTT_Add);
+               fResult = AddTarget(order->fNumShares);
+               break;
+            case kPOT_RemoveTarget:
+               ++fCounters.fMessages[kPMM_Control];
+               Trace(kPTE_Target,0,0,0,order->fNumShares,kPTT_Remove);
+               fResult = RemoveTarget(order->fNumShares);
+               break;
+            default:
+            case kPOT_Exit:
+               fResult = kPR_InvalidData;
+               break;
+         }
+         if (PRICERERR(fResult))
+         {
+            TraceError(fResult,0);
+            PricerOutputError(fResult,errStream);
+         }
+
+         return fResult;
+      }
+
+      /// Records a message event if tracing.
+      void Trace(ePricerTraceEvent  type,
+                 char               side,
+                 PXUInt64           id,
+                 PXInt64            value,
+                 PXInt64            shares,
+                 PXUInt16           flags = 0)
+      {
+#if (PRICER_TRACE > 0)
+         if (fTrace)
+            fTrace->Record(type,side,id,value,shares,flags);
+#else
+         (void)type;
+         (void)side;
+         (void)id;
+         (void)value;
+         (void)shares;
+         (void)flags;
+#endif
+      }
+
+      /// Records a failed message and dumps the trace if it's the 
+      /// first.
+      void TraceError(ePricerResult result, PXUInt64 id)
+      {
+#if (PRICER_TRACE > 0)
+         if (fTrace)
+         {
+            fTrace->Record(kPTE_Error,0,id,result,0);
+            fTrace->DumpError();
+         }
+#else
+         (void)result;
+         (void)id;
+#endif
+      }
+
+      /// Side of order in trace events.
+      static char TraceSide(const PricerOrder& order)
+      {
+         return (order.fType & kPOT_Buy) ? 'B' : 'S';
+      }
+
+#if (PRICER_TRACE > 0)
+      /// Dumps the trace if SIGQUIT came in (and is being watched).
+      void PollTraceDump()
+      {
+         if ((fTrace) && (PricerSysTakeSignal(kPSS_Dump)))
+            fTrace->Dump();
+      }
+#endif
+
+#if (PRICER_LATENCY_STATS > 0)
+      /// Reports the latency histograms if SIGUSR1 came in (and is
+      /// being watched).
+      void PollLatencyReport()
+      {
+         if ((fErrStream) && (PricerSysTakeSignal(kPSS_Stats)))
+         {
+            ReportLatency(*fErrStream);
+            fErrStream->Flush();
+         }
+      }
+
+      /// Notes what the books have done before order is applied.
+      void LatencyBegin(const PricerOrder& order)
+      {
+         fLatencyType    = order.fType;
+         fLatencyRemoved = false;
+         fLatencyMarks   = LatencyMarks();
+         fLatencyStart   = xplat_ticks();
+      }
+
+      /// Records the message LatencyBegin() saw, by what it turned out
+      /// to be and what the books did with it.
+      void LatencyEnd(ePricerResult read, PXUInt64 start, PXUInt64 parsed)
+      {
+         PXUInt64 applied = xplat_ticks();
+         if (kPR_Success != read)
+            return;
+
+         ePricerLatencyMsg type;
+         switch (fLatencyType)
+         {
+            case kPOT_AddBuy:    type = kPLM_AddBuy;     break;
+            case kPOT_AddSell:   type = kPLM_AddSell;    break;
+            case kPOT_Reduce:
+               type = fLatencyRemoved ? kPLM_Remove : kPLM_Reduce;
+               break;
+            default:
+               return;
+         }
+
+         PXUInt64 marks = LatencyMarks();
+         ePricerLatencyPath path = kPLP_NoChange;
+         if ((marks >> 32) != (fLatencyMarks >> 32))
+            path = kPLP_Rescan;
+         else if (marks != fLatencyMarks)
+            path = kPLP_Output;
+
+         fLatency.RecordMessage(type,path,start,parsed,fLatencyStart,applied);
+      }
+
+      /// Both books' FillOrder() calls (high half) and states output
+      /// (low half), for telling which path a message took.
+      PXUInt64 LatencyMarks() const
+      {
+         PXUInt32 fills   = fBuyToAskHandler.GetFills() +
+                            fSellToBidHandler.GetFills();
+         PXUInt32 outputs = fBuyToAskHandler.GetOutputs() +
+                            fSellToBidHandler.GetOutputs();
+         return ((PXUInt64)fills << 32) | outputs;
+      }
+#endif
+
+      /// Name of a page backing for ReportMemory().
+      static const char* PricerPagesName(ePricerSysPages pages)
+      {
+         switch (pages)
+         {
+            case kPSP_Explicit:     return "huge pages";
+            case kPSP_Transparent:  return "transparent huge pages";
+            default:                return "small pages";
+         }
+      }
+
+      /// Prefetches what the first count read-ahead messages will
+      /// touch: the id table slots of adds and reduces, then - with 
+      /// those mostly loaded - the orders the reduces name.  Only a 
+      /// hint; the messages still look everything up as they're applied.
+      void PrefetchReadAhead(const ePricerResult* reads, int count)
+      {
+         for (int i = 0; i < count; ++i)
+         {
+            const PricerOrder* order = fReadAhead[i];
+            if ((kPR_Success == reads[i]) &&
+                (order->fType & (kPOT_Add | kPOT_Reduce)))
+            {
+               fIdTable.Prefetch(order->fId);
+            }
+         }
+
+         for (int i = 0; i < count; ++i)
+         {
+            const PricerOrder* order = fReadAhead[i];
+            if ((kPR_Success == reads[i]) && (kPOT_Reduce == order->fType))
+            {
+               PricerOrder* reduceOrder = fIdTable.Find(order->fId);
+               if (reduceOrder)
+                  xplat_prefetch(reduceOrder);
+            }
+         }
+      }
+
+      /// Storage for every order, and the books' set nodes.
+      PricerOrderPool            fOrderPool;
+
       /// Processes Buy entries and outputs Asks
       PricerBook< OutStream >    fBuyToAskHandler;
 
       /// Processes Sell entries and outputs Bids
       PricerBook< OutStream >    fSellToBidHandler;
 
+      /// Result of the last message (sticky for parser errors).
+      ePricerResult              fResult;
+
+      /// Read buffer for the next message.
+      PricerOrder*               fReadOrder;
+
+      OutStream*                 fErrStream;
+
+      enum eWindowState
+      {
+         kWS_Before,    ///< Quiet, catching up to the window.
+         kWS_In,        ///< Publishing (the default, with no window).
+         kWS_After      ///< Done.
+      };
+
+      /// fWindowMark when there's no window - past any timestamp.
+      static const PXUInt64 kNoWindowMark = ((PXUInt64)1) << 32;
+
+      PXUInt32                   fWindowStart;
+      PXUInt32                   fWindowEnd;
+      PXUInt64                   fWindowMark;    ///< Timestamp of next edge.
+      eWindowState               fWindowState;
+
+      bool                       fCoalesce;      ///< Last quote per time.
+      bool                       fRateLimited;   ///< Filters hold quotes.
+
+      /// Read buffers for the messages Run() reads ahead.
+      std::vector<PricerOrder*>  fReadAhead;
+
+      PricerParserCounters       fCounters;
+
+#if (PRICER_LATENCY_STATS > 0)
+      PricerLatencyStats         fLatency;
+      PXUInt32                   fLatencyType;     ///< Type being applied.
+      PXUInt64                   fLatencyMarks;    ///< LatencyMarks() before.
+      PXUInt64                   fLatencyStart;    ///< Applying from.
+      bool                       fLatencyRemoved;  ///< Reduce took it all.
+#endif
+
+#if (PRICER_TRACE > 0)
+      PricerTraceRing*           fTrace;           ///< Flight recorder, or 0.
+#endif
+
    private:
-      typedef std::map< PricerOrderId*, 
-                        PricerOrder*,
-                        PricerOrderId_cmp>        PricerIdOrderMap;
-      
-      typedef std::pair<PricerOrderId*,
-                        PricerOrder*>             PricerIdOrderPair;
+      /// Id representation, so checkpoints from a build with the
+      /// other id type are rejected.
+      static const PXUInt32 kIdFormat = PRICER_USE_64BIT_IDS;
+
+      /// True if order is the one fIdTable holds for its id.
+      struct PricerIsIndexed
+      {
+         PricerIsIndexed(PricerIdTable& idTable)
+         : fTable(idTable)
+         {
+         }
+
+         bool operator()(const PricerOrder* order) const
+         {
+            return (fTable.Find(order->fId) == order);
+         }
 
-      typedef PricerIdOrderMap::iterator          PricerIdOrderIter;
+         PricerIdTable& fTable;
+      };
       
-      /// Internal map of all PricerOrders (buy and sell) referenced
-      /// by the id.  This is the "master list" of all PricerOrder
-      /// objects.  When deleting, objects must be removed from
-      /// PricerBooks first, then the map, then deleted.
-      PricerIdOrderMap fIdOrderMap;
+      /// Table of all PricerOrders (buy and sell) by id.  This is the
+      /// "master list" of all PricerOrder objects.  When deleting, 
+      /// objects must be removed from PricerBooks first, then the 
+      /// table, then deleted.
+      PricerIdTable fIdTable;
 };
 
 
@@ -0,0 +1,509 @@
+/// \file  PricerServer.cpp
+/// \brief Local socket server - one feed in, quotes out to subscribers.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include "PricerServer.h"
+#include "PricerSys.h"
+
+#if (PRICER_USE_SERVER > 0)
+   #include <errno.h>
+   #include <unistd.h>
+   #include <sys/epoll.h>
+   #include <sys/socket.h>
+   #include <sys/un.h>
+   #include <netinet/in.h>
+   #include <netinet/tcp.h>
+   #include <arpa/inet.h>
+
+/// Events taken per epoll_wait().
+static const int kPricerServerEvents = 64;
+
+/// How often (msec) an idle server checks for SIGTERM/SIGINT.
+static const int kPricerServerPollMsec = 100;
+
+/// Reads from the feed per wakeup, so a fast feed can't starve
+/// new connections.
+static const int kPricerServerReadsPerWake = 16;
+
+PricerServer::PricerServer(int errNum, size_t maxLag)
+: fErrNum(errNum),
+  fMaxLag(maxLag),
+  fPricer(0),
+  fListenFd(-1),
+  fEpollFd(-1),
+  fUnixPath(),
+  fConnections(),
+  fFeed(0),
+  fOut(),
+  fOutBase(0),
+  fIn(PRICER_BUFFER_SIZE)
+{
+}
+
+PricerServer::~PricerServer()
+{
+   // Flushes into fOut - nobody's left to send it to.
+   PricerDestroy(fPricer);
+
+   for (size_t i = 0; i < fConnections.size(); ++i)
+   {
+      if (!fConnections[i]->fClosed)
+         close(fConnections[i]->fFd);
+      delete fConnections[i];
+   }
+
+   if (fEpollFd >= 0)
+      close(fEpollFd);
+   if (fListenFd >= 0)
+      close(fListenFd);
+   if (!fUnixPath.empty())
+      unlink(fUnixPath.c_str());
+}
+
+bool PricerServer::Start(int targetShares, const PricerOptions* options)
+{
+   fPricer = PricerCreate(targetShares,WriteOut,WriteErr,this,options);
+   return (0 != fPricer);
+}
+
+int PRICER_CALL PricerServer::WriteOut(void*        context,
+                                       const char*  data,
+                                       int          length)
+{
+   std::vector<char>& out = ((PricerServer*)context)->fOut;
+   out.insert(out.end(),data,data + length);
+   return 0;
+}
+
+int PRICER_CALL PricerServer::WriteErr(void*        context,
+                                       const char*  data,
+                                       int          length)
+{
+   PricerServer* server = (PricerServer*)context;
+   xplat_write(server->fErrNum,data,(unsigned int)length);
+   return 0;
+}
+
+void PricerServer::Report(const char* text)
+{
+   xplat_write(fErrNum,text,(unsigned int)strlen(text));
+}
+
+bool PricerServer::Listen(const char* address)
+{
+   if ((0 == address) || (fListenFd >= 0))
+      return false;
+
+   if (0 == strncmp(address,"unix:",5))
+      return ListenUnix(address + 5);
+   if (0 == strncmp(address,"tcp:",4))
+      return ListenTcp(address + 4);
+   return false;
+}
+
+bool PricerServer::ListenUnix(const char* path)
+{
+   struct sockaddr_un local;
+   memset(&local,0,sizeof(local));
+   local.sun_family = AF_UNIX;
+   if ((0 == path[0]) || (strlen(path) >= sizeof(local.sun_path)))
+      return false;
+   strcpy(local.sun_path,path);
+
+   // A socket left by a server that didn't shut down cleanly.
+   struct stat info;
+   if ((0 == lstat(path,&info)) && (S_ISSOCK(info.st_mode)))
+      unlink(path);
+
+   fListenFd = socket(AF_UNIX,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,0);
+   if ((fListenFd < 0) ||
+       (0 != bind(fListenFd,(struct sockaddr*)&local,sizeof(local))) ||
+       (0 != listen(fListenFd,SOMAXCONN)))
+   {
+      return false;
+   }
+   fUnixPath = path;
+
+   std::string text = "Listening on unix:" + fUnixPath + "\n";
+   Report(text.c_str());
+   return true;
+}
+
+bool PricerServer::ListenTcp(const char* hostPort)
+{
+   std::string host = "127.0.0.1";
+   const char* port = hostPort;
+   const char* colon = strrchr(hostPort,':');
+   if (colon)
+   {
+      host.assign(hostPort,colon - hostPort);
+      port = colon + 1;
+   }
+
+   char* end = 0;
+   long  portNum = strtol(port,&end,10);
+   struct sockaddr_in local;
+   memset(&local,0,sizeof(local));
+   local.sin_family = AF_INET;
+   local.sin_port   = htons((unsigned short)portNum);
+   if ((port[0] < '0') || (port[0] > '9') || (*end != 0) ||
+       (portNum > 65535) ||
+       (1 != inet_pton(AF_INET,host.c_str(),&local.sin_addr)))
+   {
+      return false;
+   }
+
+   int reuse = 1;
+   fListenFd = socket(AF_INET,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,0);
+   if ((fListenFd < 0) ||
+       (0 != setsockopt(fListenFd,SOL_SOCKET,SO_REUSEADDR,
+                        &reuse,sizeof(reuse))) ||
+       (0 != bind(fListenFd,(struct sockaddr*)&local,sizeof(local))) ||
+       (0 != listen(fListenFd,SOMAXCONN)))
+   {
+      return false;
+   }
+
+   // Port 0 was given one by the system.
+   socklen_t length = sizeof(local);
+   getsockname(fListenFd,(struct sockaddr*)&local,&length);
+
+   char text[96];
+   sprintf(text,"Listening on tcp:%s:%d\n",host.c_str(),
+           (int)ntohs(local.sin_port));
+   Report(text);
+   return true;
+}
+
+int PricerServer::Run()
+{
+   if ((0 == fPricer) || (fListenFd < 0))
+      return kPR_ServerFailed;
+
+   fEpollFd = epoll_create1(EPOLL_CLOEXEC);
+   struct epoll_event listenEvent;
+   listenEvent.events   = EPOLLIN;
+   listenEvent.data.ptr = 0;
+   if ((fEpollFd < 0) ||
+       (0 != epoll_ctl(fEpollFd,EPOLL_CTL_ADD,fListenFd,&listenEvent)))
+   {
+      return kPR_ServerFailed;
+   }
+
+   PricerSysWatchSignal(kPSS_Stop);
+   PricerSysWatchSignal(kPSS_Interrupt);
+
+   int                result = kPR_Success;
+   struct epoll_event events[kPricerServerEvents];
+   for (;;)
+   {
+      bool stop = PricerSysTakeSignal(kPSS_Stop);
+      if ((PricerSysTakeSignal(kPSS_Interrupt)) || (stop))
+         break;
+
+      int count = epoll_wait(fEpollFd,events,kPricerServerEvents,
+                             kPricerServerPollMsec);
+      if (count < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         result = kPR_ServerFailed;
+         break;
+      }
+
+      for (int i = 0; i < count; ++i)
+      {
+         Connection* connection = (Connection*)events[i].data.ptr;
+         unsigned    flags      = events[i].events;
+         if (0 == connection)
+         {
+            Accept();
+            continue;
+         }
+
+         // Input first - a feed that hung up may have sent more.
+         if ((connection->fReading) &&
+             (flags & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+         {
+            Read(connection);
+         }
+         else if (flags & (EPOLLHUP | EPOLLERR))
+         {
+            Close(connection,0);
+         }
+
+         if ((!connection->fClosed) && (flags & EPOLLOUT))
+            Send(connection);
+      }
+
+      Broadcast();
+      Reap();
+   }
+
+   // Deliver what's held, as far as the subscribers will take it.
+   PricerFlush(fPricer);
+   Broadcast();
+   Reap();
+   return result;
+}
+
+void PricerServer::Accept()
+{
+   for (;;)
+   {
+      int fd = accept4(fListenFd,0,0,SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return;
+      }
+
+      if (fUnixPath.empty())
+      {
+         int noDelay = 1;
+         setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&noDelay,sizeof(noDelay));
+      }
+
+      // Subscribers start with the next quote.
+      Connection* connection = new Connection();
+      connection->fFd      = fd;
+      connection->fSent    = OutputEnd();
+      connection->fReading = true;
+      connection->fWaiting = false;
+      connection->fClosed  = false;
+
+      struct epoll_event event;
+      event.events   = EPOLLIN;
+      event.data.ptr = connection;
+      if (0 != epoll_ctl(fEpollFd,EPOLL_CTL_ADD,fd,&event))
+      {
+         close(fd);
+         delete connection;
+         continue;
+      }
+      fConnections.push_back(connection);
+   }
+}
+
+void PricerServer::Read(Connection* connection)
+{
+   for (int reads = 0; reads < kPricerServerReadsPerWake; ++reads)
+   {
+      xplat_ssize_t res = recv(connection->fFd,&fIn[0],fIn.size(),0);
+      if (res > 0)
+      {
+         if (connection != fFeed)
+         {
+            if (fFeed)
+            {
+               Close(connection,"Refused a second feed.\n");
+               return;
+            }
+            fFeed = connection;
+            connection->fWaiting = false;
+            Watch(connection);
+            Report("Feed connected.\n");
+         }
+
+         // Unknown orders are reported by the pricer itself.
+         int result = PricerFeed(fPricer,&fIn[0],(int)res);
+         if ((PRICERERR(result)) && (kPR_OrderNotFound != result))
+            Report(PricerGetResultString(result));
+
+         Broadcast();
+         continue;
+      }
+
+      if ((res < 0) && (errno == EINTR))
+         continue;
+
+      if ((res < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+      {
+         // The feed's idle - don't sit on quotes.
+         if (connection == fFeed)
+         {
+            PricerFlush(fPricer);
+            Broadcast();
+         }
+         return;
+      }
+
+      if (connection == fFeed)
+      {
+         PricerFlush(fPricer);
+         Broadcast();
+         Close(connection,"Feed disconnected.\n");
+      }
+      else if (0 == res)
+      {
+         // Done sending (it never did) - it can still be read to.
+         connection->fReading = false;
+         Watch(connection);
+      }
+      else
+      {
+         Close(connection,0);
+      }
+      return;
+   }
+}
+
+void PricerServer::Send(Connection* connection)
+{
+   while (connection->fSent < OutputEnd())
+   {
+      size_t        offset = (size_t)(connection->fSent - fOutBase);
+      xplat_ssize_t res    = send(connection->fFd, &fOut[offset],
+                                  fOut.size() - offset, MSG_NOSIGNAL);
+      if (res > 0)
+      {
+         connection->fSent += res;
+         continue;
+      }
+
+      if ((res < 0) && (errno == EINTR))
+         continue;
+
+      if ((res < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+      {
+         if (!connection->fWaiting)
+         {
+            connection->fWaiting = true;
+            Watch(connection);
+         }
+         return;
+      }
+
+      Close(connection,0);
+      return;
+   }
+
+   if (connection->fWaiting)
+   {
+      connection->fWaiting = false;
+      Watch(connection);
+   }
+}
+
+void PricerServer::Broadcast()
+{
+   PXUInt64 end    = OutputEnd();
+   PXUInt64 oldest = end;
+
+   for (size_t i = 0; i < fConnections.size(); ++i)
+   {
+      Connection* connection = fConnections[i];
+      if ((connection->fClosed) || (connection == fFeed))
+         continue;
+
+      // Ones waiting for room are sent to when there is some.
+      if ((connection->fSent < end) && (!connection->fWaiting))
+         Send(connection);
+
+      if (connection->fClosed)
+         continue;
+
+      if (end - connection->fSent > fMaxLag)
+      {
+         Close(connection,"Disconnected a slow subscriber.\n");
+         continue;
+      }
+
+      if (connection->fSent < oldest)
+         oldest = connection->fSent;
+   }
+
+   // Drop what everyone has - all of it, or once it's half the buffer
+   // so the front isn't moved for every send.
+   size_t sent = (size_t)(oldest - fOutBase);
+   if (sent == fOut.size())
+   {
+      fOut.clear();
+      fOutBase = end;
+   }
+   else if ((sent > 0) && (sent >= fOut.size() / 2))
+   {
+      fOut.erase(fOut.begin(),fOut.begin() + sent);
+      fOutBase = oldest;
+   }
+}
+
+void PricerServer::Watch(Connection* connection)
+{
+   struct epoll_event event;
+   event.events   = (connection->fReading ? EPOLLIN  : 0) |
+                    (connection->fWaiting ? EPOLLOUT : 0);
+   event.data.ptr = connection;
+   epoll_ctl(fEpollFd,EPOLL_CTL_MOD,connection->fFd,&event);
+}
+
+void PricerServer::Close(Connection* connection, const char* why)
+{
+   if (why)
+      Report(why);
+
+   epoll_ctl(fEpollFd,EPOLL_CTL_DEL,connection->fFd,0);
+   close(connection->fFd);
+   connection->fClosed = true;
+   if (connection == fFeed)
+      fFeed = 0;
+}
+
+void PricerServer::Reap()
+{
+   size_t kept = 0;
+   for (size_t i = 0; i < fConnections.size(); ++i)
+   {
+      if (fConnections[i]->fClosed)
+         delete fConnections[i];
+      else
+         fConnections[kept++] = fConnections[i];
+   }
+   fConnections.resize(kept);
+}
+
+#endif // PRICER_USE_SERVER
+
+int PRICER_CALL PricerServe(int                   targetShares,
+                            const char*           address,
+                            int                   outErrNum,
+                            const PricerOptions*  options)
+{
+   PricerOptions defaults;
+   if (0 == options)
+   {
+      PricerInitOptions(&defaults);
+      options = &defaults;
+   }
+
+   int         result = kPR_ServerFailed;
+   const char* msg;
+
+#if (PRICER_USE_SERVER > 0)
+   bool pinned = (options->cpu < 0) || (PricerSysPinThread(options->cpu));
+
+   PricerServer server(outErrNum,(size_t)options->serverMaxLag);
+   if ((0 >= options->serverMaxLag) ||
+       (!server.Start(targetShares,options)))
+   {
+      result = kPR_InvalidCmdLine;
+   }
+   else if (server.Listen(address))
+   {
+      if (!pinned)
+      {
+         msg = PricerGetResultString(kPR_SysSetupFailed);
+         xplat_write(outErrNum,msg,(unsigned int)strlen(msg));
+      }
+      return server.Run();
+   }
+#else
+   (void)targetShares;
+   (void)address;
+#endif
+
+   msg = PricerGetResultString(result);
+   xplat_write(outErrNum,msg,(unsigned int)strlen(msg));
+   return result;
+}
@@ -0,0 +1,114 @@
+/// \file  PricerServer.h
+/// \brief Local socket server - one feed in, quotes out to subscribers.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerServer_H_
+#define _PricerServer_H_
+
+#include <string>
+#include <vector>
+#include "PricerDefs.h"
+#include "Pricer.h"
+
+#if defined(__linux__)
+   #define PRICER_USE_SERVER 1
+#else
+   #define PRICER_USE_SERVER 0
+#endif
+
+#if (PRICER_USE_SERVER > 0)
+
+/// \class PricerServer
+/// \brief Non-blocking epoll loop behind PricerServe().
+///
+/// Quotes from the pricer are appended once to a buffer shared by all
+/// the subscribers; each subscriber only has a position in it, so
+/// writing to n subscribers is n send() calls on the same bytes.  The
+/// buffer is trimmed as the slowest subscriber catches up, and a
+/// subscriber fMaxLag bytes behind is disconnected, which bounds it.
+class PricerServer
+{
+   public:
+      PricerServer(int errNum, size_t maxLag);
+      ~PricerServer();
+
+      /// Creates the pricer.  Returns false on bad arguments.
+      bool Start(int targetShares, const PricerOptions* options);
+
+      /// Binds and listens on "unix:path" or "tcp:[host:]port", and
+      /// reports the address to the error output.
+      bool Listen(const char* address);
+
+      /// Serves until SIGTERM or SIGINT.
+      int Run();
+
+   protected:
+      struct Connection
+      {
+         int         fFd;
+         PXUInt64    fSent;      ///< Position in the output sent up to.
+         bool        fReading;   ///< Watching for input.
+         bool        fWaiting;   ///< Watching for room to write.
+         bool        fClosed;    ///< Deleted after this wakeup.
+      };
+
+      /// Output callbacks for the pricer handle.
+      static int PRICER_CALL WriteOut(void* context, const char* data,
+                                      int length);
+      static int PRICER_CALL WriteErr(void* context, const char* data,
+                                      int length);
+
+      bool ListenUnix(const char* path);
+      bool ListenTcp(const char* hostPort);
+
+      /// Accepts every pending connection as a subscriber.
+      void Accept();
+
+      /// Reads from connection until it would block - market data if
+      /// it's (or becomes) the feed.
+      void Read(Connection* connection);
+
+      /// Sends connection as much of the output as it will take.
+      void Send(Connection* connection);
+
+      /// Sends the output to every subscriber, drops the ones too far
+      /// behind, and trims what they've all been sent.
+      void Broadcast();
+
+      /// Updates connection's epoll events from fReading / fWaiting.
+      void Watch(Connection* connection);
+
+      void Close(Connection* connection, const char* why);
+
+      /// Deletes the connections closed during this wakeup.
+      void Reap();
+
+      /// End of the output, as a position.
+      PXUInt64 OutputEnd() const { return fOutBase + fOut.size(); }
+
+      void Report(const char* text);
+
+      int                        fErrNum;
+      size_t                     fMaxLag;
+      PricerHandle               fPricer;
+      int                        fListenFd;
+      int                        fEpollFd;
+      std::string                fUnixPath;   ///< Removed when done.
+
+      std::vector<Connection*>   fConnections;
+      Connection*                fFeed;
+
+      std::vector<char>          fOut;        ///< Output not yet sent to all.
+      PXUInt64                   fOutBase;    ///< Position of fOut[0].
+      std::vector<char>          fIn;         ///< Feed read buffer.
+
+   private:
+      /// Not implemented.
+      PricerServer(const PricerServer&);
+      /// Not implemented.
+      PricerServer& operator=(const PricerServer&);
+};
+
+#endif // PRICER_USE_SERVER
+
+#endif // _PricerServer_H_
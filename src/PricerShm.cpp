@@ -0,0 +1,206 @@
+/// \file  PricerShm.cpp
+/// \brief Latest quotes in POSIX shared memory, behind seqlocks.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include <string>
+#include "PricerShm.h"
+
+#if (PRICER_USE_SHM > 0)
+   #include <fcntl.h>
+   #include <unistd.h>
+   #include <sys/mman.h>
+#endif
+
+/// Copies before PricerShmRead() gives up on a slot - only reached if
+/// the writer died part way through an update.
+static const int kPricerShmReadTries = 1 << 16;
+
+#if (PRICER_USE_SHM > 0)
+/// POSIX segment names start with a single '/'.
+static std::string PricerShmPath(const char* name)
+{
+   std::string path = name;
+   if (path.empty() || (path[0] != '/'))
+      path.insert(path.begin(),'/');
+   return path;
+}
+#endif
+
+PricerShmPublisher::PricerShmPublisher()
+: fQuotes(0)
+{
+}
+
+PricerShmPublisher::~PricerShmPublisher()
+{
+#if (PRICER_USE_SHM > 0)
+   // The segment stays, so readers still have the last quotes.
+   if (fQuotes)
+   {
+      fQuotes->fLive = 0;
+      munmap(fQuotes,sizeof(PricerShmQuotes));
+   }
+#endif
+}
+
+bool PricerShmPublisher::Open(const char* name)
+{
+#if (PRICER_USE_SHM > 0)
+   if ((fQuotes) || (0 == name) || (0 == name[0]))
+      return false;
+
+   std::string path = PricerShmPath(name);
+   int fd = shm_open(path.c_str(), O_CREAT | O_RDWR, 0644);
+   if (fd < 0)
+      return false;
+
+   void* mem = MAP_FAILED;
+   if (0 == ftruncate(fd,sizeof(PricerShmQuotes)))
+   {
+      mem = mmap(0, sizeof(PricerShmQuotes), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+   }
+   close(fd);
+   if (MAP_FAILED == mem)
+      return false;
+
+   fQuotes = (PricerShmQuotes*)mem;
+
+   // Readers may have it mapped from the last run - mark it dead and
+   // hide its extra targets, then empty the main ones through the
+   // seqlocks too.
+   fQuotes->fLive      = 0;
+   fQuotes->fSlotsUsed = 2;
+   xplat_fence_release();
+
+   PricerQuoteEvent empty;
+   memset(&empty,0,sizeof(empty));
+   for (int i = 0; i < PRICER_SHM_SLOTS; ++i)
+   {
+      // A writer that died mid-update left its sequence odd, and Write()
+      // would keep it so.  Round it up to even (not down, back to a
+      // value readers may have seen before that update began).
+      PricerShmSlot* slot = &fQuotes->fSlots[i];
+      slot->fSequence = (slot->fSequence + 1) & ~(PXUInt32)1;
+
+      empty.side = (i == 1) ? 'S' : 'B';
+      Write(slot,empty);
+   }
+
+   fQuotes->fSlotCount = PRICER_SHM_SLOTS;
+   fQuotes->fVersion   = kPricerShmVersion;
+   fQuotes->fLive      = 1;
+   xplat_fence_release();
+   fQuotes->fMagic     = kPricerShmMagic;
+   return true;
+#else
+   (void)name;
+   return false;
+#endif
+}
+
+const PricerShmQuotes* PRICER_CALL PricerShmOpen(const char* name)
+{
+#if (PRICER_USE_SHM > 0)
+   if ((0 == name) || (0 == name[0]))
+      return 0;
+
+   std::string path = PricerShmPath(name);
+   int fd = shm_open(path.c_str(), O_RDONLY, 0);
+   if (fd < 0)
+      return 0;
+
+   struct stat info;
+   void* mem = MAP_FAILED;
+   if ((0 == fstat(fd,&info)) &&
+       (info.st_size >= (off_t)sizeof(PricerShmQuotes)))
+   {
+      mem = mmap(0, sizeof(PricerShmQuotes), PROT_READ, MAP_SHARED, fd, 0);
+   }
+   close(fd);
+   if (MAP_FAILED == mem)
+      return 0;
+
+   const PricerShmQuotes* quotes = (const PricerShmQuotes*)mem;
+   if ((quotes->fMagic   != kPricerShmMagic) ||
+       (quotes->fVersion != kPricerShmVersion) ||
+       (quotes->fSlotCount > PRICER_SHM_SLOTS))
+   {
+      munmap(mem,sizeof(PricerShmQuotes));
+      return 0;
+   }
+   return quotes;
+#else
+   (void)name;
+   return 0;
+#endif
+}
+
+/// Consistent copy of slot into quote - false if the writer never
+/// finished with it.
+static bool PricerShmCopy(const PricerShmSlot&  slot,
+                          PricerQuoteEvent&     quote,
+                          PXUInt32&             sequence)
+{
+   for (int tries = 0; tries < kPricerShmReadTries; ++tries)
+   {
+      sequence = slot.fSequence;
+      xplat_fence_acquire();
+
+      quote.timeStamp    = slot.fTimeStamp;
+      quote.totalPrice   = slot.fTotalPrice;
+      quote.targetShares = slot.fTargetShares;
+      quote.side         = slot.fSide;
+      quote.valid        = slot.fValid;
+      quote.extra        = slot.fExtra;
+
+      xplat_fence_acquire();
+      if ((0 == (sequence & 1)) && (sequence == slot.fSequence))
+         return true;
+      xplat_cpu_relax();
+   }
+   return false;
+}
+
+int PRICER_CALL PricerShmRead(const PricerShmQuotes*  quotes,
+                              char                    side,
+                              long long               targetShares,
+                              PricerQuoteEvent*       quote,
+                              unsigned int*           sequence)
+{
+   if ((0 == quotes) || (0 == quote))
+      return kPR_InvalidData;
+
+   PXUInt32 used = quotes->fSlotsUsed;
+   xplat_fence_acquire();
+   if (used > quotes->fSlotCount)
+      used = quotes->fSlotCount;
+
+   // The main target's are always first.
+   for (PXUInt32 i = 0; i < used; ++i)
+   {
+      PXUInt32 copied = 0;
+      if (!PricerShmCopy(quotes->fSlots[i],*quote,copied))
+         continue;
+
+      if ((quote->side == side) &&
+          ((0 == targetShares) ? (!quote->extra)
+                               : (quote->targetShares == targetShares)))
+      {
+         if (sequence)
+            *sequence = copied / 2;
+         return kPR_Success;
+      }
+   }
+   return kPR_InvalidData;
+}
+
+void PRICER_CALL PricerShmClose(const PricerShmQuotes* quotes)
+{
+#if (PRICER_USE_SHM > 0)
+   if (quotes)
+      munmap((void*)quotes,sizeof(PricerShmQuotes));
+#else
+   (void)quotes;
+#endif
+}
@@ -0,0 +1,138 @@
+/// \file  PricerShm.h
+/// \brief Latest quotes in POSIX shared memory, behind seqlocks.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerShm_H_
+#define _PricerShm_H_
+
+#include "PricerDefs.h"
+#include "Pricer.h"
+#include "PricerSink.h"
+
+#if !defined(_WIN32)
+   #define PRICER_USE_SHM 1
+#else
+   #define PRICER_USE_SHM 0
+#endif
+
+/// "PRSQ" - marks a pricer's segment.
+static const PXUInt32 kPricerShmMagic   = 0x51535250;
+static const PXUInt32 kPricerShmVersion = 1;
+
+/// One side of one target, as a seqlock.
+///
+/// The writer makes fSequence odd, updates the rest, then makes it
+/// even again. A reader that sees the same even fSequence before and
+/// after copying the rest has a consistent copy. fSequence / 2 is the
+/// number of updates.  Each slot has a cache line of its own, so the
+/// writer updating one side doesn't disturb readers of the other.
+struct PricerShmSlot
+{
+   volatile PXUInt32    fSequence;
+   volatile PXUInt32    fTimeStamp;
+   volatile PXInt64     fTotalPrice;
+   volatile PXInt64     fTargetShares;
+   volatile char        fSide;
+   volatile char        fValid;
+   volatile char        fExtra;
+   char                 fReserved[64 - 27];
+};
+
+/// Segment layout. Slots 0 and 1 are the main target's bid and ask;
+/// extra targets take the next ones as they're first published.
+struct PricerShmQuotes
+{
+   PXUInt32             fMagic;
+   PXUInt32             fVersion;
+   PXUInt32             fSlotCount;    ///< Capacity.
+   volatile PXUInt32    fSlotsUsed;    ///< Only grows while live.
+   volatile PXUInt32    fLive;         ///< 1 while the writer runs.
+   char                 fReserved[64 - 20];
+   PricerShmSlot        fSlots[PRICER_SHM_SLOTS];
+};
+
+/// \class PricerShmPublisher
+/// \brief Quote sink writing each side's latest state to a segment.
+///
+/// Single writer; any number of readers in other processes
+/// (\see PricerShmRead).  Extra targets past the segment's capacity
+/// aren't published.
+class PricerShmPublisher : public PricerQuoteSink
+{
+   public:
+      PricerShmPublisher();
+      ~PricerShmPublisher();
+
+      /// Creates segment name - or takes over one left by an earlier
+      /// run - and starts it over with no quotes.
+      bool Open(const char* name);
+
+      bool IsOpen() const { return (0 != fQuotes); }
+
+      virtual void OnQuote(const PricerQuoteEvent& event)
+      {
+         PXUInt32 used  = fQuotes->fSlotsUsed;
+         PXUInt32 index = FindSlot(event,fQuotes,used);
+         if (index < used)
+         {
+            Write(&fQuotes->fSlots[index],event);
+         }
+         else if (index < fQuotes->fSlotCount)
+         {
+            // A new extra target - filled in before readers see it.
+            Write(&fQuotes->fSlots[index],event);
+            xplat_fence_release();
+            fQuotes->fSlotsUsed = used + 1;
+         }
+      }
+
+   protected:
+      /// Seqlock update of slot.
+      static void Write(PricerShmSlot* slot, const PricerQuoteEvent& event)
+      {
+         PXUInt32 sequence = slot->fSequence;
+         slot->fSequence = sequence + 1;
+         xplat_fence_release();
+
+         slot->fTimeStamp    = event.timeStamp;
+         slot->fTotalPrice   = event.totalPrice;
+         slot->fTargetShares = event.targetShares;
+         slot->fSide         = event.side;
+         slot->fValid        = event.valid;
+         slot->fExtra        = event.extra;
+
+         xplat_fence_release();
+         slot->fSequence = sequence + 2;
+      }
+
+      /// Index of the slot for the event's side and target - used if
+      /// it's an extra target with no slot yet.
+      static PXUInt32 FindSlot(const PricerQuoteEvent& event,
+                               const PricerShmQuotes*  quotes,
+                               PXUInt32                used)
+      {
+         if (!event.extra)
+            return (event.side == 'B') ? 0 : 1;
+
+         for (PXUInt32 i = 2; i < used; ++i)
+         {
+            const PricerShmSlot& slot = quotes->fSlots[i];
+            if ((slot.fSide == event.side) &&
+                (slot.fTargetShares == event.targetShares))
+            {
+               return i;
+            }
+         }
+         return used;
+      }
+
+      PricerShmQuotes*     fQuotes;
+
+   private:
+      /// Not implemented.
+      PricerShmPublisher(const PricerShmPublisher&);
+      /// Not implemented.
+      PricerShmPublisher& operator=(const PricerShmPublisher&);
+};
+
+#endif // _PricerShm_H_
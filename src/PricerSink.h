@@ -0,0 +1,424 @@
+/// \file  PricerSink.h
+/// \brief Receivers for the quotes generated by PricerBook.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerSink_H_
+#define _PricerSink_H_
+
+#include <vector>
+#include "Pricer.h"
+#include "PricerDefs.h"
+#include "PricerMetrics.h"
+
+/// \class PricerQuoteSink
+/// \brief Receives each new Bid/Ask state from a PricerBook.
+///
+/// PricerBook formats nothing itself - it hands a PricerQuoteEvent to
+/// its sink.  PricerTextSink gives the classic text output; in-process
+/// users can take the events directly with no formatting at all.
+class PricerQuoteSink
+{
+   public:
+      virtual ~PricerQuoteSink() {}
+
+      /// Called for every published quote.
+      virtual void OnQuote(const PricerQuoteEvent& event) = 0;
+};
+
+/// \class PricerNullSink
+/// \brief Drops every quote - for books that are only being caught up.
+class PricerNullSink : public PricerQuoteSink
+{
+   public:
+      virtual void OnQuote(const PricerQuoteEvent&) {}
+};
+
+/// \class PricerTextSink
+/// \brief Formats quotes as text lines on an output stream.
+///
+/// "timeStamp side dollars.cents" or "timeStamp side NA", followed by
+/// " targetShares" for extra targets.
+template<class OutStream>
+class PricerTextSink : public PricerQuoteSink
+{
+   public:
+      PricerTextSink()
+      : fOutStream(0)
+      {
+      }
+
+      void SetStream(OutStream* outStream)
+      {
+         fOutStream = outStream;
+      }
+
+      virtual void OnQuote(const PricerQuoteEvent& event)
+      {
+         if (event.valid)
+         {
+            PXUInt32 cents = (PXUInt32)(event.totalPrice%100);
+            (*fOutStream) << event.timeStamp  << ' '
+                          << event.side       << ' '
+                          << (PXUInt64)event.totalPrice/100
+                          << ((cents<10)?".0":".")
+                          << cents;
+         }
+         else
+         {
+            (*fOutStream) << event.timeStamp << ' '
+                          << event.side      << ' '
+                          << "NA";
+         }
+
+         if (event.extra)
+            (*fOutStream) << ' ' << (PXUInt64)event.targetShares;
+         (*fOutStream) << '\n';
+      }
+
+   protected:
+      OutStream*  fOutStream;
+};
+
+/// True if two events are quotes for the same target of a book - the
+/// main target (whatever its size) or the same extra one.
+inline bool PricerSameTarget(const PricerQuoteEvent& a,
+                             const PricerQuoteEvent& b)
+{
+   return (a.extra == b.extra) &&
+          ((!a.extra) || (a.targetShares == b.targetShares));
+}
+
+/// \class PricerCoalesceSink
+/// \brief Passes on only the last quote of each timestamp.
+///
+/// Quotes are held until one with a new timestamp arrives or Flush()
+/// is called.  Then the final state of the main target and of each
+/// extra target is passed to the next sink - unless it's the same as
+/// the last state passed on for it.
+class PricerCoalesceSink : public PricerQuoteSink
+{
+   public:
+      PricerCoalesceSink()
+      : fSink(0),
+        fPendingTime(0),
+        fSlots()
+      {
+      }
+
+      void SetSink(PricerQuoteSink* sink)
+      {
+         fSink = sink;
+      }
+
+      virtual void OnQuote(const PricerQuoteEvent& event)
+      {
+         if (event.timeStamp != fPendingTime)
+         {
+            Flush();
+            fPendingTime = event.timeStamp;
+         }
+
+         Slot& slot       = FindSlot(event);
+         slot.fPending    = event;
+         slot.fHasPending = true;
+      }
+
+      /// Passes on the held quotes that changed anything.
+      void Flush()
+      {
+         for (size_t i = 0; i < fSlots.size(); ++i)
+         {
+            Slot& slot = fSlots[i];
+            if (!slot.fHasPending)
+               continue;
+
+            slot.fHasPending = false;
+            const PricerQuoteEvent& pending   = slot.fPending;
+            PricerQuoteEvent&       published = slot.fPublished;
+            if ((pending.valid == published.valid) &&
+                ((!pending.valid) || 
+                 (pending.totalPrice == published.totalPrice)))
+            {
+               continue;
+            }
+
+            published = pending;
+            fSink->OnQuote(pending);
+         }
+      }
+
+   protected:
+      /// Held and last passed-on state of one target.
+      struct Slot
+      {
+         PricerQuoteEvent  fPending;
+         PricerQuoteEvent  fPublished;
+         bool              fHasPending;
+      };
+
+      /// Slot for the event's target - the main target has one slot,
+      /// whatever its size, and each extra target one of its own.
+      Slot& FindSlot(const PricerQuoteEvent& event)
+      {
+         for (size_t i = 0; i < fSlots.size(); ++i)
+         {
+            if (PricerSameTarget(fSlots[i].fPending,event))
+               return fSlots[i];
+         }
+
+         // Nothing published yet reads as "NA".
+         Slot slot;
+         memset(&slot,0,sizeof(slot));
+         fSlots.push_back(slot);
+         return fSlots.back();
+      }
+
+      PricerQuoteSink*    fSink;
+      PXUInt32            fPendingTime;
+      std::vector<Slot>   fSlots;
+};
+
+/// \class PricerFilterSink
+/// \brief Publication filter: passes on only quotes that moved enough,
+/// no more often than a set interval.
+///
+/// A valid quote that moved less than the PricerPublishFilter minimum
+/// from the last one passed on (for the same target) is dropped.  One
+/// that moved enough, but sooner than minInterval after the last, is
+/// held - replacing any held before it - and goes out, stamped with 
+/// the time it's released, from Release() once the interval is up or
+/// from Flush().  Changes between valid and NA always go straight out.
+class PricerFilterSink : public PricerQuoteSink
+{
+   public:
+      PricerFilterSink()
+      : fSink(0),
+        fSlots()
+      {
+         memset(&fFilter,0,sizeof(fFilter));
+      }
+
+      void SetSink(PricerQuoteSink* sink)
+      {
+         fSink = sink;
+      }
+
+      void SetFilter(const PricerPublishFilter& filter)
+      {
+         fFilter = filter;
+      }
+
+      /// True if the filter lets anything through unchanged.
+      bool IsOpen() const
+      {
+         return (fFilter.minMoveCents <= 0) && (fFilter.minMoveBps <= 0) &&
+                (fFilter.minInterval <= 0);
+      }
+
+      virtual void OnQuote(const PricerQuoteEvent& event)
+      {
+         Slot& slot = FindSlot(event);
+         const PricerQuoteEvent& published = slot.fPublished;
+
+         if (event.valid != published.valid)
+         {
+            Publish(slot,event);
+            return;
+         }
+
+         // Too small a move (NA to NA is none at all) - anything held
+         // is no longer worth sending either.
+         PXInt64 move = event.totalPrice - published.totalPrice;
+         if (move < 0)
+            move = -move;
+         PXInt64 base = (published.totalPrice < 0) ? -published.totalPrice
+                                                   :  published.totalPrice;
+         if ((!event.valid) || (0 == move) ||
+             (move < fFilter.minMoveCents) ||
+             (move * 10000 < base * fFilter.minMoveBps))
+         {
+            slot.fHasPending = false;
+            return;
+         }
+
+         if ((fFilter.minInterval > 0) && 
+             (event.timeStamp < 
+              (PXUInt64)slot.fPublishedAt + fFilter.minInterval))
+         {
+            slot.fPending    = event;
+            slot.fHasPending = true;
+            return;
+         }
+
+         Publish(slot,event);
+      }
+
+      /// Sends the held quotes whose interval is up by timeStamp.
+      void Release(PXUInt32 timeStamp)
+      {
+         for (size_t i = 0; i < fSlots.size(); ++i)
+         {
+            Slot& slot = fSlots[i];
+            if ((slot.fHasPending) &&
+                ((PXUInt64)slot.fPublishedAt + fFilter.minInterval <= 
+                 timeStamp))
+            {
+               slot.fPending.timeStamp = timeStamp;
+               Publish(slot,slot.fPending);
+            }
+         }
+      }
+
+      /// Sends every held quote, stamped timeStamp - at the end of input.
+      void Flush(PXUInt32 timeStamp)
+      {
+         for (size_t i = 0; i < fSlots.size(); ++i)
+         {
+            Slot& slot = fSlots[i];
+            if (slot.fHasPending)
+            {
+               if (slot.fPending.timeStamp < timeStamp)
+                  slot.fPending.timeStamp = timeStamp;
+               Publish(slot,slot.fPending);
+            }
+         }
+      }
+
+   protected:
+      /// Last passed-on and held state of one target.
+      struct Slot
+      {
+         PricerQuoteEvent  fPublished;
+         PXUInt32          fPublishedAt;
+         PricerQuoteEvent  fPending;
+         bool              fHasPending;
+      };
+
+      void Publish(Slot& slot, const PricerQuoteEvent& event)
+      {
+         slot.fPublished   = event;
+         slot.fPublishedAt = event.timeStamp;
+         slot.fHasPending  = false;
+         fSink->OnQuote(event);
+      }
+
+      /// Slot for the event's target.
+      Slot& FindSlot(const PricerQuoteEvent& event)
+      {
+         for (size_t i = 0; i < fSlots.size(); ++i)
+         {
+            if (PricerSameTarget(fSlots[i].fPublished,event))
+               return fSlots[i];
+         }
+
+         // Nothing published yet reads as "NA".
+         Slot slot;
+         memset(&slot,0,sizeof(slot));
+         slot.fPublished.extra        = event.extra;
+         slot.fPublished.targetShares = event.targetShares;
+         fSlots.push_back(slot);
+         return fSlots.back();
+      }
+
+      PricerQuoteSink*     fSink;
+      PricerPublishFilter  fFilter;
+      std::vector<Slot>    fSlots;
+};
+
+/// \class PricerCountSink
+/// \brief Counts the quotes passed through it to the next sink.
+class PricerCountSink : public PricerQuoteSink
+{
+   public:
+      PricerCountSink(PricerQuoteSink* sink, PricerCounter* count)
+      : fSink(sink),
+        fCount(count)
+      {
+      }
+
+      void SetSink(PricerQuoteSink* sink)
+      {
+         fSink = sink;
+      }
+
+      virtual void OnQuote(const PricerQuoteEvent& event)
+      {
+         ++*fCount;
+         fSink->OnQuote(event);
+      }
+
+   protected:
+      PricerQuoteSink*     fSink;
+      PricerCounter*       fCount;
+};
+
+/// \class PricerCallbackSink
+/// \brief Passes quote events to a C callback.
+class PricerCallbackSink : public PricerQuoteSink
+{
+   public:
+      PricerCallbackSink(PricerQuoteFunc func, void* context)
+      : fFunc(func),
+        fContext(context)
+      {
+      }
+
+      virtual void OnQuote(const PricerQuoteEvent& event)
+      {
+         fFunc(fContext,&event);
+      }
+
+   protected:
+      PricerQuoteFunc   fFunc;
+      void*             fContext;
+};
+
+/// \class PricerArraySink
+/// \brief Appends quote events to a caller-owned, preallocated array.
+///
+/// Events past the capacity are dropped and counted; the caller drains
+/// the array with Take().
+class PricerArraySink : public PricerQuoteSink
+{
+   public:
+      PricerArraySink(PricerQuoteEvent* events, int capacity)
+      : fEvents(events),
+        fCapacity(capacity),
+        fCount(0),
+        fDropped(0)
+      {
+      }
+
+      virtual void OnQuote(const PricerQuoteEvent& event)
+      {
+         if (fCount < fCapacity)
+            fEvents[fCount++] = event;
+         else
+            ++fDropped;
+      }
+
+      /// Returns the number of events stored and starts over at the
+      /// beginning of the array.
+      int Take()
+      {
+         int count = fCount;
+         fCount    = 0;
+         return count;
+      }
+
+      /// Returns the number of events dropped since the last call.
+      int TakeDropped()
+      {
+         int dropped = fDropped;
+         fDropped    = 0;
+         return dropped;
+      }
+
+   protected:
+      PricerQuoteEvent*  fEvents;
+      int                fCapacity;
+      int                fCount;
+      int                fDropped;
+};
+
+#endif // _PricerSink_H_
@@ -0,0 +1,154 @@
+/// \file  PricerSnapshot.cpp
+/// \brief Immutable book snapshots for readers on other threads.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include <string.h>
+#include "PricerSnapshot.h"
+
+bool PricerSnapshot::Query(char      side,
+                           PXInt64   shares,
+                           PXInt64&  totalPrice,
+                           PXInt64&  marginalPrice) const
+{
+   if ((shares <= 0) || (('B' != side) && ('S' != side)))
+      return false;
+
+   // First level where the cumulative shares reach shares.
+   const std::vector<PricerSnapshotLevel>& levels = fLevels[('S' == side) ? 1 : 0];
+   size_t low  = 0;
+   size_t high = levels.size();
+   while (low < high)
+   {
+      size_t mid = (low + high) / 2;
+      if (levels[mid].fShares < shares)
+         low = mid + 1;
+      else
+         high = mid;
+   }
+   if (low == levels.size())
+      return false;
+
+   PXInt64 sharesBefore = 0;
+   PXInt64 totalBefore  = 0;
+   if (low > 0)
+   {
+      sharesBefore = levels[low - 1].fShares;
+      totalBefore  = levels[low - 1].fTotal;
+   }
+
+   totalPrice    = totalBefore + (shares - sharesBefore) * levels[low].fPrice;
+   marginalPrice = levels[low].fPrice;
+   return true;
+}
+
+PricerSnapshots::PricerSnapshots()
+: fCurrent(0),
+  fEpoch(1),
+  fRetired(0),
+  fFree(0)
+{
+   memset(fSlots,0,sizeof(fSlots));
+}
+
+PricerSnapshots::~PricerSnapshots()
+{
+   delete fCurrent;
+   DeleteList(fRetired);
+   DeleteList(fFree);
+}
+
+void PricerSnapshots::DeleteList(PricerSnapshot* list)
+{
+   while (list)
+   {
+      PricerSnapshot* next = list->fNext;
+      delete list;
+      list = next;
+   }
+}
+
+PricerSnapshot* PricerSnapshots::Prepare()
+{
+   PricerSnapshot* snapshot = fFree;
+   if (0 == snapshot)
+      return new PricerSnapshot();
+
+   fFree = snapshot->fNext;
+   snapshot->fNext      = 0;
+   snapshot->fTimeStamp = 0;
+   snapshot->fLevels[0].clear();
+   snapshot->fLevels[1].clear();
+   return snapshot;
+}
+
+void PricerSnapshots::Publish(PricerSnapshot* snapshot)
+{
+   PricerSnapshot* old = fCurrent;
+   xplat_fence_release();
+   fCurrent = snapshot;
+
+   if (old)
+   {
+      old->fRetired = fEpoch;
+      old->fNext    = fRetired;
+      fRetired      = old;
+   }
+
+   // Readers entering from here on are in a later epoch than old was
+   // retired in, and see the new snapshot.
+   PXUInt32 epoch = fEpoch + 1;
+   xplat_fence_release();
+   fEpoch = (0 == epoch) ? 1 : epoch;
+
+   xplat_fence_full();
+   Reclaim();
+}
+
+void PricerSnapshots::Reclaim()
+{
+   bool     reading = false;
+   PXUInt32 oldest  = 0;
+   for (int i = 0; i < PRICER_SNAPSHOT_READERS; ++i)
+   {
+      PXUInt32 epoch = fSlots[i].fEpoch;
+      if ((epoch) && ((!reading) || (Before(epoch,oldest))))
+      {
+         oldest  = epoch;
+         reading = true;
+      }
+   }
+
+   // A reader that entered in the epoch a snapshot was retired in (or
+   // earlier) may still hold it.
+   PricerSnapshot** link = &fRetired;
+   while (*link)
+   {
+      PricerSnapshot* snapshot = *link;
+      if ((reading) && (!Before(snapshot->fRetired,oldest)))
+      {
+         link = &snapshot->fNext;
+         continue;
+      }
+
+      *link           = snapshot->fNext;
+      snapshot->fNext = fFree;
+      fFree           = snapshot;
+   }
+}
+
+int PricerSnapshots::AddReader()
+{
+   for (int i = 0; i < PRICER_SNAPSHOT_READERS; ++i)
+   {
+      if ((0 == fSlots[i].fClaimed) && (xplat_cas32(&fSlots[i].fClaimed,0,1)))
+         return i;
+   }
+   return -1;
+}
+
+void PricerSnapshots::RemoveReader(int reader)
+{
+   fSlots[reader].fEpoch = 0;
+   xplat_fence_release();
+   fSlots[reader].fClaimed = 0;
+}
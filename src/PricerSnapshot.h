@@ -0,0 +1,157 @@
+/// \file  PricerSnapshot.h
+/// \brief Immutable book snapshots for readers on other threads.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerSnapshot_H_
+#define _PricerSnapshot_H_
+
+#include <vector>
+#include "PricerDefs.h"
+
+/// One price level of a snapshot, with the shares and total price of
+/// every level up to and including it.
+struct PricerSnapshotLevel
+{
+   PXInt64     fPrice;
+   PXInt64     fShares;    ///< Cumulative.
+   PXInt64     fTotal;     ///< Cumulative, in cents.
+};
+
+/// \class PricerSnapshot
+/// \brief Both sides of the book as they stood after one message.
+///
+/// Filled in by the pricing thread and never changed once published,
+/// so any number of threads can query it with no locking at all.
+class PricerSnapshot
+{
+   public:
+      PricerSnapshot()
+      : fTimeStamp(0),
+        fRetired(0),
+        fNext(0)
+      {
+      }
+
+      /// Levels walked for side ('B' or 'S'), best first - the ones
+      /// to fill in before it's published.
+      std::vector<PricerSnapshotLevel>& GetLevels(char side)
+      {
+         return fLevels[('S' == side) ? 1 : 0];
+      }
+
+      /// Prices shares against side the way PricerBook::QueryCost()
+      /// does, in O(log levels).
+      ///
+      /// \return bool false if the side doesn't hold that many.
+      bool Query(char      side,
+                 PXInt64   shares,
+                 PXInt64&  totalPrice,
+                 PXInt64&  marginalPrice) const;
+
+      PXUInt32                            fTimeStamp;
+
+   protected:
+      friend class PricerSnapshots;
+
+      std::vector<PricerSnapshotLevel>    fLevels[2];    ///< 'B', 'S'.
+      PXUInt32                            fRetired;      ///< Epoch replaced in.
+      PricerSnapshot*                     fNext;         ///< Retired/free list.
+};
+
+/// \class PricerSnapshots
+/// \brief Publishes snapshots to reader threads, reclaiming them by
+///        epoch.
+///
+/// The pricing thread is the single writer: it fills a snapshot from
+/// Prepare() and Publish()es it, which swaps the current pointer and
+/// retires the one it replaces.  Readers never block it and never
+/// take a lock - each has a slot holding the epoch it entered in
+/// (0 when it isn't reading), and a retired snapshot is only reused
+/// once every reader in a read has entered in a later epoch.  A
+/// reader that's slow only holds snapshots back; the writer never
+/// waits on it.
+class PricerSnapshots
+{
+   public:
+      PricerSnapshots();
+      ~PricerSnapshots();
+
+      /// Writer: an empty snapshot to fill in - a reclaimed one when
+      /// there is one, so the steady state doesn't allocate.
+      PricerSnapshot* Prepare();
+
+      /// Writer: makes snapshot the current one and reclaims what no
+      /// reader can still be looking at.
+      void Publish(PricerSnapshot* snapshot);
+
+      /// Claims a reader slot, from any thread.  -1 if they're all taken.
+      int AddReader();
+
+      /// Gives back a slot from AddReader().
+      void RemoveReader(int reader);
+
+      /// Starts a read - the snapshot stays valid until Leave().
+      const PricerSnapshot* Enter(int reader)
+      {
+         Slot& slot = fSlots[reader];
+
+         PXUInt32 epoch = fEpoch;
+         xplat_fence_acquire();
+         slot.fEpoch = epoch;
+
+         // Our epoch must be visible before we look at the pointer, or
+         // the writer could retire and reuse what we're about to read.
+         xplat_fence_full();
+         const PricerSnapshot* snapshot = fCurrent;
+         xplat_fence_acquire();
+         return snapshot;
+      }
+
+      /// Ends a read from Enter().
+      void Leave(int reader)
+      {
+         xplat_fence_release();
+         fSlots[reader].fEpoch = 0;
+      }
+
+   protected:
+      /// A reader's slot, on a cache line of its own.
+      struct Slot
+      {
+         volatile PXUInt32    fClaimed;
+         volatile PXUInt32    fEpoch;     ///< Entered in, or 0.
+         char                 fReserved[64 - 8];
+      };
+
+      /// Moves retired snapshots no reader can still hold to fFree.
+      void Reclaim();
+
+      /// a is an earlier epoch than b (they wrap).
+      static bool Before(PXUInt32 a, PXUInt32 b)
+      {
+         return ((PXInt32)(a - b) < 0);
+      }
+
+      static void DeleteList(PricerSnapshot* list);
+
+      Slot                             fSlots[PRICER_SNAPSHOT_READERS];
+      PricerSnapshot* volatile         fCurrent;
+      volatile PXUInt32                fEpoch;     ///< Never 0.
+      PricerSnapshot*                  fRetired;   ///< Writer only.
+      PricerSnapshot*                  fFree;      ///< Writer only.
+
+   private:
+      /// Not implemented.
+      PricerSnapshots(const PricerSnapshots&);
+      /// Not implemented.
+      PricerSnapshots& operator=(const PricerSnapshots&);
+};
+
+/// Handle behind PricerReader.
+struct PricerSnapshotReader
+{
+   PricerSnapshots*  fSnapshots;
+   int               fSlot;
+};
+
+#endif // _PricerSnapshot_H_
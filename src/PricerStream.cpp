@@ -6,6 +6,17 @@
 #include "PricerStream.h"
 #include "PricerOrder.h"
 #include "PricerOpt.h"
+#include "PricerUring.h"
+#include "PricerSys.h"
+
+#if !defined(_WIN32)
+   #include <fcntl.h>
+   #include <limits.h>
+   #include <sys/mman.h>
+#endif
+#if defined(__linux__)
+   #include <sys/inotify.h>
+#endif
 
 /// Some libraries get all nasty if you set the mode
 /// on stdin more than once. This is just a guard for that.
@@ -17,18 +28,39 @@ PricerInputStream::PricerInputStream(int fileNum, int maxBufferSize)
   fStreamError(false), 
   fAtEndOfFile(false),
   fCanBuffer(false), 
+  fIsStream(false),
   fBuffer(0), 
   fBufferPos(0),
   fEndBufferPos(0),
   fBufferSize(0),
   fStartPos(0), 
-  fCurEndPos(0)
+  fCurEndPos(0),
+  fNumIdleStreams(0),
+  fUring(0),
+  fReadBuf(-1),
+  fBusyPoll(false),
+  fSavedFlags(-1),
+  fExternal(false),
+  fFollow(false),
+  fFollowPath(),
+  fNotifyFd(-1),
+  fDecompressor(0)
 {
    if (maxBufferSize > 0)
    {
       fCanBuffer = SetupStreamForBinaryBuffer(fFileNum,
                                               fStartPos, 
                                               fCurEndPos);
+#if !defined(_WIN32)
+      // Pipes and sockets hand back whatever is ready on read(),
+      // so they can be buffered too - just not sized up front.
+      if (!fCanBuffer)
+      {
+         fIsStream  = true;
+         fStartPos  = 0;
+         fCurEndPos = 0;
+      }
+#endif
 
       fBuffer       = new char[maxBufferSize];
       fBufferPos    = fBuffer;
@@ -39,13 +71,37 @@ PricerInputStream::PricerInputStream(int fileNum, int maxBufferSize)
 
 PricerInputStream::~PricerInputStream()
 {
-   delete fBuffer;
+#if (PRICER_USE_DECOMPRESS > 0)
+   // Stops the thread before anything it uses goes away.
+   delete fDecompressor;
+#endif
+
+#if !defined(_WIN32)
+   if (fNotifyFd >= 0)
+      close(fNotifyFd);
+
+   // Don't leave a shared stdin non-blocking behind us.
+   if (fSavedFlags >= 0)
+      fcntl(fFileNum,F_SETFL,fSavedFlags);
+#endif
+
+#if (PRICER_USE_IO_URING > 0)
+   if (fUring)
+   {
+      // Ring goes first - it cancels any read still in flight.
+      delete fUring;
+      delete [] fUringBufs[0];
+      delete [] fUringBufs[1];
+      return;
+   }
+#endif
+   delete [] fBuffer;
 }
 
 xplat_inline bool PricerInputStream::GetNextChar(char& val)
 {
    // Try to pull from our buffer first.
-   if (!fCanBuffer)
+   if (!(fCanBuffer | fIsStream | fExternal))
       return GetUnbufferedChar(val);
 
    if (fBufferPos == fEndBufferPos)
@@ -278,6 +334,14 @@ PricerInputStream& PricerInputStream::operator >>(PricerOrder& order)
             (*this) >> order.fReduceCount;
          }
          break;
+      case 'T':
+         {
+            // Target control message - the size goes in fNumShares.
+            (*this) >> c;
+            (*this) >> order.fNumShares;
+            order.fType = PricerGetTargetAction(c);
+         }
+         break;
       default:
          break;
    }
@@ -347,11 +411,531 @@ bool PricerInputStream::SetupStreamForBinaryBuffer(  int      fileNum,
    return true;
 }
 
+void PricerInputStream::AddIdleFlush(PricerOutputStream* outStream)
+{
+   for (int i = 0; i < fNumIdleStreams; ++i)
+   {
+      if (fIdleStreams[i] == outStream)
+         return;
+   }
+   if (fNumIdleStreams < kMaxIdleStreams)
+      fIdleStreams[fNumIdleStreams++] = outStream;
+}
+
+void PricerInputStream::CheckIdle(bool dataReady)
+{
+   // Before we block on the read, push out anything we're holding
+   // back if there's no more input ready yet.
+   bool pending = false;
+   for (int i = 0; i < fNumIdleStreams; ++i)
+   {
+      if (fIdleStreams[i]->HasPending())
+      {
+         pending = true;
+         break;
+      }
+   }
+
+   if (!pending)
+      return;
+
+   bool idle = !(dataReady || xplat_readable(fFileNum));
+   for (int i = 0; i < fNumIdleStreams; ++i)
+   {
+      if (idle)
+         fIdleStreams[i]->Flush();
+      else
+         fIdleStreams[i]->FlushIfExpired();
+   }
+}
+
+ePricerCompression PricerInputStream::EnableDecompress(int readerCpu)
+{
+#if !defined(_WIN32)
+   if ((fExternal) || (fUring) || (fDecompressor) || (0 == fBuffer))
+      return kPC_None;
+
+   char               magic[kPricerCompressionMagicSize];
+   int                magicLen = 0;
+   ePricerCompression format;
+
+   if (fCanBuffer)
+   {
+      // Regular file - peek without moving.
+      xplat_ssize_t res = pread(fFileNum,magic,sizeof(magic),fStartPos);
+      magicLen = (res > 0) ? (int)res : 0;
+      format   = PricerDetectCompression(magic,magicLen);
+   }
+   else if (fIsStream)
+   {
+      // Pipe - read the start into the buffer. If it's not compressed,
+      // it's simply parsed from there as usual.
+      while ((fEndBufferPos - fBuffer < kPricerCompressionMagicSize) &&
+             (fEndBufferPos - fBuffer < fBufferSize))
+      {
+         xplat_ssize_t res = xplat_read(fFileNum, fEndBufferPos,
+                                        fBufferSize - 
+                                        (int)(fEndBufferPos - fBuffer));
+         if (res <= 0)
+            break;
+         fEndBufferPos += res;
+         fStartPos     += res;
+         fCurEndPos     = fStartPos;
+      }
+      format = PricerDetectCompression(fBufferPos,
+                                       (int)(fEndBufferPos - fBufferPos));
+   }
+   else
+   {
+      return kPC_None;
+   }
+
+   if ((kPC_None == format) || (!PricerCanDecompress(format)))
+      return format;
+
+#if (PRICER_USE_DECOMPRESS > 0)
+   // Hand over whatever we've read of the compressed data. From here 
+   // on positions count decompressed bytes, as if from a pipe.
+   PricerDecompressor* decompressor = new PricerDecompressor();
+   if (!decompressor->Start(fFileNum, format, fBufferPos,
+                            (int)(fEndBufferPos - fBufferPos),
+                            fBufferSize, readerCpu))
+   {
+      delete decompressor;
+      return format;
+   }
+
+   fDecompressor  = decompressor;
+   fCanBuffer     = false;
+   fIsStream      = true;
+   fStartPos      = 0;
+   fCurEndPos     = 0;
+   fBufferPos     = fBuffer;
+   fEndBufferPos  = fBuffer;
+#else
+   (void)readerCpu;
+#endif
+   return format;
+#else
+   (void)readerCpu;
+   return kPC_None;
+#endif
+}
+
+void PricerInputStream::GetReaderPlacement(int& cpu, int& node) const
+{
+   cpu  = -1;
+   node = -1;
+#if (PRICER_USE_DECOMPRESS > 0)
+   if (fDecompressor)
+   {
+      cpu  = fDecompressor->GetCpu();
+      node = fDecompressor->GetNode();
+   }
+#endif
+}
+
+void PricerInputStream::FlushIdleStreams()
+{
+   for (int i = 0; i < fNumIdleStreams; ++i)
+      fIdleStreams[i]->Flush();
+}
+
+bool PricerInputStream::EnableFollow()
+{
+#if !defined(_WIN32)
+   if ((!fCanBuffer) || (fUring) || (fExternal) || (fFollow))
+      return false;
+
+   fFollow = true;
+
+#if defined(__linux__)
+   // Find the file's name so we can watch for rotation and reopen it.
+   char procPath[64];
+   char path[PATH_MAX];
+   sprintf(procPath,"/proc/self/fd/%d",fFileNum);
+   xplat_ssize_t length = readlink(procPath,path,sizeof(path) - 1);
+   if ((length <= 0) || (path[0] != '/'))
+      return true;
+
+   path[length] = 0;
+   fFollowPath  = path;
+
+   // Without inotify we still work - just by polling.
+   fNotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (fNotifyFd >= 0)
+   {
+      std::string dir = fFollowPath.substr(0,fFollowPath.rfind('/') + 1);
+      inotify_add_watch(fNotifyFd, path, 
+                        IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                        IN_MOVE_SELF | IN_DELETE_SELF);
+      inotify_add_watch(fNotifyFd, dir.c_str(), IN_CREATE | IN_MOVED_TO);
+   }
+#endif
+   return true;
+#else
+   return false;
+#endif
+}
+
+bool PricerInputStream::ReopenRotated()
+{
+#if defined(__linux__)
+   if (fFollowPath.empty())
+      return false;
+
+   // Nothing there (mid-rotation) or still the same file - keep going.
+   struct stat pathInfo;
+   struct stat fileInfo;
+   if ((0 != stat(fFollowPath.c_str(),&pathInfo)) ||
+       (0 != fstat(fFileNum,&fileInfo))           ||
+       ((pathInfo.st_dev == fileInfo.st_dev) && 
+        (pathInfo.st_ino == fileInfo.st_ino)))
+   {
+      return false;
+   }
+
+   // Keep our fd number (it may well be stdin).
+   int newFile = open(fFollowPath.c_str(),O_RDONLY);
+   if (newFile < 0)
+      return false;
+
+   bool ok = (dup2(newFile,fFileNum) >= 0);
+   close(newFile);
+   if (!ok)
+      return false;
+
+   fStartPos  = 0;
+   fCurEndPos = 0;
+
+   if (fNotifyFd >= 0)
+   {
+      inotify_add_watch(fNotifyFd, fFollowPath.c_str(),
+                        IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                        IN_MOVE_SELF | IN_DELETE_SELF);
+   }
+   return true;
+#else
+   return false;
+#endif
+}
+
+bool PricerInputStream::WaitForGrowth()
+{
+#if !defined(_WIN32)
+   for (;;)
+   {
+      struct xplat_stat fileInfo;
+      if (0 != xplat_fstat(fFileNum,&fileInfo))
+      {
+         fStreamError = true;
+         return false;
+      }
+
+      // Truncated under us - start over from the top.
+      if (fileInfo.st_size < fStartPos)
+      {
+         if (-1 == xplat_lseek(fFileNum,0,SEEK_SET))
+         {
+            fStreamError = true;
+            return false;
+         }
+         fStartPos = 0;
+      }
+
+      fCurEndPos = fileInfo.st_size;
+      if (fCurEndPos > fStartPos)
+         return true;
+
+      // All read - if the name is a new file now, move on to it.
+      if (ReopenRotated())
+         continue;
+
+      // Get everything out before we sleep, then wait for a change.
+      // Events that land after the fstat() above wake the poll.
+      FlushIdleStreams();
+
+      struct pollfd notify;
+      notify.fd      = fNotifyFd;
+      notify.events  = POLLIN;
+      notify.revents = 0;
+      poll(&notify, 1, PRICER_FOLLOW_POLL_MSEC);
+
+#if defined(__linux__)
+      if (fNotifyFd >= 0)
+      {
+         char events[4096];
+         while (read(fNotifyFd,events,sizeof(events)) > 0);
+      }
+#endif
+   }
+#else
+   return false;
+#endif
+}
+
+bool PricerInputStream::SetBusyPoll()
+{
+#if !defined(_WIN32)
+   if ((!fIsStream) || (fUring) || (fBusyPoll) || (fDecompressor))
+      return false;
+
+   int flags = fcntl(fFileNum,F_GETFL);
+   if (flags < 0)
+      return false;
+
+   if (0 == (flags & O_NONBLOCK))
+   {
+      if (0 != fcntl(fFileNum,F_SETFL,flags | O_NONBLOCK))
+         return false;
+      fSavedFlags = flags;
+   }
+
+   fBusyPoll = true;
+   return true;
+#else
+   return false;
+#endif
+}
+
+void PricerInputStream::Prefault()
+{
+   if (fUring)
+   {
+      PricerSysPrefault(fUringBufs[0],fBufferSize);
+      PricerSysPrefault(fUringBufs[1],fBufferSize);
+   }
+   else if (fBuffer)
+   {
+      PricerSysPrefault(fBuffer,fBufferSize);
+   }
+}
+
+bool PricerInputStream::EnableUring()
+{
+#if (PRICER_USE_IO_URING > 0)
+   if ((fUring) || (fBusyPoll) || (fFollow) || (fDecompressor) || 
+       !(fCanBuffer | fIsStream))
+      return false;
+
+   PricerUring* uring = new PricerUring();
+   char* altBuffer = new char[fBufferSize];
+
+   struct iovec iovs[2];
+   iovs[0].iov_base = fBuffer;
+   iovs[0].iov_len  = fBufferSize;
+   iovs[1].iov_base = altBuffer;
+   iovs[1].iov_len  = fBufferSize;
+
+   if ((!uring->Init(4)) || (!uring->RegisterBuffers(iovs,2)))
+   {
+      delete uring;
+      delete [] altBuffer;
+      return false;
+   }
+
+   fUring        = uring;
+   fUringBufs[0] = fBuffer;
+   fUringBufs[1] = altBuffer;
+
+   // Start the first read right away.
+   SubmitUringRead(1);
+   return true;
+#else
+   return false;
+#endif
+}
+
+void PricerInputStream::SubmitUringRead(int bufIndex)
+{
+#if (PRICER_USE_IO_URING > 0)
+   PXInt64      offset  = -1;
+   unsigned int readLen = (unsigned int)fBufferSize;
+
+   fReadBuf = -1;
+   if (fCanBuffer)
+   {
+      // Regular file - read at explicit offsets up to the known end.
+      PXInt64 amountLeft = fCurEndPos - fStartPos;
+      if (amountLeft <= 0)
+         return;
+      if (amountLeft < fBufferSize)
+         readLen = (unsigned int)amountLeft;
+      offset = fStartPos;
+   }
+
+   if (fUring->SubmitRead(fFileNum, bufIndex, fUringBufs[bufIndex],
+                          readLen, offset, (PXUInt64)bufIndex))
+   {
+      fReadBuf = bufIndex;
+   }
+   else
+   {
+      fStreamError = true;
+   }
+#endif
+}
+
+bool PricerInputStream::RefreshCacheUring()
+{
+#if (PRICER_USE_IO_URING > 0)
+   if (fReadBuf < 0)
+   {
+      // Nothing in flight - we hit the end (or failed to submit).
+      fAtEndOfFile = !fStreamError;
+      return false;
+   }
+
+   CheckIdle(fUring->HasCompletion());
+
+   PXUInt64 userData = 0;
+   int      res      = 0;
+   if (!fUring->WaitCompletion(userData,res))
+   {
+      fStreamError = true;
+      return false;
+   }
+
+   int doneBuf = fReadBuf;
+   fReadBuf = -1;
+
+   if (res <= 0)
+   {
+      fAtEndOfFile = (res == 0);
+      fStreamError = !fAtEndOfFile;
+      return false;
+   }
+
+   fStartPos += res;
+   if (fIsStream)
+      fCurEndPos = fStartPos;
+
+   fBuffer       = fUringBufs[doneBuf];
+   fBufferPos    = fBuffer;
+   fEndBufferPos = fBufferPos + res;
+
+   // Get the next block coming into the buffer we just finished.
+   SubmitUringRead(doneBuf ^ 1);
+   return true;
+#else
+   return false;
+#endif
+}
+
+void PricerInputStream::SetBuffer(const char* data, int length)
+{
+   fExternal      = true;
+   fCanBuffer     = false;
+   fIsStream      = false;
+   fBufferPos     = (char*)data;
+   fEndBufferPos  = fBufferPos + length;
+   fAtEndOfFile   = false;
+   fInvalidParse  = false;
+   fStreamError   = false;
+}
+
+bool PricerInputStream::SeekTo(PXInt64 offset)
+{
+   if ((fUring) || (offset < 0))
+      return false;
+
+   if (fCanBuffer)
+   {
+      if ((offset > fCurEndPos) || 
+          (-1 == xplat_lseek(fFileNum,offset,SEEK_SET)))
+      {
+         return false;
+      }
+      fStartPos     = offset;
+      fBufferPos    = fBuffer;
+      fEndBufferPos = fBuffer;
+      return true;
+   }
+
+   if ((!fIsStream) || (offset < GetOffset()))
+      return false;
+
+   while (fStartPos < offset)
+   {
+      fBufferPos = fEndBufferPos;
+      if (!RefreshCache())
+         return false;
+   }
+   fBufferPos = fEndBufferPos - (fStartPos - offset);
+   return true;
+}
+
 bool PricerInputStream::RefreshCache()
 {
+   // Caller's memory is all there is.
+   if (fExternal)
+   {
+      fAtEndOfFile = true;
+      return false;
+   }
+
+   if (fUring)
+      return RefreshCacheUring();
+
+   if (fIsStream)
+   {
+#if (PRICER_USE_DECOMPRESS > 0)
+      // Parse the next decompressed block where it is.
+      if (fDecompressor)
+      {
+         char* data   = 0;
+         int   length = 0;
+         if (!fDecompressor->NextBlock(data,length))
+         {
+            // Corrupt or truncated data ends the input too - there's
+            // no resyncing inside a compressed stream.
+            fStreamError = fDecompressor->HadError();
+            fAtEndOfFile = true;
+            return false;
+         }
+
+         fStartPos    += length;
+         fCurEndPos    = fStartPos;
+         fBufferPos    = data;
+         fEndBufferPos = data + length;
+         return true;
+      }
+#endif
+
+      CheckIdle(false);
+
+      xplat_ssize_t res = xplat_read(fFileNum, fBuffer, fBufferSize);
+      
+      // Busy-polling - spin until something shows up.
+      while ((res < 0) && (fBusyPoll) && 
+             ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+      {
+         xplat_cpu_relax();
+         res = xplat_read(fFileNum, fBuffer, fBufferSize);
+      }
+
+      if (res <= 0)
+      {
+         fAtEndOfFile = (errno == EOF) || (res == 0);
+         fStreamError = !fAtEndOfFile;
+         return false;
+      }
+
+      fStartPos += res;
+      fCurEndPos = fStartPos;
+
+      fBufferPos    = fBuffer;
+      fEndBufferPos = fBufferPos + res;
+      return true;
+   }
+
    if (!fCanBuffer)
       return false;
 
+   // Following - wait for the file to grow rather than stop.
+   if ((fFollow) && (fCurEndPos <= fStartPos) && (!WaitForGrowth()))
+      return false;
+
    PXInt64 amountLeft = fCurEndPos - fStartPos;
    int readSize;
 
@@ -365,6 +949,14 @@ bool PricerInputStream::RefreshCache()
    }
    
    xplat_ssize_t res = xplat_read(fFileNum, fBuffer, readSize);
+
+   // Shrunk between the size check and the read.
+   if ((res == 0) && (fFollow))
+   {
+      fCurEndPos = fStartPos;
+      return RefreshCache();
+   }
+
    if (res <= 0)
    {
       fAtEndOfFile = (errno == EOF) || (res == 0);
@@ -389,7 +981,25 @@ PricerOutputStream::PricerOutputStream(int fileNum, int maxBufSize)
   fBuffer(0),
   fBufPtr(0),
   fBufEndPtr(0),
-  fBufferSize(maxBufSize)
+  fBufferSize(maxBufSize),
+  fBatchLatency(0),
+  fBatchStart(0),
+  fUring(0),
+  fCurBuf(0),
+  fWritePtr(0),
+  fWriteLen(0),
+  fMapped(false),
+  fMapFd(-1),
+  fHeapBuffer(0),
+  fMapOffset(0),
+  fMapSize(0),
+  fWriteFunc(0),
+  fWriteContext(0),
+  fUseCallback(false),
+  fCounters()
+#if (PRICER_LATENCY_STATS > 0)
+  ,fLatency(0)
+#endif
 {
    if (fBufferSize <= 1)
       fBufferSize = 1;
@@ -417,7 +1027,347 @@ PricerOutputStream::PricerOutputStream(int fileNum, int maxBufSize)
 }
 PricerOutputStream::~PricerOutputStream()
 {
+   if (fMapped)
+      CloseMappedFile();
+
+   Flush();
+#if (PRICER_USE_IO_URING > 0)
+   if (fUring)
+   {
+      WaitUringWrite();
+      delete fUring;
+      delete [] fUringBufs[0];
+      delete [] fUringBufs[1];
+      return;
+   }
+#endif
+   delete [] fBuffer;
+}
+
+void PricerOutputStream::SetLineFlush()
+{
+   Flush();
+   fCanBuffer    = false;
+   fBatchLatency = 0;
+   fBatchStart   = 0;
+}
+
+void PricerOutputStream::SetWriteCallback(PricerStreamWriteFunc writeFunc,
+                                          void*                 context,
+                                          int                   bufSize)
+{
+   // Callback streams are set up before use, never
+   // switched over from mapped/async output.
+   if (fMapped || fUring)
+      return;
+
    Flush();
+
+   if (bufSize < 256)
+      bufSize = 256;
+
+   fUseCallback  = true;
+   fWriteFunc    = writeFunc;
+   fWriteContext = context;
+   fCanBuffer    = true;
+   fBatchLatency = 0;
+   fBatchStart   = 0;
+
+   delete [] fBuffer;
+   fBuffer     = new char[bufSize];
+   fBuffer[0]  = 0;
+   fBufPtr     = fBuffer;
+   fBufEndPtr  = fBuffer + bufSize;
+   fBufferSize = bufSize;
+}
+
+void PricerOutputStream::Prefault()
+{
+   if (fUring)
+   {
+      PricerSysPrefault(fUringBufs[0],fBufEndPtr - fBuffer);
+      PricerSysPrefault(fUringBufs[1],fBufEndPtr - fBuffer);
+   }
+   else
+   {
+      PricerSysPrefault(fBuffer,fBufEndPtr - fBuffer);
+   }
+}
+
+bool PricerOutputStream::EnableMappedFile()
+{
+#if !defined(_WIN32)
+   if ((!fCanBuffer) || fMapped || fUring || fUseCallback)
+      return false;
+
+   Flush();
+
+   // Appending streams write at the end, wherever the offset is.
+   int flags = fcntl(fFileNum,F_GETFL);
+   PXInt64 pos = xplat_lseek(fFileNum, 0, 
+                   ((flags >= 0) && (flags & O_APPEND)) ? SEEK_END : SEEK_CUR);
+   if (pos < 0)
+      return false;
+
+   // Shared mappings need a readable fd, and stdout is usually 
+   // redirected write-only. Reopen it read/write if so.
+   fMapFd = fFileNum;
+   if ((flags < 0) || ((flags & O_ACCMODE) != O_RDWR))
+   {
+#if defined(__linux__)
+      char path[64];
+      sprintf(path,"/proc/self/fd/%d",fFileNum);
+      fMapFd = open(path,O_RDWR);
+#else
+      fMapFd = -1;
+#endif
+      if (fMapFd < 0)
+      {
+         fMapFd = -1;
+         return false;
+      }
+   }
+
+   fHeapBuffer = fBuffer;
+   fMapSize    = PRICER_MMAP_WINDOW;
+   if (!MapWindow(pos))
+   {
+      if (fMapFd != fFileNum)
+         close(fMapFd);
+      fMapFd  = -1;
+      fBuffer = fHeapBuffer;
+      fBufPtr = fBuffer;
+      fBufEndPtr = fBuffer + fBufferSize;
+      return false;
+   }
+
+   fMapped = true;
+   return true;
+#else
+   return false;
+#endif
+}
+
+bool PricerOutputStream::MapWindow(PXInt64 pos)
+{
+#if !defined(_WIN32)
+   PXInt64 pageSize = (PXInt64)sysconf(_SC_PAGESIZE);
+   PXInt64 start    = pos - (pos % pageSize);
+
+   // Reserve the blocks up front so we never take a SIGBUS on a full
+   // disk while formatting into the mapping.
+#if defined(__linux__)
+   if (0 != fallocate(fMapFd,0,start,fMapSize))
+#else
+   if (0 != posix_fallocate(fMapFd,start,fMapSize))
+#endif
+      return false;
+
+   void* mapping = mmap(0, (size_t)fMapSize, PROT_READ|PROT_WRITE,
+                        MAP_SHARED, fMapFd, start);
+   if (MAP_FAILED == mapping)
+      return false;
+
+   fMapOffset = start;
+   fBuffer    = (char*)mapping;
+   fBufPtr    = fBuffer + (pos - start);
+   fBufEndPtr = fBuffer + fMapSize;
+   return true;
+#else
+   return false;
+#endif
+}
+
+void PricerOutputStream::UnmapWindow()
+{
+#if !defined(_WIN32)
+   // Start writeback, but don't wait for it.
+   msync(fBuffer,(size_t)fMapSize,MS_ASYNC);
+   munmap(fBuffer,(size_t)fMapSize);
+#endif
+}
+
+void PricerOutputStream::AdvanceWindow()
+{
+   PXInt64 nextPos = fMapOffset + fMapSize;
+   UnmapWindow();
+
+   if (fMapSize < PRICER_MMAP_MAX_WINDOW)
+      fMapSize *= 2;
+
+   if (MapWindow(nextPos))
+      return;
+
+   // Couldn't map the next window - drop back to plain writes
+   // from where we are.
+   fMapped = false;
+#if !defined(_WIN32)
+   if (0 != ftruncate(fMapFd,nextPos))
+      fWriteError = true;
+   if (fMapFd != fFileNum)
+      close(fMapFd);
+#endif
+   fMapFd = -1;
+   xplat_lseek(fFileNum,nextPos,SEEK_SET);
+
+   fBuffer    = fHeapBuffer;
+   fBufPtr    = fBuffer;
+   fBufEndPtr = fBuffer + fBufferSize;
+}
+
+void PricerOutputStream::CloseMappedFile()
+{
+   PXInt64 length = fMapOffset + (PXInt64)(fBufPtr - fBuffer);
+   UnmapWindow();
+   fMapped = false;
+
+#if !defined(_WIN32)
+   // Trim the preallocated tail.
+   if (0 != ftruncate(fMapFd,length))
+      fWriteError = true;
+   if (fMapFd != fFileNum)
+      close(fMapFd);
+#endif
+   fMapFd = -1;
+   xplat_lseek(fFileNum,length,SEEK_SET);
+
+   fBuffer    = fHeapBuffer;
+   fBufPtr    = fBuffer;
+   fBufEndPtr = fBuffer + fBufferSize;
+}
+
+bool PricerOutputStream::EnableUring()
+{
+#if (PRICER_USE_IO_URING > 0)
+   if (fUring || fMapped || fUseCallback)
+      return false;
+
+   int   bufSize   = (int)(fBufEndPtr - fBuffer);
+   PricerUring* uring = new PricerUring();
+   char* altBuffer = new char[bufSize];
+
+   struct iovec iovs[2];
+   iovs[0].iov_base = fBuffer;
+   iovs[0].iov_len  = bufSize;
+   iovs[1].iov_base = altBuffer;
+   iovs[1].iov_len  = bufSize;
+
+   if ((!uring->Init(4)) || (!uring->RegisterBuffers(iovs,2)))
+   {
+      delete uring;
+      delete [] altBuffer;
+      return false;
+   }
+
+   fUring        = uring;
+   fUringBufs[0] = fBuffer;
+   fUringBufs[1] = altBuffer;
+   fCurBuf       = 0;
+   return true;
+#else
+   return false;
+#endif
+}
+
+void PricerOutputStream::WaitUringWrite()
+{
+#if (PRICER_USE_IO_URING > 0)
+   if (0 == fWritePtr)
+      return;
+
+   PXUInt64 userData = 0;
+   int      res      = -1;
+   if (!fUring->WaitCompletion(userData,res))
+      res = -1;
+
+   if (res < 0)
+      fWriteError = true;
+   else if (res < fWriteLen)
+      WriteAll(fWritePtr + res, fWriteLen - res);
+
+   fWritePtr = 0;
+   fWriteLen = 0;
+#endif
+}
+
+void PricerOutputStream::FlushUring(const char* extra, int extraLen)
+{
+#if (PRICER_USE_IO_URING > 0)
+   int bufSize = (int)(fBufPtr - fBuffer);
+   fBatchStart = 0;
+
+   if (bufSize)
+   {
+      // One write in flight at a time keeps the output in order.
+      WaitUringWrite();
+
+      if (fUring->SubmitWrite(fFileNum, fCurBuf, fBuffer, bufSize, -1,
+                              (PXUInt64)fCurBuf))
+      {
+         fWritePtr = fBuffer;
+         fWriteLen = bufSize;
+
+         // Carry on in the other buffer while that one goes out.
+         int bufLen = (int)(fBufEndPtr - fBuffer);
+         fCurBuf    ^= 1;
+         fBuffer     = fUringBufs[fCurBuf];
+         fBufEndPtr  = fBuffer + bufLen;
+      }
+      else
+      {
+         WriteAll(fBuffer,bufSize);
+      }
+      fBufPtr = fBuffer;
+   }
+
+   if (extraLen)
+   {
+      WaitUringWrite();
+      WriteAll(extra,extraLen);
+   }
+#endif
+}
+
+
+void PricerOutputStream::SetBatching(int maxBytes, int latencyUsec)
+{
+   // Regular files are already fully buffered.
+   if (fCanBuffer)
+      return;
+
+   Flush();
+
+   // The io_uring buffers are registered at their current size.
+   if (fUring)
+      return;
+
+   int bufSize = 256;
+   fBatchLatency = 0;
+   fBatchStart   = 0;
+
+#if !defined(_WIN32)
+   // No cheap idle check on win32, so never hold quotes there.
+   if ((latencyUsec > 0) && (maxBytes > bufSize))
+   {
+      bufSize       = maxBytes;
+      fBatchLatency = (PXUInt64)latencyUsec;
+   }
+#endif
+
+   delete [] fBuffer;
+   fBuffer    = new char[bufSize];
+   fBuffer[0] = 0;
+   fBufPtr    = fBuffer;
+   fBufEndPtr = fBufPtr+bufSize;
+}
+
+void PricerOutputStream::FlushIfExpired()
+{
+   if ((fBatchStart != 0) && 
+       (xplat_usec() - fBatchStart >= fBatchLatency))
+   {
+      Flush();
+   }
 }
 
 PricerOutputStream& PricerOutputStream::operator <<(char c)
@@ -432,7 +1382,22 @@ PricerOutputStream& PricerOutputStream::operator <<(char c)
    else if (!fCanBuffer)
    {
       if (c == '\n')
-         Flush();
+      {
+         if (0 == fBatchLatency)
+         {
+            Flush();
+         }
+         else
+         {
+            // Batching - hold the quote unless the oldest one 
+            // we're holding has used up its latency budget.
+            PXUInt64 now = xplat_usec();
+            if (0 == fBatchStart)
+               fBatchStart = now;
+            else if (now - fBatchStart >= fBatchLatency)
+               Flush();
+         }
+      }
    }
    
    return *this;
@@ -440,19 +1405,122 @@ PricerOutputStream& PricerOutputStream::operator <<(char c)
 
 void PricerOutputStream::Flush()
 {
+   FlushWith(0,0);
+}
+
+void PricerOutputStream::FlushWith(const char* extra, int extraLen)
+{
+#if (PRICER_LATENCY_STATS > 0)
+   if ((fLatency) && ((fBufPtr != fBuffer) || (extraLen > 0)))
+   {
+      PricerLatencyStats* stats = fLatency;
+      PXUInt64            start = xplat_ticks();
+      fLatency = 0;
+      FlushWith(extra,extraLen);
+      fLatency = stats;
+      stats->RecordWrite(xplat_ticks() - start);
+      return;
+   }
+#endif
+
+   // Mapped output is already in the file - only move on when
+   // the window is full.
+   if (fMapped)
+   {
+      if (fBufPtr == fBufEndPtr)
+         AdvanceWindow();
+      return;
+   }
+
+   PXUInt64 pending = (PXUInt64)(fBufPtr - fBuffer) + (PXUInt64)extraLen;
+   if (pending)
+   {
+      fCounters.fBytes += pending;
+      ++fCounters.fWrites;
+   }
+
+   if (fUseCallback)
+   {
+      int bufSize = (int)(fBufPtr - fBuffer);
+      fBufPtr = fBuffer;
+      if (fWriteFunc)
+      {
+         if ((bufSize) && (fWriteFunc(fWriteContext,fBuffer,bufSize) < 0))
+            fWriteError = true;
+         if ((extraLen) && (fWriteFunc(fWriteContext,extra,extraLen) < 0))
+            fWriteError = true;
+      }
+      return;
+   }
+
+   if (fUring)
+   {
+      FlushUring(extra,extraLen);
+      return;
+   }
+
    int   bufSize  = (int)(fBufPtr - fBuffer);
    char* startBuf = fBuffer;
 
-   if (!bufSize)
-      return;
-   
+   fBatchStart = 0;
+
+#if !defined(_WIN32)
+   // Gather buffer and extra into a single syscall.
+   if ((extraLen > 0) && (bufSize > 0))
+   {
+      struct iovec iov[2];
+      iov[0].iov_base = startBuf;
+      iov[0].iov_len  = bufSize;
+      iov[1].iov_base = (void*)extra;
+      iov[1].iov_len  = extraLen;
+
+      xplat_ssize_t res;
+      do
+      {
+         res = writev(fFileNum,iov,2);
+      } while ((res < 0) && (errno == EINTR));
+
+      if (res <= 0)
+      {
+         fWriteError = true;
+         fBufPtr     = fBuffer;
+         return;
+      }
+
+      if (res >= bufSize)
+      {
+         // Buffer's out, finish off any of extra left below.
+         res       -= bufSize;
+         bufSize    = 0;
+         extra     += res;
+         extraLen  -= (int)res;
+      }
+      else
+      {
+         startBuf += res;
+         bufSize  -= (int)res;
+      }
+   }
+#endif
+
    for(;;)
    {
+      if (!bufSize)
+      {
+         if (!extraLen)
+            break;
+
+         // Buffer's done, move on to the extra data.
+         startBuf = (char*)extra;
+         bufSize  = extraLen;
+         extraLen = 0;
+      }
+
       xplat_ssize_t res = xplat_write(fFileNum,startBuf,bufSize);
       if (res == bufSize)
       {
-         fBufPtr = fBuffer;
-         break;
+         bufSize = 0;
+         continue;
       }
 
       if (res <= 0)
@@ -465,6 +1533,22 @@ void PricerOutputStream::Flush()
       startBuf += res;
       bufSize -= (int)res;
    }
+   fBufPtr = fBuffer;
+}
+
+void PricerOutputStream::WriteAll(const char* data, int length)
+{
+   while (length > 0)
+   {
+      xplat_ssize_t res = xplat_write(fFileNum,data,length);
+      if (res <= 0)
+      {
+         fWriteError = true;
+         return;
+      }
+      data   += res;
+      length -= (int)res;
+   }
 }
 
 PricerOutputStream& PricerOutputStream::operator <<(PXUInt32 val)
@@ -494,6 +1578,14 @@ PricerOutputStream& PricerOutputStream::operator <<(const char* str)
       return *this;
    }
 
+   // Batching and it won't fit - write what we have
+   // along with the string in one go.
+   if (0 != fBatchLatency)
+   {
+      FlushWith(str,length);
+      return *this;
+   }
+
    while (*str != 0)
    {
       (*this) << *str;
@@ -6,9 +6,19 @@
 #define _PricerStream_H_
 
 #include "PricerXplat.h"
+#include "PricerDecompress.h"
+#include "PricerLatency.h"
+#include "PricerMetrics.h"
 #include <string>
 
 struct PricerOrder;
+class  PricerOutputStream;
+class  PricerUring;
+class  PricerDecompressor;
+
+/// Output callback for streams that deliver to the caller
+/// instead of a file. Returns < 0 on error.
+typedef int (*PricerStreamWriteFunc)(void* context, const char* data, int length);
 
 /// \class PricerInputStream
 /// \brief Input stream implementation for PricerOrder objects.
@@ -58,6 +68,73 @@ class PricerInputStream
       /// Returns true on success.
       bool RefreshCache();
 
+      /// Registers an output stream to be flushed whenever the input
+      /// runs dry (i.e. the next read would block). Used with batched
+      /// output so held quotes go out as soon as the feed goes idle.
+      /// Up to kMaxIdleStreams may be registered.
+      void AddIdleFlush(PricerOutputStream* outStream);
+
+      static const int kMaxIdleStreams = 2;
+
+      /// Switches the stream to the io_uring backend: two registered
+      /// buffers, with the next block read in flight while the current
+      /// one is parsed.  Call before reading.  Returns false (and stays
+      /// synchronous) if io_uring isn't available.
+      bool EnableUring();
+
+      /// Latency mode for pipes/sockets: puts the fd in non-blocking
+      /// mode and spins on read() instead of sleeping in it, so there's
+      /// no scheduler wakeup between a message arriving and parsing it.
+      /// Returns false if the input isn't a pipe/socket.
+      bool SetBusyPoll();
+
+      /// Touches the buffer pages so they're resident before use.
+      void Prefault();
+
+      /// Checks the input's first bytes for gzip/zstd magic and, if it's
+      /// compressed, has it decompressed on a background thread into a
+      /// ring of blocks that are parsed in place.  Call before reading.
+      ///
+      /// \param readerCpu CPU to pin the thread to, or -1.
+      ///
+      /// \return The compression found.  If it's not kPC_None but
+      ///         IsDecompressing() is false, this build can't read it.
+      ePricerCompression EnableDecompress(int readerCpu = -1);
+
+      /// True if the input is being decompressed.
+      bool IsDecompressing() const { return (0 != fDecompressor); }
+
+      /// CPU the decompressing thread is pinned to, and the NUMA node
+      /// its ring is on - -1 for either if not.
+      void GetReaderPlacement(int& cpu, int& node) const;
+
+      /// For regular files: keeps the buffered file path but, like
+      /// tail -F, waits for more data at the end instead of stopping.
+      /// The file is reopened by name if it's rotated, and reread from
+      /// the start if it's truncated.  Idle-flush streams are flushed
+      /// before each wait.  Returns false if the input isn't a regular
+      /// file or follow isn't supported (Windows).
+      bool EnableFollow();
+
+      /// Points the stream at caller-owned memory instead of a file.
+      /// The data isn't copied and must stay valid while it's parsed;
+      /// the stream reports eof() when it's used up.  Construct with
+      /// maxBufferSize 0 for this.
+      void SetBuffer(const char* data, int length);
+
+      /// True if all data in the buffer has been consumed.
+      bool IsBufferEmpty() const { return (fBufferPos == fEndBufferPos); }
+
+      /// Position of the next unread byte: the file offset for regular
+      /// files, bytes consumed so far for pipes/sockets.
+      PXInt64 GetOffset() const 
+         { return fStartPos - (PXInt64)(fEndBufferPos - fBufferPos); }
+
+      /// Moves to offset (as from GetOffset()) before reading resumes.
+      /// Regular files seek; pipes/sockets read and discard up to it,
+      /// for restarts fed the same stream again.  Call before 
+      /// EnableUring(). Returns false if offset can't be reached.
+      bool SeekTo(PXInt64 offset);
 
    protected:
       /// Get the next character. set error flags.
@@ -67,6 +144,25 @@ class PricerInputStream
       /// Unbuffered version
       xplat_inline bool GetUnbufferedChar(char& val);
 
+      /// Flushes idle-flush streams if the input has nothing ready.
+      /// dataReady is whether the next read is known not to block.
+      void CheckIdle(bool dataReady);
+
+      /// Flushes every idle-flush stream.
+      void FlushIdleStreams();
+
+      /// Follow mode: waits until there's more of the file to read,
+      /// handling truncation and rotation. Returns false on error.
+      bool WaitForGrowth();
+
+      /// Follow mode: if the path now names a different file, switches
+      /// fFileNum over to it.  Returns true if it did.
+      bool ReopenRotated();
+
+      /// io_uring versions of RefreshCache()'s read.
+      bool RefreshCacheUring();
+      void SubmitUringRead(int bufIndex);
+
       /// Mainly for Win32 - if you set a stdin handle
       /// to binary twice, it throws an exception.
       static bool sHasSetStdIn;
@@ -80,6 +176,8 @@ class PricerInputStream
 
       bool     fCanBuffer;    ///< True if it's a regular file and 
                               ///< we can fully buffer it.
+      bool     fIsStream;     ///< True if it's a pipe/socket/tty that
+                              ///< we read in whatever chunks are ready.
 
       char*    fBuffer;       ///< Input buffer
       char*    fBufferPos;    ///< Position within input buffer
@@ -89,11 +187,33 @@ class PricerInputStream
 
       PXInt64  fStartPos;     ///< Current starting file position in buffer.
       PXInt64  fCurEndPos;    ///< Current known ending file position
+
+      /// Output streams to flush when input goes idle.
+      PricerOutputStream* fIdleStreams[kMaxIdleStreams];
+      int                 fNumIdleStreams;
+
+      PricerUring*        fUring;          ///< io_uring backend, or 0.
+      char*               fUringBufs[2];   ///< Registered double buffers.
+      int                 fReadBuf;        ///< Buffer w/ read in flight, or -1.
+
+      bool                fBusyPoll;       ///< Spinning on a non-blocking fd.
+      int                 fSavedFlags;     ///< fd flags to restore, or -1.
+
+      bool                fExternal;       ///< Reading caller's memory.
+
+      bool                fFollow;         ///< Waiting at end of file.
+      std::string         fFollowPath;     ///< Followed file's name.
+      int                 fNotifyFd;       ///< inotify fd, or -1.
+
+      PricerDecompressor* fDecompressor;   ///< Compressed input, or 0.
    private:
       /// Not implemented.
       PricerInputStream(const PricerInputStream&)
       : fFileNum(0),fInvalidParse(false),fStreamError(false),fAtEndOfFile(false),fCanBuffer(false),
-        fBuffer(0),fBufferPos(0),fEndBufferPos(0),fBufferSize(0),fStartPos(0),fCurEndPos(0)
+        fIsStream(false),fBuffer(0),fBufferPos(0),fEndBufferPos(0),fBufferSize(0),fStartPos(0),
+        fCurEndPos(0),fNumIdleStreams(0),fUring(0),fReadBuf(-1),
+        fBusyPoll(false),fSavedFlags(-1),fExternal(false),fFollow(false),fFollowPath(),
+        fNotifyFd(-1),fDecompressor(0)
       {throw;}
       
       /// Not implemented.
@@ -119,7 +239,85 @@ class PricerOutputStream
       PricerOutputStream& operator <<(const char* str);
 
       void Flush();
+
+      /// Enables latency-bounded batching when the stream is not a
+      /// regular file (pipes, sockets, ttys).  Quotes are held until
+      /// maxBytes are pending or the oldest held quote is latencyUsec
+      /// old, whichever comes first.  latencyUsec <= 0 restores the
+      /// default flush-per-line behavior.
+      void SetBatching(int maxBytes, int latencyUsec);
+
+      /// Flushes if batching and the oldest held quote has expired.
+      void FlushIfExpired();
+
+      /// True if there is unwritten data in the buffer.
+      bool HasPending() const { return (fBufPtr != fBuffer); }
+
+      /// Switches flushes to the io_uring backend: the full buffer is
+      /// submitted asynchronously and we carry on in a second registered
+      /// buffer.  Call after SetBatching(). Returns false (and stays 
+      /// synchronous) if io_uring isn't available.
+      bool EnableUring();
+
+      /// For regular files: preallocates the file and formats output
+      /// directly into a mapped window of it, moving on to a larger
+      /// window when one fills.  The file is truncated to the exact
+      /// length written when the stream is destroyed.
+      /// Returns false (and stays on write()) if it can't be mapped.
+      bool EnableMappedFile();
+
+      /// Writes every line out as soon as it's complete, even to a
+      /// regular file (latency mode).  Overrides SetBatching().
+      void SetLineFlush();
+
+      /// Touches the buffer pages so they're resident before use.
+      void Prefault();
+
+      /// True if any write has failed.
+      bool HadWriteError() const { return fWriteError; }
+
+      /// Delivers output to writeFunc instead of the file, buffering
+      /// up to bufSize bytes between calls.  A null writeFunc discards.
+      void SetWriteCallback(PricerStreamWriteFunc writeFunc,
+                            void*                 context,
+                            int                   bufSize);
+
+      /// Bytes and writes so far.  Mapped output never goes through a
+      /// write, so isn't counted.
+      const PricerStreamCounters& GetCounters() const { return fCounters; }
+
+#if (PRICER_LATENCY_STATS > 0)
+      /// Times each write of the buffer into stats.
+      void SetLatencyStats(PricerLatencyStats* stats) { fLatency = stats; }
+#endif
+
    protected:
+      /// Maps a window of the file starting at the page holding pos.
+      bool MapWindow(PXInt64 pos);
+
+      /// Async-syncs and unmaps the current window.
+      void UnmapWindow();
+
+      /// Moves on to the next (larger) window once the current is full.
+      void AdvanceWindow();
+
+      /// Unmaps, truncates to the written length and restores the 
+      /// file position.  Back to the heap buffer afterwards.
+      void CloseMappedFile();
+
+      /// Writes the buffer followed by extra in one call if possible.
+      void FlushWith(const char* extra, int extraLen);
+
+      /// io_uring flush - submits the buffer and swaps to the other one.
+      void FlushUring(const char* extra, int extraLen);
+
+      /// Waits for the in-flight io_uring write, finishing it 
+      /// synchronously if it was short.
+      void WaitUringWrite();
+
+      /// Synchronous write of the whole block.
+      void WriteAll(const char* data, int length);
+
       bool                 fCanBuffer;
       bool                 fWriteError;
       int                  fFileNum;
@@ -129,10 +327,36 @@ class PricerOutputStream
       char*                fBufEndPtr;
 
       int                  fBufferSize;
+
+      PXUInt64             fBatchLatency;  ///< usec, 0 if not batching.
+      PXUInt64             fBatchStart;    ///< usec of oldest held quote.
+
+      PricerUring*         fUring;          ///< io_uring backend, or 0.
+      char*                fUringBufs[2];   ///< Registered double buffers.
+      int                  fCurBuf;         ///< Index of fBuffer in fUringBufs.
+      const char*          fWritePtr;       ///< In-flight write data, or 0.
+      int                  fWriteLen;       ///< In-flight write length.
+
+      bool                 fMapped;         ///< Formatting into a mapping.
+      int                  fMapFd;          ///< Read/write fd for the mapping.
+      char*                fHeapBuffer;     ///< Buffer to return to on close.
+      PXInt64              fMapOffset;      ///< File offset of fBuffer.
+      PXInt64              fMapSize;        ///< Size of current window.
+
+      PricerStreamWriteFunc fWriteFunc;     ///< Callback output, or 0.
+      void*                fWriteContext;   ///< Context for fWriteFunc.
+      bool                 fUseCallback;    ///< Deliver to fWriteFunc.
+      PricerStreamCounters fCounters;
+#if (PRICER_LATENCY_STATS > 0)
+      PricerLatencyStats*  fLatency;        ///< Write timings, or 0.
+#endif
    private:
       /// Not implemented.
       PricerOutputStream(const PricerOutputStream&)
-      : fCanBuffer(false),fWriteError(false),fFileNum(0),fBuffer(0),fBufPtr(0),fBufEndPtr(0),fBufferSize(0)
+      : fCanBuffer(false),fWriteError(false),fFileNum(0),fBuffer(0),fBufPtr(0),fBufEndPtr(0),fBufferSize(0),
+        fBatchLatency(0),fBatchStart(0),fUring(0),fCurBuf(0),fWritePtr(0),fWriteLen(0),
+        fMapped(false),fMapFd(-1),fHeapBuffer(0),fMapOffset(0),fMapSize(0),
+        fWriteFunc(0),fWriteContext(0),fUseCallback(false),fCounters()
       {throw;}
       
       /// Not implemented.
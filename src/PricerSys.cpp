@@ -0,0 +1,321 @@
+/// \file  PricerSys.cpp
+/// \brief System tuning helpers (CPU pinning, memory locking, pre-faulting).
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+   #define _GNU_SOURCE
+#endif
+
+#include "PricerSys.h"
+
+#if !defined(_WIN32)
+   #include <alloca.h>
+   #include <signal.h>
+   #include <sys/mman.h>
+#else
+   #include <malloc.h>
+   #include <windows.h>
+   #define alloca _alloca
+#endif
+#if defined(__linux__)
+   #include <sched.h>
+   #include <dirent.h>
+   #include <unistd.h>
+   #include <sys/syscall.h>
+   #include <linux/mempolicy.h>
+#endif
+
+bool PricerSysPinThread(int cpu)
+{
+#if defined(__linux__)
+   if (cpu < 0)
+      return false;
+
+   cpu_set_t cpus;
+   CPU_ZERO(&cpus);
+   CPU_SET(cpu,&cpus);
+   return (0 == sched_setaffinity(0,sizeof(cpus),&cpus));
+#else
+   return false;
+#endif
+}
+
+int PricerSysCpuNode(int cpu)
+{
+#if defined(__linux__)
+   if (cpu < 0)
+      return -1;
+
+   // The CPU's sysfs directory has a "nodeN" link to its node.
+   char path[64];
+   sprintf(path,"/sys/devices/system/cpu/cpu%d",cpu);
+   DIR* dir = opendir(path);
+   if (0 == dir)
+      return -1;
+
+   int node = -1;
+   struct dirent* entry;
+   while ((node < 0) && (0 != (entry = readdir(dir))))
+   {
+      if ((0 == strncmp(entry->d_name,"node",4)) &&
+          (entry->d_name[4] >= '0') && (entry->d_name[4] <= '9'))
+      {
+         node = atoi(entry->d_name + 4);
+      }
+   }
+   closedir(dir);
+   return node;
+#else
+   (void)cpu;
+   return -1;
+#endif
+}
+
+bool PricerSysLockMemory()
+{
+#if !defined(_WIN32)
+   return (0 == mlockall(MCL_CURRENT | MCL_FUTURE));
+#else
+   return false;
+#endif
+}
+
+void PricerSysPrefault(void* mem, size_t size)
+{
+   // Write, don't just read - reads may map the shared zero page.
+   volatile char* ptr = (volatile char*)mem;
+   for (size_t offset = 0; offset < size; offset += 4096)
+      ptr[offset] = ptr[offset];
+   if (size)
+      ptr[size-1] = ptr[size-1];
+}
+
+void PricerSysPrefaultStack(size_t size)
+{
+   volatile char* stack = (volatile char*)alloca(size);
+   for (size_t offset = 0; offset < size; offset += 4096)
+      stack[offset] = 0;
+}
+
+void* PricerSysAllocPages(size_t size, ePricerSysPages& pages, bool prefault)
+{
+#if defined(_WIN32)
+   // Large pages need SeLockMemoryPrivilege - not worth the setup.
+   pages = kPSP_Small;
+   void* mem = VirtualAlloc(0,size,MEM_COMMIT|MEM_RESERVE,PAGE_READWRITE);
+#else
+   const int prot  = PROT_READ | PROT_WRITE;
+   const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+   #if defined(MAP_HUGETLB)
+   if ((kPSP_Explicit == pages) && (0 == (size % kPricerSysHugePage)))
+   {
+      void* mem = mmap(0,size,prot,flags | MAP_HUGETLB,-1,0);
+      if (MAP_FAILED != mem)
+      {
+         if (prefault)
+            PricerSysPrefault(mem,size);
+         return mem;
+      }
+   }
+   #endif
+   if (kPSP_Explicit == pages)
+      pages = kPSP_Transparent;
+
+   // Transparent huge pages only back aligned 2 MB spans, so map
+   // extra and trim to the alignment.
+   size_t slack = (kPSP_Transparent == pages) ? kPricerSysHugePage : 0;
+   char*  mem   = (char*)mmap(0,size + slack,prot,flags,-1,0);
+   if (MAP_FAILED == mem)
+      return 0;
+
+   if (slack)
+   {
+      size_t head = (kPricerSysHugePage - 
+                     ((size_t)mem % kPricerSysHugePage)) % kPricerSysHugePage;
+      if (head)
+         munmap(mem,head);
+      if (slack - head)
+         munmap(mem + head + size,slack - head);
+      mem += head;
+
+      #if defined(MADV_HUGEPAGE)
+      // Before the first touch, or the pages are already small.
+      if (0 != madvise(mem,size,MADV_HUGEPAGE))
+         pages = kPSP_Small;
+      #else
+      pages = kPSP_Small;
+      #endif
+   }
+#endif
+
+   if ((mem) && (prefault))
+      PricerSysPrefault(mem,size);
+   return mem;
+}
+
+void PricerSysFreePages(void* mem, size_t size)
+{
+   if (0 == mem)
+      return;
+#if defined(_WIN32)
+   (void)size;
+   VirtualFree(mem,0,MEM_RELEASE);
+#else
+   munmap(mem,size);
+#endif
+}
+
+bool PricerSysBindMemory(void* mem, size_t size, int node)
+{
+#if defined(__linux__) && defined(__NR_mbind)
+   // Called directly - there's no libnuma dependency for one call.
+   const unsigned long kBits = 8 * sizeof(unsigned long);
+   unsigned long mask[4] = {0,0,0,0};
+   if ((0 == mem) || (node < 0) || (node >= (int)(4 * kBits)))
+      return false;
+
+   mask[node / kBits] = 1UL << (node % kBits);
+   size_t page = (size_t)sysconf(_SC_PAGESIZE);
+   size = (size + page - 1) & ~(page - 1);
+   return (0 == syscall(__NR_mbind, mem, size, MPOL_PREFERRED, mask,
+                        4 * kBits + 1, MPOL_MF_MOVE));
+#else
+   (void)mem;
+   (void)size;
+   (void)node;
+   return false;
+#endif
+}
+
+#if defined(__linux__)
+/// Reads "Name:   123 kB" from an smaps line, in bytes.
+static bool PricerSysSmapsField(const char* line, const char* name, 
+                                PXUInt64& bytes)
+{
+   size_t len = strlen(name);
+   if (0 != strncmp(line,name,len))
+      return false;
+   bytes = strtoull(line + len,0,10) * 1024;
+   return true;
+}
+#endif
+
+bool PricerSysPageMix(const PricerSysRegion* regions,
+                      size_t                 count,
+                      PXUInt64&              resident,
+                      PXUInt64&              huge)
+{
+   resident = 0;
+   huge     = 0;
+#if defined(__linux__)
+   FILE* smaps = fopen("/proc/self/smaps","r");
+   if (0 == smaps)
+      return false;
+
+   char line[512];
+   bool counting = false;
+   while (fgets(line,sizeof(line),smaps))
+   {
+      // Drop the rest of an overlong line (a long path).
+      if (0 == strchr(line,'\n'))
+      {
+         int c;
+         while (((c = fgetc(smaps)) != EOF) && (c != '\n'))
+            ;
+      }
+
+      // Fields are "Name: value kB"; anything else is a mapping's 
+      // header, "start-end perms offset dev inode [path]".
+      const char* space = strchr(line,' ');
+      if ((0 == space) || (space[-1] != ':'))
+      {
+         unsigned long long start = 0;
+         unsigned long long end   = 0;
+         counting = false;
+         if (2 != sscanf(line,"%llx-%llx",&start,&end))
+            continue;
+
+         for (size_t i = 0; (i < count) && (!counting); ++i)
+         {
+            PXUInt64 mem = (PXUInt64)(size_t)regions[i].fMem;
+            counting = (mem < end) && (mem + regions[i].fSize > start);
+         }
+         continue;
+      }
+
+      PXUInt64 bytes = 0;
+      if (!counting)
+         continue;
+
+      if (PricerSysSmapsField(line,"Rss:",bytes))
+      {
+         resident += bytes;
+      }
+      else if (PricerSysSmapsField(line,"AnonHugePages:",bytes))
+      {
+         huge += bytes;
+      }
+      else if ((PricerSysSmapsField(line,"Private_Hugetlb:",bytes)) ||
+               (PricerSysSmapsField(line,"Shared_Hugetlb:",bytes)))
+      {
+         // hugetlbfs pages aren't in Rss.
+         resident += bytes;
+         huge     += bytes;
+      }
+   }
+   fclose(smaps);
+   return true;
+#else
+   (void)regions;
+   (void)count;
+   return false;
+#endif
+}
+
+#if !defined(_WIN32)
+/// Set by the handler, cleared by PricerSysTakeSignal().
+static volatile sig_atomic_t sPricerSysSignals[kPSS_Count];
+
+/// System signal number for each ePricerSysSignal.
+static const int kPricerSysSignalNums[kPSS_Count] = { SIGUSR2, SIGTERM,
+                                                      SIGINT,  SIGUSR1,
+                                                      SIGQUIT };
+
+static void PricerSysSignalHandler(int sigNum)
+{
+   for (int i = 0; i < kPSS_Count; ++i)
+   {
+      if (kPricerSysSignalNums[i] == sigNum)
+         sPricerSysSignals[i] = 1;
+   }
+}
+#endif
+
+bool PricerSysWatchSignal(ePricerSysSignal signal)
+{
+#if !defined(_WIN32)
+   struct sigaction action;
+   memset(&action,0,sizeof(action));
+   action.sa_handler = PricerSysSignalHandler;
+   action.sa_flags   = SA_RESTART;
+   sigemptyset(&action.sa_mask);
+   return (0 == sigaction(kPricerSysSignalNums[signal],&action,0));
+#else
+   (void)signal;
+   return false;
+#endif
+}
+
+bool PricerSysTakeSignal(ePricerSysSignal signal)
+{
+#if !defined(_WIN32)
+   if (0 == sPricerSysSignals[signal])
+      return false;
+   sPricerSysSignals[signal] = 0;
+   return true;
+#else
+   (void)signal;
+   return false;
+#endif
+}
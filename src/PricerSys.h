@@ -0,0 +1,89 @@
+/// \file  PricerSys.h
+/// \brief System tuning helpers (CPU pinning, memory locking, pre-faulting).
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerSys_H_
+#define _PricerSys_H_
+
+#include "PricerXplat.h"
+
+/// Pins the calling thread to a single CPU.
+/// Returns false if unsupported or the CPU can't be used.
+bool PricerSysPinThread(int cpu);
+
+/// NUMA node cpu belongs to, or -1 if the system doesn't say.
+int PricerSysCpuNode(int cpu);
+
+/// Locks all current and future pages of the process in memory
+/// (mlockall). Returns false if unsupported or not permitted.
+bool PricerSysLockMemory();
+
+/// Touches every page in [mem, mem+size) so it is resident before use.
+void PricerSysPrefault(void* mem, size_t size);
+
+/// Touches size bytes of stack below the caller.
+void PricerSysPrefaultStack(size_t size);
+
+/// Huge page size PricerSysAllocPages() aligns to (x86-64's 2 MB).
+static const size_t kPricerSysHugePage = 2*1024*1024;
+
+/// Page backing for PricerSysAllocPages().
+enum ePricerSysPages
+{
+   kPSP_Small = 0,      ///< Ordinary pages.
+   kPSP_Transparent,    ///< Transparent huge pages, where the kernel can.
+   kPSP_Explicit        ///< Reserved huge pages (hugetlbfs).
+};
+
+/// Maps size bytes of zeroed memory.
+/// \param pages     In, the backing wanted; out, what was mapped.
+///                  Explicit huge pages (size a multiple of 
+///                  kPricerSysHugePage) fall back to transparent ones,
+///                  and transparent ones to small pages.
+/// \param prefault  Touch every page now.
+/// \return The memory (free with PricerSysFreePages()), or 0.
+void* PricerSysAllocPages(size_t size, ePricerSysPages& pages, bool prefault);
+
+/// Unmaps memory from PricerSysAllocPages().
+void PricerSysFreePages(void* mem, size_t size);
+
+/// Asks for the pages of [mem, mem+size) - page aligned, as from
+/// PricerSysAllocPages() - to be on NUMA node, moving any already 
+/// there.  Returns false if unsupported or refused.
+bool PricerSysBindMemory(void* mem, size_t size, int node);
+
+/// Address range for PricerSysPageMix().
+struct PricerSysRegion
+{
+   const void* fMem;
+   size_t      fSize;
+};
+
+/// Adds up the resident bytes of the mappings holding regions, and
+/// how many of those are on huge pages.  Mappings the kernel merged 
+/// with the regions are counted whole.
+/// Returns false if the system doesn't say (anything but Linux).
+bool PricerSysPageMix(const PricerSysRegion* regions,
+                      size_t                 count,
+                      PXUInt64&              resident,
+                      PXUInt64&              huge);
+
+/// Signals the pricer acts on between messages.
+enum ePricerSysSignal
+{
+   kPSS_Checkpoint = 0,    ///< SIGUSR2 - write a checkpoint now.
+   kPSS_Stop,              ///< SIGTERM - shut down cleanly.
+   kPSS_Interrupt,         ///< SIGINT - likewise.
+   kPSS_Stats,             ///< SIGUSR1 - report latency stats.
+   kPSS_Dump,              ///< SIGQUIT - dump the flight recorder.
+   kPSS_Count
+};
+
+/// Starts catching signal into a flag polled with PricerSysTakeSignal().
+/// Returns false if unsupported (Windows).
+bool PricerSysWatchSignal(ePricerSysSignal signal);
+
+/// True (once) if signal has arrived since the last call.
+bool PricerSysTakeSignal(ePricerSysSignal signal);
+
+#endif // _PricerSys_H_
@@ -0,0 +1,120 @@
+/// \file  PricerTrace.cpp
+/// \brief Flight recorder of book operations, and its dump format.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "PricerTrace.h"
+
+/// path with each "%p" replaced by the process id.
+static std::string PricerTracePath(const char* path)
+{
+   std::string expanded(path ? path : "");
+   char pid[32];
+   sprintf(pid,"%ld",(long)xplat_getpid());
+
+   std::string::size_type pos = 0;
+   while (std::string::npos != (pos = expanded.find("%p",pos)))
+   {
+      expanded.replace(pos,2,pid);
+      pos += strlen(pid);
+   }
+   return expanded;
+}
+
+PricerTraceRing::PricerTraceRing(const char* path, int events)
+: fEvents(0),
+  fMask(0),
+  fNext(0),
+  fTicks(xplat_ticks()),
+  fStartTicks(fTicks),
+  fStartUsec(xplat_usec()),
+  fPath(PricerTracePath(path)),
+  fErrorDumped(false)
+{
+   PXUInt64 size = 1;
+   while ((PXInt64)size < events)
+      size <<= 1;
+
+   // Touched now, so recording never page faults.
+   fEvents = new PricerTraceEvent[(size_t)size];
+   memset(fEvents,0,(size_t)size * sizeof(PricerTraceEvent));
+   fMask = size - 1;
+}
+
+PricerTraceRing::~PricerTraceRing()
+{
+   delete [] fEvents;
+}
+
+bool PricerTraceRing::Dump() const
+{
+   return DumpTo(fPath);
+}
+
+bool PricerTraceRing::DumpError()
+{
+   if (fErrorDumped)
+      return true;
+
+   fErrorDumped = true;
+   return DumpTo(fPath + ".error");
+}
+
+bool PricerTraceRing::DumpTo(const std::string& path) const
+{
+   if (path.empty())
+      return false;
+
+   PXUInt64 size  = fMask + 1;
+   PXUInt64 count = (fNext < size) ? fNext : size;
+   PXUInt64 first = fNext - count;
+
+   PricerTraceHeader header;
+   memset(&header,0,sizeof(header));
+   memcpy(header.fMagic,kPricerTraceMagic,sizeof(header.fMagic));
+   header.fEventSize  = sizeof(PricerTraceEvent);
+   header.fIdFormat   = PRICER_USE_64BIT_IDS;
+   header.fCount      = count;
+   header.fRecorded   = fNext;
+   header.fStartTicks = fStartTicks;
+   header.fStartUsec  = fStartUsec;
+   header.fDumpTicks  = xplat_ticks();
+   header.fDumpUsec   = xplat_usec();
+
+   // A unique temporary beside path, so the rename stays within its
+   // file system and concurrent dumps to one path can't collide.
+   std::string temp = path + ".XXXXXX";
+   std::vector<char> name(temp.begin(),temp.end());
+   name.push_back(0);
+   int fd = xplat_mkstemp(&name[0]);
+   if (fd < 0)
+      return false;
+   temp = &name[0];
+
+   FILE* file = xplat_fdopen(fd,"wb");
+   if (0 == file)
+   {
+      xplat_close(fd);
+      remove(temp.c_str());
+      return false;
+   }
+
+   // Oldest first: from the oldest slot to the end, then the start.
+   PXUInt64 start = first & fMask;
+   PXUInt64 tail  = (start + count > size) ? size - start : count;
+   bool ok = (1 == fwrite(&header,sizeof(header),1,file));
+   ok = ok && (tail  == fwrite(fEvents + start,sizeof(PricerTraceEvent),
+                               (size_t)tail,file));
+   ok = ok && (count - tail == fwrite(fEvents,sizeof(PricerTraceEvent),
+                                      (size_t)(count - tail),file));
+   ok = (0 == fclose(file)) && ok;
+
+   if ((!ok) || (0 != rename(temp.c_str(),path.c_str())))
+   {
+      remove(temp.c_str());
+      return false;
+   }
+   return true;
+}
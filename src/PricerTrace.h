@@ -0,0 +1,159 @@
+/// \file  PricerTrace.h
+/// \brief Flight recorder of book operations, and its dump format.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerTrace_H_
+#define _PricerTrace_H_
+
+#include <string>
+#include "PricerConfig.h"
+#include "PricerDefs.h"
+
+/// Kinds of trace event.  Sides are the input's: 'B' for the book of
+/// buy orders, 'S' for sells - except quotes, which carry the side
+/// quoted ('B' bid, 'S' ask) as the output does.
+enum ePricerTraceEvent
+{
+   kPTE_None = 0,
+   kPTE_Time,           ///< Timestamp moved on to fValue.
+   kPTE_Add,            ///< Order fId added: fShares at price fValue.
+   kPTE_Reduce,         ///< Order fId reduced by fShares.
+   kPTE_Remove,         ///< Order fId reduced by fShares, all it had.
+   kPTE_Target,         ///< Control message: fFlags kPTT_*, fShares.
+   kPTE_Alloc,          ///< Order fId (at fValue) now allocates fShares.
+   kPTE_Marginal,       ///< Order fId (at fValue) is now the marginal
+                        ///  one, with fShares held in all (0 fId: none).
+   kPTE_Quote,          ///< Quote of fValue for fShares, fFlags kPTQ_*.
+   kPTE_Error,          ///< Message failed with ePricerResult fValue.
+   kPTE_Count
+};
+
+/// kPTE_Target flags.
+enum ePricerTraceTarget
+{
+   kPTT_Set = 0,
+   kPTT_Add,
+   kPTT_Remove
+};
+
+/// kPTE_Quote flags.
+enum ePricerTraceQuote
+{
+   kPTQ_Valid = 1,      ///< Else "NA".
+   kPTQ_Extra = 2       ///< An extra target's.
+};
+
+/// One event - 32 bytes, so two to a cache line.
+struct PricerTraceEvent
+{
+   PXUInt64    fTicks;     ///< xplat_ticks() when its batch was read.
+   PXUInt64    fId;        ///< Order id - packed, or its hash.
+   PXInt64     fValue;     ///< Price, total, timestamp or result.
+   PXUInt32    fShares;    ///< Saturated at 0xFFFFFFFF.
+   PXUInt8     fType;      ///< ePricerTraceEvent.
+   PXUInt8     fSide;      ///< 'B', 'S' or 0.
+   PXUInt16    fFlags;
+};
+
+/// Dump file magic.
+static const char kPricerTraceMagic[8] = { 'P','R','T','R','A','C','E','1' };
+
+/// Dump files start with this, followed by fCount events, oldest
+/// first.  Everything is in the writer's byte order.
+struct PricerTraceHeader
+{
+   char        fMagic[8];
+   PXUInt32    fEventSize;    ///< sizeof(PricerTraceEvent).
+   PXUInt32    fIdFormat;     ///< PRICER_USE_64BIT_IDS - 0 if ids are hashes.
+   PXUInt64    fCount;        ///< Events in the file.
+   PXUInt64    fRecorded;     ///< Events ever recorded (the rest were lost).
+   PXUInt64    fStartTicks;   ///< Ticks and usec at the start and at the
+   PXUInt64    fStartUsec;    ///  dump, for converting ticks to time.
+   PXUInt64    fDumpTicks;
+   PXUInt64    fDumpUsec;
+};
+
+/// Id to store in an event.
+#if (PRICER_USE_64BIT_IDS > 0)
+   static xplat_inline PXUInt64 PricerTraceId(const PricerOrderId& id)
+   {
+      return id;
+   }
+#else
+   static xplat_inline PXUInt64 PricerTraceId(const PricerOrderId& id)
+   {
+      return PricerOrderIdHash(id);
+   }
+#endif
+
+/// \class PricerTraceRing
+/// \brief Always-on ring of the last trace events, dumped on demand.
+///
+/// Recording an event is a handful of stores into a preallocated
+/// power-of-two ring - no branches on fullness, no locks, nothing to
+/// flush, no clock.  The parser Stamp()s once per batch of messages
+/// read together, and every event of the batch carries its ticks.
+/// Single threaded: the pricing thread records and dumps.
+class PricerTraceRing
+{
+   public:
+      /// events is rounded up to a power of two.  Dump() writes path,
+      /// with any "%p" in it replaced by the process id.
+      PricerTraceRing(const char* path, int events);
+      ~PricerTraceRing();
+
+      /// Re-reads the cycle counter for the events that follow.
+      void Stamp()
+      {
+         fTicks = xplat_ticks();
+      }
+
+      void Record(ePricerTraceEvent  type,
+                  char               side,
+                  PXUInt64           id,
+                  PXInt64            value,
+                  PXInt64            shares,
+                  PXUInt16           flags = 0)
+      {
+         PricerTraceEvent& event = fEvents[fNext & fMask];
+         ++fNext;
+         event.fTicks  = fTicks;
+         event.fId     = id;
+         event.fValue  = value;
+         event.fShares = (shares < 0) ? 0 :
+                         (shares > (PXInt64)0xFFFFFFFF) ? 0xFFFFFFFF :
+                         (PXUInt32)shares;
+         event.fType   = (PXUInt8)type;
+         event.fSide   = (PXUInt8)side;
+         event.fFlags  = flags;
+      }
+
+      /// Writes the ring, oldest event first, to the path (via a
+      /// temporary file beside it and a rename, so it's never seen 
+      /// half written).
+      bool Dump() const;
+
+      /// Dumps to "path.error" the first time it's called - for the
+      /// first failed message, without a dump per bad line.
+      bool DumpError();
+
+   protected:
+      bool DumpTo(const std::string& path) const;
+
+      PricerTraceEvent*    fEvents;
+      PXUInt64             fMask;
+      PXUInt64             fNext;         ///< Events ever recorded.
+      PXUInt64             fTicks;        ///< Last Stamp().
+      PXUInt64             fStartTicks;
+      PXUInt64             fStartUsec;
+      std::string          fPath;
+      bool                 fErrorDumped;
+
+   private:
+      /// Not implemented.
+      PricerTraceRing(const PricerTraceRing&);
+      /// Not implemented.
+      PricerTraceRing& operator=(const PricerTraceRing&);
+};
+
+#endif // _PricerTrace_H_
@@ -0,0 +1,188 @@
+/// \file  PricerTraceDump.cpp
+/// \brief main() for pricer-tracedump, the flight-recorder decoder.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "PricerTrace.h"
+
+/// Formats an id as the input had it - its packed characters - or as
+/// the hash it was stored as.
+static const char* PricerTraceIdText(PXUInt64 id, bool packed, char* buf)
+{
+   if (!packed)
+   {
+      sprintf(buf,"#%016llx",(unsigned long long)id);
+      return buf;
+   }
+
+   // First character in the highest non-zero byte.
+   int len = 0;
+   for (int shift = 56; shift >= 0; shift -= 8)
+   {
+      char c = (char)((id >> shift) & 0xff);
+      if ((c) || (len))
+         buf[len++] = c;
+   }
+   buf[len] = 0;
+   return buf;
+}
+
+/// Formats cents as dollars, like the quotes.
+static const char* PricerTracePrice(PXInt64 cents, char* buf)
+{
+   const char* sign = (cents < 0) ? "-" : "";
+   if (cents < 0)
+      cents = -cents;
+   sprintf(buf,"%s%lld.%02lld",sign,(long long)(cents / 100),
+           (long long)(cents % 100));
+   return buf;
+}
+
+static const char* PricerTraceBook(PXUInt8 side)
+{
+   return ('B' == side) ? "buy " : "sell";
+}
+
+static void PricerTracePrint(const PricerTraceEvent&  event,
+                             PXUInt64                 seq,
+                             double                   usec,
+                             bool                     packed)
+{
+   char id[32];
+   char price[32];
+   printf("%10llu %14.3f  ",(unsigned long long)seq,usec);
+
+   switch (event.fType)
+   {
+      case kPTE_Time:
+         printf("time     %lld\n",(long long)event.fValue);
+         break;
+      case kPTE_Add:
+         printf("add      %s %s %u @ %s\n",PricerTraceBook(event.fSide),
+                PricerTraceIdText(event.fId,packed,id),event.fShares,
+                PricerTracePrice(event.fValue,price));
+         break;
+      case kPTE_Reduce:
+      case kPTE_Remove:
+         printf("%s %s %s by %u\n",
+                (kPTE_Remove == event.fType) ? "remove  " : "reduce  ",
+                PricerTraceBook(event.fSide),
+                PricerTraceIdText(event.fId,packed,id),event.fShares);
+         break;
+      case kPTE_Target:
+         printf("target   %s %u\n",
+                (kPTT_Add == event.fFlags)    ? "add"    :
+                (kPTT_Remove == event.fFlags) ? "remove" : "set",
+                event.fShares);
+         break;
+      case kPTE_Alloc:
+         printf("alloc    %s %s @ %s owns %u\n",PricerTraceBook(event.fSide),
+                PricerTraceIdText(event.fId,packed,id),
+                PricerTracePrice(event.fValue,price),event.fShares);
+         break;
+      case kPTE_Marginal:
+         if (event.fId)
+            printf("marginal %s %s @ %s, %u held\n",
+                   PricerTraceBook(event.fSide),
+                   PricerTraceIdText(event.fId,packed,id),
+                   PricerTracePrice(event.fValue,price),event.fShares);
+         else
+            printf("marginal %s none, %u held\n",
+                   PricerTraceBook(event.fSide),event.fShares);
+         break;
+      case kPTE_Quote:
+         printf("quote    %c %s for %u%s\n",(char)event.fSide,
+                (event.fFlags & kPTQ_Valid) ?
+                   PricerTracePrice(event.fValue,price) : "NA",
+                event.fShares,
+                (event.fFlags & kPTQ_Extra) ? " (extra)" : "");
+         break;
+      case kPTE_Error:
+         if (event.fId)
+            printf("error    %lld on %s\n",(long long)event.fValue,
+                   PricerTraceIdText(event.fId,packed,id));
+         else
+            printf("error    %lld\n",(long long)event.fValue);
+         break;
+      default:
+         printf("unknown  type %u\n",(unsigned)event.fType);
+         break;
+   }
+}
+
+/// Prints a flight-recorder dump (from --trace) as text, one event a
+/// line: its sequence number, usec since the first event in the dump,
+/// and the event.  Prices are dollars, as in the quotes.
+///
+///   pricer-tracedump file [count]   - the last count events, or all.
+int main(int argc, char** argv)
+{
+   if ((argc < 2) || (argc > 3))
+   {
+      fprintf(stderr,"Usage: pricer-tracedump file [count]\n");
+      return 1;
+   }
+
+   FILE* file = fopen(argv[1],"rb");
+   if (0 == file)
+   {
+      fprintf(stderr,"Can't open %s.\n",argv[1]);
+      return 1;
+   }
+
+   PricerTraceHeader header;
+   if ((1 != fread(&header,sizeof(header),1,file)) ||
+       (0 != memcmp(header.fMagic,kPricerTraceMagic,sizeof(header.fMagic))) ||
+       (sizeof(PricerTraceEvent) != header.fEventSize))
+   {
+      fprintf(stderr,"%s isn't a pricer trace (from this build).\n",argv[1]);
+      fclose(file);
+      return 1;
+   }
+
+   std::vector<PricerTraceEvent> events((size_t)header.fCount);
+   if ((header.fCount) &&
+       (header.fCount != fread(&events[0],sizeof(PricerTraceEvent),
+                               (size_t)header.fCount,file)))
+   {
+      fprintf(stderr,"%s is truncated.\n",argv[1]);
+      fclose(file);
+      return 1;
+   }
+   fclose(file);
+
+   size_t first = 0;
+   if (argc > 2)
+   {
+      size_t count = (size_t)atol(argv[2]);
+      if (count < events.size())
+         first = events.size() - count;
+   }
+
+   // Ticks per usec, over the recorder's life.
+   double ticksPerUsec = 1.0;
+   if (header.fDumpUsec > header.fStartUsec)
+   {
+      ticksPerUsec = (double)(header.fDumpTicks - header.fStartTicks) /
+                     (double)(header.fDumpUsec - header.fStartUsec);
+   }
+
+   printf("%llu events recorded, %llu in the dump",
+          (unsigned long long)header.fRecorded,
+          (unsigned long long)header.fCount);
+   if (first)
+      printf(", last %llu shown",(unsigned long long)(events.size() - first));
+   printf(".\n%10s %14s  %s\n","seq","usec","event");
+
+   PXUInt64 seq = header.fRecorded - header.fCount;
+   for (size_t i = first; i < events.size(); ++i)
+   {
+      double usec = (double)(PXInt64)(events[i].fTicks - events[first].fTicks) /
+                    ticksPerUsec;
+      PricerTracePrint(events[i],seq + i,usec,(0 != header.fIdFormat));
+   }
+   return 0;
+}
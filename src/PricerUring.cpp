@@ -0,0 +1,214 @@
+/// \file  PricerUring.cpp
+/// \brief Minimal io_uring wrapper for the Pricer streams (Linux only).
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include "PricerUring.h"
+
+#if (PRICER_USE_IO_URING > 0)
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+static int PricerUringSetup(unsigned int entries, struct io_uring_params* p)
+{
+   return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int PricerUringEnter(int fd, unsigned int toSubmit,
+                            unsigned int minComplete, unsigned int flags)
+{
+   return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete,
+                       flags, (void*)0, (size_t)0);
+}
+
+static int PricerUringRegister(int fd, unsigned int opcode,
+                               const void* arg, unsigned int nrArgs)
+{
+   return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+PricerUring::PricerUring()
+: fRingFd(-1),
+  fSqRingPtr(0),
+  fSqRingSize(0),
+  fCqRingPtr(0),
+  fCqRingSize(0),
+  fSqesPtr(0),
+  fSqesSize(0),
+  fSqHead(0),
+  fSqTail(0),
+  fSqMask(0),
+  fSqArray(0),
+  fCqHead(0),
+  fCqTail(0),
+  fCqMask(0),
+  fCqes(0)
+{
+}
+
+PricerUring::~PricerUring()
+{
+   if (fSqesPtr)
+      munmap(fSqesPtr,fSqesSize);
+   if (fCqRingPtr && (fCqRingPtr != fSqRingPtr))
+      munmap(fCqRingPtr,fCqRingSize);
+   if (fSqRingPtr)
+      munmap(fSqRingPtr,fSqRingSize);
+
+   // Closing the ring cancels anything still in flight.
+   if (fRingFd >= 0)
+      close(fRingFd);
+}
+
+bool PricerUring::Init(unsigned int entries)
+{
+   struct io_uring_params params;
+   memset(&params,0,sizeof(params));
+
+   fRingFd = PricerUringSetup(entries,&params);
+   if (fRingFd < 0)
+      return false;
+
+   // Need offset -1 support for pipes / appending.
+   if (0 == (params.features & IORING_FEAT_RW_CUR_POS))
+   {
+      close(fRingFd);
+      fRingFd = -1;
+      return false;
+   }
+
+   fSqRingSize = params.sq_off.array + params.sq_entries*sizeof(unsigned int);
+   fCqRingSize = params.cq_off.cqes +
+                 params.cq_entries*sizeof(struct io_uring_cqe);
+   bool single = (0 != (params.features & IORING_FEAT_SINGLE_MMAP));
+   if (single && (fCqRingSize > fSqRingSize))
+      fSqRingSize = fCqRingSize;
+
+   fSqRingPtr = mmap(0, fSqRingSize, PROT_READ|PROT_WRITE,
+                     MAP_SHARED|MAP_POPULATE, fRingFd, IORING_OFF_SQ_RING);
+   if (MAP_FAILED == fSqRingPtr)
+   {
+      fSqRingPtr = 0;
+      return false;
+   }
+
+   if (single)
+   {
+      fCqRingPtr  = fSqRingPtr;
+      fCqRingSize = fSqRingSize;
+   }
+   else
+   {
+      fCqRingPtr = mmap(0, fCqRingSize, PROT_READ|PROT_WRITE,
+                        MAP_SHARED|MAP_POPULATE, fRingFd, IORING_OFF_CQ_RING);
+      if (MAP_FAILED == fCqRingPtr)
+      {
+         fCqRingPtr = 0;
+         return false;
+      }
+   }
+
+   fSqesSize = params.sq_entries*sizeof(struct io_uring_sqe);
+   fSqesPtr  = mmap(0, fSqesSize, PROT_READ|PROT_WRITE,
+                    MAP_SHARED|MAP_POPULATE, fRingFd, IORING_OFF_SQES);
+   if (MAP_FAILED == fSqesPtr)
+   {
+      fSqesPtr = 0;
+      return false;
+   }
+
+   char* sq = (char*)fSqRingPtr;
+   char* cq = (char*)fCqRingPtr;
+   fSqHead  = (unsigned int*)(sq + params.sq_off.head);
+   fSqTail  = (unsigned int*)(sq + params.sq_off.tail);
+   fSqMask  = (unsigned int*)(sq + params.sq_off.ring_mask);
+   fSqArray = (unsigned int*)(sq + params.sq_off.array);
+   fCqHead  = (unsigned int*)(cq + params.cq_off.head);
+   fCqTail  = (unsigned int*)(cq + params.cq_off.tail);
+   fCqMask  = (unsigned int*)(cq + params.cq_off.ring_mask);
+   fCqes    = cq + params.cq_off.cqes;
+   return true;
+}
+
+bool PricerUring::RegisterBuffers(const struct iovec* iovs, unsigned int count)
+{
+   if (fRingFd < 0)
+      return false;
+   return (0 == PricerUringRegister(fRingFd,IORING_REGISTER_BUFFERS,
+                                    iovs,count));
+}
+
+bool PricerUring::SubmitRead(int fd, int bufIndex, void* buf,
+                             unsigned int len, PXInt64 offset,
+                             PXUInt64 userData)
+{
+   return Submit(IORING_OP_READ_FIXED,fd,bufIndex,buf,len,offset,userData);
+}
+
+bool PricerUring::SubmitWrite(int fd, int bufIndex, const void* buf,
+                              unsigned int len, PXInt64 offset,
+                              PXUInt64 userData)
+{
+   return Submit(IORING_OP_WRITE_FIXED,fd,bufIndex,buf,len,offset,userData);
+}
+
+bool PricerUring::Submit(int op, int fd, int bufIndex, const void* buf,
+                         unsigned int len, PXInt64 offset, PXUInt64 userData)
+{
+   unsigned int tail = *fSqTail;
+   unsigned int head = __atomic_load_n(fSqHead,__ATOMIC_ACQUIRE);
+   unsigned int mask = *fSqMask;
+
+   // Full - callers keep at most a couple in flight, so this is a bug.
+   if (tail - head > mask)
+      return false;
+
+   unsigned int index = tail & mask;
+   struct io_uring_sqe* sqe = ((struct io_uring_sqe*)fSqesPtr) + index;
+   memset(sqe,0,sizeof(*sqe));
+   sqe->opcode    = (PXUInt8)op;
+   sqe->fd        = fd;
+   sqe->off       = (PXUInt64)offset;
+   sqe->addr      = (PXUInt64)(size_t)buf;
+   sqe->len       = len;
+   sqe->buf_index = (PXUInt16)bufIndex;
+   sqe->user_data = userData;
+
+   fSqArray[index] = index;
+   __atomic_store_n(fSqTail,tail+1,__ATOMIC_RELEASE);
+
+   int res;
+   do
+   {
+      res = PricerUringEnter(fRingFd,1,0,0);
+   } while ((res < 0) && (errno == EINTR));
+
+   return (res == 1);
+}
+
+bool PricerUring::HasCompletion() const
+{
+   return (*fCqHead != __atomic_load_n(fCqTail,__ATOMIC_ACQUIRE));
+}
+
+bool PricerUring::WaitCompletion(PXUInt64& userData, int& res)
+{
+   while (!HasCompletion())
+   {
+      int rc = PricerUringEnter(fRingFd,0,1,IORING_ENTER_GETEVENTS);
+      if ((rc < 0) && (errno != EINTR))
+         return false;
+   }
+
+   unsigned int head = *fCqHead;
+   struct io_uring_cqe* cqe =
+      ((struct io_uring_cqe*)fCqes) + (head & *fCqMask);
+   userData = cqe->user_data;
+   res      = cqe->res;
+   __atomic_store_n(fCqHead,head+1,__ATOMIC_RELEASE);
+   return true;
+}
+
+#endif // PRICER_USE_IO_URING
@@ -0,0 +1,87 @@
+/// \file  PricerUring.h
+/// \brief Minimal io_uring wrapper for the Pricer streams (Linux only).
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#ifndef _PricerUring_H_
+#define _PricerUring_H_
+
+#include "PricerXplat.h"
+
+#if (PRICER_USE_IO_URING > 0)
+
+struct iovec;
+
+/// \class PricerUring
+/// \brief Tiny io_uring submission/completion queue pair.
+///
+/// Talks to the kernel directly through the io_uring syscalls so we
+/// don't drag in liburing.  Only what the streams need is here:
+/// fixed-buffer reads and writes, one or two requests in flight.
+///
+/// Requires IORING_FEAT_RW_CUR_POS (Linux 5.6+) so offset -1 can be
+/// used on pipes and to append at the current file position.  If
+/// Init() fails, callers should stay on the synchronous path.
+class PricerUring
+{
+   public:
+      PricerUring();
+      ~PricerUring();
+
+      /// Sets up the rings. Returns false if io_uring is unavailable.
+      bool Init(unsigned int entries);
+
+      /// Registers fixed buffers. Buffer indices follow the iovec order.
+      bool RegisterBuffers(const struct iovec* iovs, unsigned int count);
+
+      /// Queues and submits a READ_FIXED into registered buffer bufIndex.
+      /// offset -1 reads from the current file position.
+      bool SubmitRead(int fd, int bufIndex, void* buf, unsigned int len,
+                      PXInt64 offset, PXUInt64 userData);
+
+      /// Queues and submits a WRITE_FIXED from registered buffer bufIndex.
+      /// offset -1 writes at (and advances) the current file position.
+      bool SubmitWrite(int fd, int bufIndex, const void* buf,
+                       unsigned int len, PXInt64 offset, PXUInt64 userData);
+
+      /// Waits for the next completion.
+      /// \param userData  userData of the completed request.
+      /// \param res       Result (bytes, or -errno).
+      bool WaitCompletion(PXUInt64& userData, int& res);
+
+      /// True if a completion is waiting (WaitCompletion won't block).
+      bool HasCompletion() const;
+
+      bool IsValid() const { return fRingFd >= 0; }
+
+   protected:
+      bool Submit(int op, int fd, int bufIndex, const void* buf,
+                  unsigned int len, PXInt64 offset, PXUInt64 userData);
+
+      int            fRingFd;
+
+      void*          fSqRingPtr;
+      size_t         fSqRingSize;
+      void*          fCqRingPtr;
+      size_t         fCqRingSize;
+      void*          fSqesPtr;
+      size_t         fSqesSize;
+
+      // Pointers into the mapped rings.
+      unsigned int*  fSqHead;
+      unsigned int*  fSqTail;
+      unsigned int*  fSqMask;
+      unsigned int*  fSqArray;
+      unsigned int*  fCqHead;
+      unsigned int*  fCqTail;
+      unsigned int*  fCqMask;
+      void*          fCqes;
+   private:
+      /// Not implemented.
+      PricerUring(const PricerUring&);
+      /// Not implemented.
+      PricerUring& operator=(const PricerUring&);
+};
+
+#endif // PRICER_USE_IO_URING
+
+#endif // _PricerUring_H_
@@ -11,10 +11,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <time.h>
 
 #if defined (_WIN32)   
    #include <io.h>
    #include <fcntl.h>
+   #include <process.h>
    #include <memory.h>
    #include <string.h>
 
@@ -56,6 +58,12 @@
    #define xplat_open(x,y,z)      _open(x,y,z)
    #define xplat_close(x)         _close(x)
    #define xplat_commit(x)        _commit(x)
+   #define xplat_fdopen(x,y)      _fdopen(x,y)
+   #define xplat_getpid()         _getpid()
+   // No mkstemp(): name it, then claim the name with an exclusive create.
+   #define xplat_mkstemp(x)       ((0 != _mktemp_s(x,strlen(x) + 1)) ? -1 : \
+                                   _open(x,_O_CREAT | _O_EXCL | _O_WRONLY | \
+                                         _O_BINARY,_S_IREAD | _S_IWRITE))
 
    #define xplat_IsRegularStream  _S_IFREG
    #define xplat_BinaryMode       _O_BINARY
@@ -69,6 +77,8 @@
 #else // nix, osx
    #include <unistd.h>
    #include <errno.h>
+   #include <poll.h>
+   #include <sys/uio.h>
    #include <memory.h>
    #include <string.h>
    // Make sure the type definitions are correct.
@@ -103,6 +113,9 @@
    #define xplat_setmode(x,y)     (0)
    #define xplat_lseek(x,y,z)     lseek(x,y,z)
    #define xplat_close(x)         close(x)
+   #define xplat_fdopen(x,y)      fdopen(x,y)
+   #define xplat_getpid()         getpid()
+   #define xplat_mkstemp(x)       mkstemp(x)
 
    #define xplat_itoa(x,y,z)      itoa(x,y,z)
 
@@ -137,6 +150,109 @@ static xplat_inline ssize_t xplat_read(int fd,void* buf, unsigned int count)
    #define xplat_read(x,y,z) xplat_readfunc(x,y,z)
 #endif
 
+/// CPU hint for spin-wait loops.
+#if (defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)))
+   #define xplat_cpu_relax()      __builtin_ia32_pause()
+#else
+   #define xplat_cpu_relax()      ((void)0)
+#endif
+
+/// Cache prefetch hint for an address about to be read.
+#if defined(__GNUC__)
+   #define xplat_prefetch(x)      __builtin_prefetch((x))
+#elif defined(_WIN32)
+   #include <xmmintrin.h>
+   #define xplat_prefetch(x)      _mm_prefetch((const char*)(x),_MM_HINT_T0)
+#else
+   #define xplat_prefetch(x)      ((void)0)
+#endif
+
+/// Fences for lock-free publication (seqlocks): release keeps earlier
+/// stores ahead of later stores, acquire earlier loads ahead of later
+/// loads.
+#if defined(__GNUC__)
+   #define xplat_fence_release()  __atomic_thread_fence(__ATOMIC_RELEASE)
+   #define xplat_fence_acquire()  __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#elif defined(_WIN32)
+   #include <intrin.h>
+   // x86 keeps stores and loads in order - only the compiler mustn't
+   // move them.
+   #define xplat_fence_release()  _ReadWriteBarrier()
+   #define xplat_fence_acquire()  _ReadWriteBarrier()
+#else
+   #define xplat_fence_release()  __sync_synchronize()
+   #define xplat_fence_acquire()  __sync_synchronize()
+#endif
+
+/// Full fence - also keeps earlier stores ahead of later loads - and
+/// compare-and-swap of a 32-bit value, for epoch-based reclamation.
+#if defined(__GNUC__)
+   #define xplat_fence_full()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+   #define xplat_cas32(p,o,n)     __sync_bool_compare_and_swap((p),(o),(n))
+#elif defined(_WIN32)
+   #define xplat_fence_full()     _mm_mfence()
+   #define xplat_cas32(p,o,n)     ((long)(o) == \
+              _InterlockedCompareExchange((volatile long*)(p),(long)(n),(long)(o)))
+#else
+   #define xplat_fence_full()     __sync_synchronize()
+   #define xplat_cas32(p,o,n)     __sync_bool_compare_and_swap((p),(o),(n))
+#endif
+
+/// Relaxed atomic load and store of a 64-bit value: never torn (even
+/// on 32-bit targets) but no ordering beyond that - for counters one
+/// thread updates while another reads them.  Win32 builds have no
+/// such readers.
+#if defined(__GNUC__)
+   #define xplat_load64(p)        __atomic_load_n((p),__ATOMIC_RELAXED)
+   #define xplat_store64(p,v)     __atomic_store_n((p),(v),__ATOMIC_RELAXED)
+#else
+   #define xplat_load64(p)        (*(p))
+   #define xplat_store64(p,v)     (*(p) = (v))
+#endif
+
+#if defined(_WIN32)
+/// Monotonic-ish time in microseconds (clock() resolution on win32).
+static xplat_inline PXUInt64 xplat_usec()
+{
+   return ((PXUInt64)clock()*1000000)/CLOCKS_PER_SEC;
+}
+
+/// No cheap readiness check on win32 pipes - always report readable
+/// so callers fall back to their blocking behavior.
+static xplat_inline bool xplat_readable(int fd)
+{
+   return true;
+}
+#else
+/// Monotonic time in microseconds.
+static xplat_inline PXUInt64 xplat_usec()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC,&ts);
+   return (PXUInt64)ts.tv_sec*1000000 + (PXUInt64)(ts.tv_nsec/1000);
+}
+
+/// Returns true if a read() on fd would not block (data, EOF or error).
+static xplat_inline bool xplat_readable(int fd)
+{
+   struct pollfd pfd;
+   pfd.fd      = fd;
+   pfd.events  = POLLIN;
+   pfd.revents = 0;
+   return (0 != poll(&pfd,1,0));
+}
+#endif
+
+/// Cheap cycle counter for timing - the TSC on x86, microseconds
+/// elsewhere.  Calibrate against xplat_usec() for real time.
+#if (defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)))
+   #define xplat_ticks()          ((PXUInt64)__builtin_ia32_rdtsc())
+#elif defined(_WIN32)
+   #define xplat_ticks()          ((PXUInt64)__rdtsc())
+#else
+   #define xplat_ticks()          xplat_usec()
+#endif
+
 /// 64-bit value packed with ASCII characters.
 /// May be used for ids.
 typedef PXUInt64           PXPacked64;
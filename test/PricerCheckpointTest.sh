@@ -0,0 +1,95 @@
+#!/bin/sh
+# Checks that restoring a checkpoint resumes exactly where it was taken:
+# the quotes up to a mid-feed checkpoint followed by a run restored from
+# it must match one uninterrupted run - from a file and from a pipe -
+# and a --window run started from the --index must match one replayed
+# from the top.
+#
+#   PricerCheckpointTest.sh path/to/pricer [workdir]
+
+pricer=$1
+work=${2:-/tmp}/PricerCheckpoint
+
+[ -x "$pricer" ] || { echo "usage: $0 path/to/pricer [workdir]"; exit 1; }
+
+rm -rf "$work"
+mkdir -p "$work" || exit 1
+cd "$work" || exit 1
+case $pricer in
+   /*) ;;
+   *)  pricer=$OLDPWD/$pricer ;;
+esac
+
+# Adds around a drifting mid and removes of a random live order, about
+# as many of each, with timestamps moving 0-3 a message.
+awk 'BEGIN {
+   srand(3); ts = 28800000; live = 0; id = 0; mid = 5000;
+   for (n = 0; n < 60000; ++n) {
+      ts += int(rand() * 4);
+      if ((live > 400) || ((live > 0) && (rand() < 0.45))) {
+         j = 1 + int(rand() * live); o = ids[j];
+         print ts, "R", o, size[o];
+         ids[j] = ids[live]; --live; delete size[o];
+      } else {
+         mid += int(rand() * 21) - 10;
+         side = (rand() < 0.5) ? "B" : "S";
+         p = (side == "B") ? mid - int(rand() * 300) : mid + int(rand() * 300);
+         o = "o" (++id); ids[++live] = o; size[o] = 50 * (1 + int(rand() * 8));
+         printf "%d A %s %s %d.%02d %d\n", ts, o, side, p / 100, p % 100, size[o];
+      }
+   }
+}' > feed
+
+status=0
+fail()
+{
+   echo "checkpoint: $1"
+   status=1
+}
+
+for target in 1 200 1000; do
+   rm -f ck.* index
+   "$pricer" --no-trace $target < feed > full 2>/dev/null
+
+   # Checkpoints every 10000 messages, each kept and indexed.  Taking
+   # them mustn't change the output.
+   "$pricer" --no-trace --checkpoint=ck --checkpoint-every=10000 \
+             --index=index $target < feed > saving 2>/dev/null
+   cmp -s saving full || fail "checkpointing changed the output at target $target"
+
+   # The third of them ("timestamp offset path" lines).
+   set -- $(sed -n 3p index)
+   if [ $# -ne 3 ]; then
+      fail "no third checkpoint in the index at target $target"
+      continue
+   fi
+   start=$1
+   offset=$2
+   saved=$3
+
+   # Quotes up to the checkpoint, then from a restore of it.
+   head -c "$offset" feed > before.in
+   "$pricer" --no-trace $target < before.in > before 2>/dev/null
+
+   "$pricer" --no-trace --restore="$saved" $target < feed > after 2>/dev/null
+   cat before after | cmp -s - full ||
+      fail "restore from a file differs at target $target"
+
+   cat feed | "$pricer" --no-trace --restore="$saved" $target > after 2>/dev/null
+   cat before after | cmp -s - full ||
+      fail "restore from a pipe differs at target $target"
+
+   # A window starting after the checkpoint, replayed and indexed.
+   window=$((start + 2000))-$((start + 12000))
+   "$pricer" --no-trace --window=$window $target < feed > replayed 2>/dev/null
+   "$pricer" --no-trace --window=$window --index=index $target < feed \
+             > indexed 2>/dev/null
+   [ -s replayed ] || fail "empty window at target $target"
+   cmp -s replayed indexed ||
+      fail "indexed window differs at target $target"
+done
+
+cd /
+rm -rf "$work"
+[ $status -eq 0 ] && echo "checkpoint: checked"
+exit $status
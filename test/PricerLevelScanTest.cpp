@@ -0,0 +1,78 @@
+/// \file  PricerLevelScanTest.cpp
+/// \brief Checks each level-scan kernel against the scalar one.
+//
+// Copyright (c) 2009 Michael Ellison. All Rights Reserved.
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "PricerLevelScan.h"
+
+static const char* kKernelNames[kPLS_Count] = { "scalar", "avx2", "avx512" };
+
+/// Scans levels with kernel and the scalar kernel for a spread of
+/// share counts; returns the mismatches.
+static int PricerCheckLevels(PricerLevelScanFn          kernel,
+                             const char*                name,
+                             const std::vector<PXInt64>& levels,
+                             PXInt64                    count)
+{
+   PXInt64 total = 0;
+   for (PXInt64 i = 0; i < count; ++i)
+      total += levels[(size_t)i];
+
+   int failures = 0;
+   for (PXInt64 shares = 1; shares <= total + 2; shares += 1 + shares / 7)
+   {
+      PricerLevelScanResult want = PricerLevelScanScalar(&levels[0],count,shares);
+      PricerLevelScanResult got  = kernel(&levels[0],count,shares);
+      if ((want.level != got.level) ||
+          (want.qtyBefore != got.qtyBefore) ||
+          (want.runBefore != got.runBefore))
+      {
+         if (++failures <= 10)
+            fprintf(stderr,"%s: count %lld shares %lld: level %lld/%lld "
+                    "qty %lld/%lld run %lld/%lld\n",name,(long long)count,
+                    (long long)shares,(long long)got.level,
+                    (long long)want.level,(long long)got.qtyBefore,
+                    (long long)want.qtyBefore,(long long)got.runBefore,
+                    (long long)want.runBefore);
+      }
+   }
+   return failures;
+}
+
+int main()
+{
+   srand(1);
+
+   int failures = 0;
+   for (int k = kPLS_Avx2; k < kPLS_Count; ++k)
+   {
+      PricerLevelScanFn kernel = PricerLevelScanKernel((ePricerLevelScanKernel)k);
+      if (0 == kernel)
+      {
+         printf("%s: not supported here, skipped\n",kKernelNames[k]);
+         continue;
+      }
+
+      // Every length around the vector widths, sparse and dense books.
+      for (PXInt64 count = 0; count <= 67; ++count)
+      {
+         for (int density = 1; density <= 4; ++density)
+         {
+            std::vector<PXInt64> levels((size_t)count + 1,0);
+            for (PXInt64 i = 0; i < count; ++i)
+            {
+               if (0 == (rand() % density))
+                  levels[(size_t)i] = rand() % 1000;
+            }
+            failures += PricerCheckLevels(kernel,kKernelNames[k],levels,count);
+         }
+      }
+      printf("%s: checked\n",kKernelNames[k]);
+   }
+
+   if (failures)
+      fprintf(stderr,"%d mismatches\n",failures);
+   return failures ? 1 : 0;
+}